@@ -0,0 +1,243 @@
+/*
+ *  batch.c
+ *
+ *  Copyright (C) 2016  Nathan Bossart
+ */
+
+/* needed for sysconf() under -std=c99 */
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include "batch.h"
+#include "common.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "utils.h"
+#include "workspace.h"
+
+/*
+ * The range of files a worker still has to analyze.  The owner takes files
+ * from the head, and idle workers steal half of the range from the tail.
+ *
+ * lock : protects head and tail
+ * head : index of the next file the owner will take
+ * tail : one past the index of the last file in the range
+ */
+struct batch_deque
+{
+	pthread_mutex_t	lock;
+	long		head;
+	long		tail;
+};
+
+/*
+ * Everything a worker thread needs.
+ *
+ * id             : index of this worker in the workers array
+ * workers        : every worker in the batch (for stealing)
+ * num_workers    : the number of workers in the batch
+ * deque          : the files this worker has left to analyze
+ * filenames      : the files in the batch
+ * secs_to_sample : the number of seconds to analyze in each file
+ * results        : one note per file
+ */
+struct batch_worker
+{
+	int			id;
+	struct batch_worker *	workers;
+	int			num_workers;
+	struct batch_deque	deque;
+	const char * const *	filenames;
+	double			secs_to_sample;
+	struct note *		results;
+};
+
+/* function prototypes for static functions */
+static void *		run_batch_worker(void *arg);
+static bool		take_file(struct batch_worker *worker, long *index);
+static bool		steal_files(struct batch_worker *worker);
+
+/*
+ * This function detects the note in each of the given files, exactly like
+ * calling get_note_from_file() on each of them, but spreads the files over
+ * num_threads worker threads.  If num_threads is less than 1, one thread per
+ * online processor is used.  The note for filenames[i] is stored in
+ * results[i]; files that could not be analyzed get an invalid note.
+ *
+ * Each worker starts with an equal share of the files and steals from the
+ * others when it runs out, so a few long or slow files don't leave the rest of
+ * the workers idle.  Each worker analyzes in its own workspace, which it keeps
+ * between files, and FFT plans are shared through the (thread-safe) plan
+ * cache.
+ *
+ * Returns BATCH_SUCCESS_CODE, or BATCH_FAILURE_CODE for illegal arguments or
+ * if the threads could not be started.
+ */
+int get_notes_from_files(const char * const * const filenames, long num_files, double secs_to_sample, int num_threads, struct note *results)
+{
+	struct batch_worker	*workers;
+	pthread_t		*threads;
+	long			files_per_worker;
+	long			remainder;
+	long			start;
+	int			threads_started;
+	int			i;
+
+	if (NULL == filenames || NULL == results || 0 > num_files) {
+		fprintf(stderr, "filenames and results cannot be NULL\n");
+		return BATCH_FAILURE_CODE;
+	}
+
+	if (0.0 >= secs_to_sample) {
+		fprintf(stderr, "secs_to_sample is less than zero\n");
+		return BATCH_FAILURE_CODE;
+	}
+
+	if (0 == num_files) {
+		return BATCH_SUCCESS_CODE;
+	}
+
+	if (1 > num_threads) {
+		num_threads = MAX(1, sysconf(_SC_NPROCESSORS_ONLN));
+	}
+
+	/* there's no sense in starting threads with nothing to do */
+	num_threads = MIN(num_threads, num_files);
+
+	workers = (struct batch_worker *) CALLOC_SAFELY(num_threads, sizeof(struct batch_worker));
+	threads = (pthread_t *) MALLOC_SAFELY(num_threads * sizeof(pthread_t));
+
+	/* hand out contiguous, (nearly) equal ranges of files */
+	files_per_worker = num_files / num_threads;
+	remainder = num_files % num_threads;
+	start = 0;
+	for (i = 0; i < num_threads; ++i) {
+		workers[i].id			= i;
+		workers[i].workers		= workers;
+		workers[i].num_workers		= num_threads;
+		workers[i].filenames		= filenames;
+		workers[i].secs_to_sample	= secs_to_sample;
+		workers[i].results		= results;
+		workers[i].deque.head		= start;
+		workers[i].deque.tail		= start + files_per_worker + (i < remainder ? 1 : 0);
+		start = workers[i].deque.tail;
+		pthread_mutex_init(&(workers[i].deque.lock), NULL);
+	}
+
+	/*
+	 * If we can't start a thread, the workers that did start will steal its
+	 * files.  If we can't start any, we do it all on this thread.
+	 */
+	for (threads_started = 0; threads_started < num_threads; ++threads_started) {
+		if (0 != pthread_create(&threads[threads_started], NULL, run_batch_worker, &workers[threads_started])) {
+			break;
+		}
+	}
+
+	if (0 == threads_started) {
+		run_batch_worker(&workers[0]);
+	}
+
+	for (i = 0; i < threads_started; ++i) {
+		pthread_join(threads[i], NULL);
+	}
+
+	for (i = 0; i < num_threads; ++i) {
+		pthread_mutex_destroy(&(workers[i].deque.lock));
+	}
+	FREE_SAFELY(threads);
+	FREE_SAFELY(workers);
+
+	return BATCH_SUCCESS_CODE;
+}
+
+/*
+ * Static function run by each worker thread.  It analyzes the files in its own
+ * range and then steals from the others until there is nothing left anywhere.
+ */
+static void *run_batch_worker(void *arg)
+{
+	struct batch_worker		*worker;
+	struct detection_options	options;
+	long				index;
+
+	worker = (struct batch_worker *) arg;
+	assert(NULL != worker);
+
+	/* the workspace grows to fit the longest file and is reused for the rest */
+	init_detection_options(&options);
+	options.workspace = create_workspace(0, 0);
+
+	do {
+		while (take_file(worker, &index)) {
+			worker->results[index] = get_note_from_file_with_options(worker->filenames[index],
+				worker->secs_to_sample, &options);
+		}
+	} while (steal_files(worker));
+
+	destroy_workspace(options.workspace);
+
+	return NULL;
+}
+
+/*
+ * Static function that takes the next file from the head of the worker's own
+ * range.  Returns false if the range is empty.
+ */
+static bool take_file(struct batch_worker *worker, long *index)
+{
+	bool ret;
+
+	assert(NULL != worker);
+	assert(NULL != index);
+
+	pthread_mutex_lock(&(worker->deque.lock));
+	ret = (worker->deque.head < worker->deque.tail);
+	if (ret) {
+		*index = worker->deque.head++;
+	}
+	pthread_mutex_unlock(&(worker->deque.lock));
+
+	return ret;
+}
+
+/*
+ * Static function that moves half of another worker's remaining files (rounded
+ * up) into this worker's (empty) range.  Victims are tried in order starting
+ * with the next worker.  Since no new files ever show up, a worker that finds
+ * nothing to steal is done.
+ *
+ * Returns false if there was nothing left to steal.
+ */
+static bool steal_files(struct batch_worker *worker)
+{
+	struct batch_deque	*victim;
+	long			count;
+	long			stolen_head;
+	int			i;
+
+	assert(NULL != worker);
+
+	for (i = 1; i < worker->num_workers; ++i) {
+		victim = &(worker->workers[(worker->id + i) % worker->num_workers].deque);
+
+		pthread_mutex_lock(&(victim->lock));
+		count = (victim->tail - victim->head + 1) / 2;
+		victim->tail -= count;
+		stolen_head = victim->tail;
+		pthread_mutex_unlock(&(victim->lock));
+
+		if (0 < count) {
+			pthread_mutex_lock(&(worker->deque.lock));
+			worker->deque.head = stolen_head;
+			worker->deque.tail = stolen_head + count;
+			pthread_mutex_unlock(&(worker->deque.lock));
+			return true;
+		}
+	}
+
+	return false;
+}
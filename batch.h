@@ -0,0 +1,18 @@
+/*
+ *  batch.h
+ *
+ *  Copyright (C) 2016  Nathan Bossart
+ */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "common.h"
+
+/* return codes for the batch analysis functions */
+#define BATCH_SUCCESS_CODE	0
+#define BATCH_FAILURE_CODE	-1
+
+int	get_notes_from_files(const char * const * const filenames, long num_files, double secs_to_sample, int num_threads, struct note *results);
+
+#endif
@@ -0,0 +1,469 @@
+/*
+ *  bench.c
+ *
+ *  Copyright (C) 2016  Nathan Bossart
+ */
+
+/* for clock_gettime() */
+#define _POSIX_C_SOURCE 199309L
+
+#include <assert.h>
+#include <fftw3.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "tonedef.h"
+
+/* every case runs at least this many times... */
+#define BENCH_MIN_ITERATIONS		20
+
+/* ...and for at least this many seconds... */
+#define BENCH_MIN_SECONDS		0.1
+
+/* ...but never more than this many times */
+#define BENCH_MAX_ITERATIONS		20000
+
+/* length and pitch of the synthetic sound files */
+#define BENCH_SYNTHETIC_SECONDS		2
+#define BENCH_SYNTHETIC_FREQ		440.0
+
+/*
+ * Highest frequencies asked for by the max_freq cases of get_note_from_file():
+ * B8 (the top of the note table, so the least that can be decimated) and C6
+ * (the top of most vocal ranges).
+ */
+#define BENCH_MAX_FREQ_B8		7902.13
+#define BENCH_MAX_FREQ_C6		1046.50
+
+/* name of the synthetic sound file (removed when we're done) */
+#define BENCH_SYNTHETIC_FILENAME	"bench-synthetic.wav"
+
+#define NANOSECONDS_PER_SECOND		1000000000.0
+
+/* output formats */
+enum bench_format_t
+{
+	CSV_FORMAT,
+	JSON_FORMAT
+};
+
+/*
+ * A single benchmark case.
+ *
+ * function    : name of the library function being measured
+ * source      : where the input comes from ("synthetic" or a filename)
+ * filename    : sound file read by the function (NULL if it doesn't read one)
+ * sample_rate : sample rate of the input (0 if it doesn't apply)
+ * window      : number of samples (or notes) per call (0 if it doesn't apply)
+ * samples     : mono input samples (window of them)
+ * chord       : input notes for get_chord()
+ * run         : makes one call to the function
+ */
+struct bench_case
+{
+	const char *		function;
+	const char *		source;
+	const char *		filename;
+	int			sample_rate;
+	long			window;
+	double *		samples;
+	struct note_node *	chord;
+	void			(*run)(const struct bench_case *bench);
+};
+
+/*
+ * The results of a benchmark case.
+ *
+ * iterations  : number of calls measured
+ * ops_per_sec : calls per second
+ * p50_ns      : median latency of a call in nanoseconds
+ * p99_ns      : 99th percentile latency of a call in nanoseconds
+ */
+struct bench_result
+{
+	long	iterations;
+	double	ops_per_sec;
+	double	p50_ns;
+	double	p99_ns;
+};
+
+static double	get_time_ns(void);
+static int	compare_doubles(const void *a, const void *b);
+static bool	write_synthetic_wav(const char * const filename, int sample_rate, long num_frames, double freq);
+static void	write_le(FILE *file, unsigned long value, int num_bytes);
+static void	run_get_samples_from_file(const struct bench_case *bench);
+static void	run_apply_hann_function(const struct bench_case *bench);
+static void	run_get_fft(const struct bench_case *bench);
+static void	run_get_note_from_file(const struct bench_case *bench);
+static void	run_get_note_from_file_below(const struct bench_case *bench, double max_freq);
+static void	run_get_note_from_file_below_b8(const struct bench_case *bench);
+static void	run_get_note_from_file_below_c6(const struct bench_case *bench);
+static void	run_get_chord(const struct bench_case *bench);
+static void	measure(const struct bench_case *bench, struct bench_result *result);
+static void	report(const struct bench_case *bench, const struct bench_result *result, enum bench_format_t format, bool first);
+static void	bench_file(const char * const filename, const char * const source, enum bench_format_t format, bool *first);
+
+static const int	sample_rates[] = {22050, 44100, 48000, 96000};
+static const long	windows[] = {1024, 4096, 16384, 65536};
+
+/*
+ * Returns a monotonic timestamp in nanoseconds.
+ */
+static double get_time_ns(void)
+{
+	struct timespec	now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return now.tv_sec * NANOSECONDS_PER_SECOND + now.tv_nsec;
+}
+
+/*
+ * A basic comparator for using qsort on an array of double.
+ */
+static int compare_doubles(const void *a, const void *b)
+{
+	assert(NULL != a);
+	assert(NULL != b);
+
+	if (* (double *) a < * (double *) b) {
+		return -1;
+	}
+
+	if (* (double *) a > * (double *) b) {
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Writes the lowest num_bytes of value to the file, least significant first.
+ */
+static void write_le(FILE *file, unsigned long value, int num_bytes)
+{
+	int	i;
+
+	for (i = 0; i < num_bytes; ++i) {
+		fputc((value >> (8 * i)) & 0xff, file);
+	}
+}
+
+/*
+ * Writes a mono, 16-bit PCM WAV file holding a sine wave at freq hertz.
+ *
+ * Returns false if the file could not be written.
+ */
+static bool write_synthetic_wav(const char * const filename, int sample_rate, long num_frames, double freq)
+{
+	FILE	*file;
+	long	i;
+	long	sample;
+
+	if (NULL == (file = fopen(filename, "wb"))) {
+		fprintf(stderr, "could not create %s\n", filename);
+		return false;
+	}
+
+	fputs("RIFF", file);
+	write_le(file, 36 + num_frames * 2, 4);
+	fputs("WAVEfmt ", file);
+	write_le(file, 16, 4);			/* size of the fmt chunk */
+	write_le(file, 1, 2);			/* PCM */
+	write_le(file, 1, 2);			/* mono */
+	write_le(file, sample_rate, 4);
+	write_le(file, sample_rate * 2, 4);	/* bytes per second */
+	write_le(file, 2, 2);			/* bytes per frame */
+	write_le(file, 16, 2);			/* bits per sample */
+	fputs("data", file);
+	write_le(file, num_frames * 2, 4);
+
+	for (i = 0; i < num_frames; ++i) {
+		sample = lround(0.5 * 32767 * sin(2 * M_PI * freq * i / sample_rate));
+		write_le(file, (unsigned long) sample, 2);
+	}
+
+	if (0 != fclose(file)) {
+		fprintf(stderr, "could not write %s\n", filename);
+		return false;
+	}
+
+	return true;
+}
+
+static void run_get_samples_from_file(const struct bench_case *bench)
+{
+	double	*samples;
+	long	samples_returned;
+
+	samples = get_samples_from_file(bench->filename, bench->window, &samples_returned);
+	assert(NULL != samples);
+	FREE_SAFELY(samples);
+}
+
+static void run_apply_hann_function(const struct bench_case *bench)
+{
+	double	*samples;
+
+	samples = apply_hann_function(bench->samples, bench->window);
+	assert(NULL != samples);
+	FREE_SAFELY(samples);
+}
+
+static void run_get_fft(const struct bench_case *bench)
+{
+	fftw_complex	*spectrum;
+
+	spectrum = get_fft(bench->samples, bench->window);
+	assert(NULL != spectrum);
+	FREE_SAFELY(spectrum);
+}
+
+static void run_get_note_from_file(const struct bench_case *bench)
+{
+	struct note	note;
+
+	note = get_note_from_file(bench->filename, bench->window / (double) bench->sample_rate);
+	assert(UNKNOWN_SEMITONE != note.semitone);
+}
+
+static void run_get_note_from_file_below(const struct bench_case *bench, double max_freq)
+{
+	struct detection_options	options;
+	struct note			note;
+
+	init_detection_options(&options);
+	options.max_freq = max_freq;
+	note = get_note_from_file_with_options(bench->filename, bench->window / (double) bench->sample_rate, &options);
+	assert(UNKNOWN_SEMITONE != note.semitone);
+}
+
+static void run_get_note_from_file_below_b8(const struct bench_case *bench)
+{
+	run_get_note_from_file_below(bench, BENCH_MAX_FREQ_B8);
+}
+
+static void run_get_note_from_file_below_c6(const struct bench_case *bench)
+{
+	run_get_note_from_file_below(bench, BENCH_MAX_FREQ_C6);
+}
+
+static void run_get_chord(const struct bench_case *bench)
+{
+	struct chord	chord;
+
+	chord = get_chord(bench->chord);
+	assert(UNKNOWN_CHORD_TYPE != chord.chord);
+}
+
+/*
+ * Runs the benchmark case until it has been measured for long enough, and
+ * summarizes the latencies of the calls.
+ */
+static void measure(const struct bench_case *bench, struct bench_result *result)
+{
+	double	*latencies;
+	double	start;
+	double	elapsed;
+	double	total;
+	long	n;
+
+	assert(NULL != bench);
+	assert(NULL != result);
+
+	/* the first call pays for planning and cache misses, so it isn't counted */
+	bench->run(bench);
+
+	latencies = (double *) malloc(BENCH_MAX_ITERATIONS * sizeof(double));
+	assert(NULL != latencies);
+
+	total = 0.0;
+	for (n = 0; n < BENCH_MAX_ITERATIONS; ++n) {
+		if (BENCH_MIN_ITERATIONS <= n && BENCH_MIN_SECONDS * NANOSECONDS_PER_SECOND <= total) {
+			break;
+		}
+
+		start = get_time_ns();
+		bench->run(bench);
+		elapsed = get_time_ns() - start;
+
+		latencies[n] = elapsed;
+		total += elapsed;
+	}
+
+	qsort(latencies, n, sizeof(double), compare_doubles);
+	result->iterations	= n;
+	result->ops_per_sec	= n * NANOSECONDS_PER_SECOND / total;
+	result->p50_ns		= latencies[(n - 1) * 50 / 100];
+	result->p99_ns		= latencies[(n - 1) * 99 / 100];
+	FREE_SAFELY(latencies);
+}
+
+/*
+ * Prints one result as a CSV row or a JSON object.  samples_per_sec is the
+ * throughput in input samples (0 for cases without a window).
+ */
+static void report(const struct bench_case *bench, const struct bench_result *result, enum bench_format_t format, bool first)
+{
+	switch(format) {
+
+	case(JSON_FORMAT):
+		printf("%s\n  {\"function\": \"%s\", \"source\": \"%s\", \"sample_rate\": %d, \"window\": %ld, "
+			"\"iterations\": %ld, \"ops_per_sec\": %.1f, \"samples_per_sec\": %.1f, "
+			"\"p50_ns\": %.0f, \"p99_ns\": %.0f}",
+			first ? "" : ",", bench->function, bench->source, bench->sample_rate, bench->window,
+			result->iterations, result->ops_per_sec, result->ops_per_sec * bench->window,
+			result->p50_ns, result->p99_ns);
+		break;
+
+	default:
+		printf("%s,%s,%d,%ld,%ld,%.1f,%.1f,%.0f,%.0f\n",
+			bench->function, bench->source, bench->sample_rate, bench->window,
+			result->iterations, result->ops_per_sec, result->ops_per_sec * bench->window,
+			result->p50_ns, result->p99_ns);
+		break;
+	}
+	fflush(stdout);
+}
+
+/*
+ * Runs the sound file benchmarks for every window that fits in the file.
+ */
+static void bench_file(const char * const filename, const char * const source, enum bench_format_t format, bool *first)
+{
+	struct tonedef_source	*sound;
+	struct bench_case	bench;
+	struct bench_result	result;
+	long			samples_returned;
+	long			num_frames;
+	double			*frames;
+	size_t			i;
+	int			j;
+	void			(*runs[])(const struct bench_case *) = {
+		run_get_samples_from_file, run_apply_hann_function, run_get_fft, run_get_note_from_file,
+		run_get_note_from_file_below_b8, run_get_note_from_file_below_c6
+	};
+	const char		*functions[] = {
+		"get_samples_from_file", "apply_hann_function", "get_fft", "get_note_from_file",
+		"get_note_from_file (max_freq B8)", "get_note_from_file (max_freq C6)"
+	};
+
+	if (NULL == (sound = open_source(filename))) {
+		fprintf(stderr, "skipping %s\n", filename);
+		return;
+	}
+	bench.sample_rate = get_source_sample_rate(sound);
+	num_frames = get_source_num_frames(sound);
+	close_source(sound);
+
+	bench.filename	= filename;
+	bench.source	= source;
+	bench.chord	= NULL;
+
+	for (i = 0; i < sizeof(windows) / sizeof(windows[0]); ++i) {
+		if (windows[i] > num_frames) {
+			continue;
+		}
+		bench.window = windows[i];
+
+		/* the in-memory functions get the (mono) start of the file */
+		frames = get_samples_from_file(filename, bench.window, &samples_returned);
+		assert(NULL != frames && samples_returned == bench.window);
+		bench.samples = (double *) fftw_malloc(bench.window * sizeof(double));
+		assert(NULL != bench.samples);
+		sound = open_source(filename);
+		mix_down_and_window(frames, bench.window, get_source_num_channels(sound), NULL, bench.samples);
+		close_source(sound);
+		FREE_SAFELY(frames);
+
+		for (j = 0; j < (int) (sizeof(runs) / sizeof(runs[0])); ++j) {
+			bench.function = functions[j];
+			bench.run = runs[j];
+			measure(&bench, &result);
+			report(&bench, &result, format, *first);
+			*first = false;
+		}
+
+		fftw_free(bench.samples);
+	}
+}
+
+int main(int argc, const char *argv[])
+{
+	enum bench_format_t	format;
+	struct bench_case	bench;
+	struct bench_result	result;
+	struct note_node	nodes[7];
+	bool			first;
+	size_t			i;
+	int			j;
+	const char		*wav_filenames[] = {"a4.wav", "f4-piano.wav", "g#5-piano.wav"};
+	const enum semitone_t	chord_semitones[] = {C, E, G, Bb, D, F, A};
+	const int		chord_sizes[] = {3, 4, 7};
+
+	format = CSV_FORMAT;
+	for (j = 1; j < argc; ++j) {
+		if (0 == strcmp(argv[j], "--json")) {
+			format = JSON_FORMAT;
+		} else if (0 == strcmp(argv[j], "--csv")) {
+			format = CSV_FORMAT;
+		} else {
+			fprintf(stderr, "usage: %s [--csv | --json]\n", argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (CSV_FORMAT == format) {
+		printf("function,source,sample_rate,window,iterations,ops_per_sec,samples_per_sec,p50_ns,p99_ns\n");
+	} else {
+		printf("[");
+	}
+	first = true;
+
+	/* synthetic sine waves at every sample rate */
+	for (i = 0; i < sizeof(sample_rates) / sizeof(sample_rates[0]); ++i) {
+		if (!write_synthetic_wav(BENCH_SYNTHETIC_FILENAME, sample_rates[i],
+				BENCH_SYNTHETIC_SECONDS * sample_rates[i], BENCH_SYNTHETIC_FREQ)) {
+			return EXIT_FAILURE;
+		}
+		bench_file(BENCH_SYNTHETIC_FILENAME, "synthetic", format, &first);
+		remove(BENCH_SYNTHETIC_FILENAME);
+	}
+
+	/* real recordings */
+	for (i = 0; i < sizeof(wav_filenames) / sizeof(wav_filenames[0]); ++i) {
+		bench_file(wav_filenames[i], wav_filenames[i], format, &first);
+	}
+
+	/* chords of increasing size (C major triad, C7, and C13) */
+	bench.function		= "get_chord";
+	bench.filename		= NULL;
+	bench.sample_rate	= 0;
+	bench.samples		= NULL;
+	bench.chord		= nodes;
+	bench.run		= run_get_chord;
+	for (i = 0; i < sizeof(chord_sizes) / sizeof(chord_sizes[0]); ++i) {
+		for (j = 0; j < chord_sizes[i]; ++j) {
+			nodes[j].note.semitone	= chord_semitones[j];
+			nodes[j].note.octave	= 4;
+			nodes[j].note.cents	= 0.0;
+			nodes[j].next		= (j + 1 < chord_sizes[i]) ? &nodes[j + 1] : NULL;
+		}
+		bench.source = "synthetic";
+		bench.window = chord_sizes[i];
+		measure(&bench, &result);
+		report(&bench, &result, format, first);
+		first = false;
+	}
+
+	if (JSON_FORMAT == format) {
+		printf("\n]\n");
+	}
+
+	tonedef_cleanup();
+
+	return EXIT_SUCCESS;
+}
@@ -6,418 +6,309 @@
 
 #include <assert.h>
 #include "chord.h"
+#include "chroma.h"
 #include "common.h"
+#include "dsp.h"
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include "utils.h"
 
-static void			get_semitones_in_chord(struct note_node *node, enum semitone_t *semitones);
-static int			compare_semitones(const void *a, const void *b);
-static void			get_chord_tonic_and_type(enum semitone_t *semitones, enum chord_t *chord, enum semitone_t *tonic);
-static void			rotate_semitones(enum semitone_t *semitones);
-static enum chord_t		get_chord_type(enum semitone_t *semitones);
-static bool			semitone_arrays_equal(enum semitone_t *ary1, enum semitone_t *ary2);
-static enum semitone_t		get_tonic(enum semitone_t *semitones, enum chord_t chord_type);
-static enum semitone_t *	get_semitones_for_chord_with_given_tonic(enum semitone_t tonic, enum chord_t chord_type);
-static enum semitone_t		get_bass_note_in_chord(struct note_node *node);
-static void			build_chord(enum semitone_t **chord, enum semitone_t tonic, int count, ...);
+/* number of distinct sets of semitones (one bit per semitone) */
+#define CHORD_TABLE_SIZE	(1 << SEMITONES_PER_OCTAVE)
 
 /*
- * A basic comparator for using qsort on an array of enum semitone_t.
+ * An entry in the chord lookup table.
+ *
+ * chord : the chord type of the set of semitones (or UNKNOWN_CHORD_TYPE)
+ * tonic : the tonic of the chord (or UNKNOWN_SEMITONE)
  */
-static int compare_semitones(const void *a, const void *b)
-{
-	assert(NULL != a);
-	assert(NULL != b);
-
-	if (* (enum semitone_t *) a < * (enum semitone_t *) b) {
-		return -1;
-	}
-
-	if (* (enum semitone_t *) a > * (enum semitone_t *) b) {
-		return 1;
-	}
-
-	return 0;
-}
-
-static enum semitone_t get_bass_note_in_chord(struct note_node *node)
+struct chord_table_entry
 {
-	double lowest_freq;
-	enum semitone_t lowest_semitone;
-
-	assert(NULL != node);
-
-	lowest_freq = get_freq(&(node->note));
-	lowest_semitone = node->note.semitone;
-	node = node->next;
-
-	while (NULL != node) {
-
-		if (get_freq(&(node->note)) < lowest_freq) {
-			lowest_freq = get_freq(&(node->note));
-			lowest_semitone = node->note.semitone;
-		}
-
-		node = node->next;
-	}
-
-	return lowest_semitone;
-}
+	enum chord_t	chord;
+	enum semitone_t	tonic;
+};
+
+static unsigned			get_semitone_mask(enum semitone_t tonic, int count, ...);
+static unsigned			rotate_semitone_mask(unsigned mask, int semitones);
+static unsigned			get_chord_mask(enum chord_t chord_type);
+static void			build_chord_table(void);
+static void			build_chord_inversions(enum chord_t chord_type);
+static bool			get_semitones_in_chord(const struct note_node *node, unsigned *mask, enum semitone_t *bass);
+static int			count_semitones(unsigned mask);
+static bool			is_better_candidate(const struct chord_candidate * const a, const struct chord_candidate * const b);
+static int			find_chord_candidates(unsigned mask, enum semitone_t bass, struct chord_candidate *candidates, int max_candidates);
 
 /*
- * This function is used to retrieve the an array of semitones present in the
- * link list of note_node represented by the "node" agrument.  The "node"
- * argument should represent the head of this list.  The return array is stored
- * in the semitones argument, which must already be allocated to hold a maximum
- * of SEMITONES_PER_OCTAVE + 1 (effectively 13) of enum semitone_t.  The return
- * array will be sorted and will be terminated by an UNKNOWN_SEMITONE upon
- * successful completion of this function.
+ * Every set of semitones maps to at most one chord, so we work them all out
+ * once and look them up afterwards.  That takes a few milliseconds and makes
+ * get_chord() free of allocation, sorting, and (mostly) loops.
  */
-static void get_semitones_in_chord(struct note_node *node, enum semitone_t *semitones)
-{
-	bool	already_added;
-	int	semitones_index;
-	int	i;
-
-	assert(NULL != node);
-	assert(NULL != semitones);
-
-	semitones_index = 0;
-	while (NULL != node) {
-
-		/*
-		 * Make sure we haven't already added this semitone to our
-		 * return array.  This implementation doesn't care how many
-		 * Bb's are in your chord.
-		 */
-		already_added = false;
-		for (i = 0; i < semitones_index; ++i) {
-			if (node->note.semitone == semitones[i]) {
-				already_added = true;
-				break;
-			}
-		}
-
-		if (!already_added) {
-			semitones[semitones_index++] = node->note.semitone;
-		}
-
-		node = node->next;  /* will be NULL after the last node */
-	}
+static struct chord_table_entry	chord_table[CHORD_TABLE_SIZE];
+static pthread_once_t		chord_table_once = PTHREAD_ONCE_INIT;
 
-	assert(semitones_index < SEMITONES_PER_OCTAVE + 1);
-
-	/* sort the semitones based upon the semitone enumeration */
-	qsort(semitones, semitones_index, sizeof(enum semitone_t), compare_semitones);
-
-	/* terminate the array with an UNKNOWN_SEMITONE, like we said we would */
-	semitones[semitones_index] = UNKNOWN_SEMITONE;
-}
 /*
- * This function rotates all the semitones in the given semitone array
- * (terminated by an UNKNOWN_SEMITONE) forward by one.  For example, given the
- * following array:
- *
- *         {Db, E, Gb, A, UNKNOWN_SEMITONE}
- *
- * This function will alter the array to look like:
- *
- *         {D, F, A, Bb, UNKNOWN_SEMITONE}
- *
- * Note that while the input array does not necessarily need to be sorted, it
- * will be sorted based upon the semitone_t enumeration upon return, and it will
- * still be terminated by an UNKNOWN_SEMITONE.
+ * The semitones of every chord type with a tonic of C (0 for chord types that
+ * aren't defined yet), and the inversion for each semitone in the bass (see
+ * struct chord_candidate).  Both are filled in with the chord table.
  */
-static void rotate_semitones(enum semitone_t *semitones)
-{
-	int i;
-
-	/* validate that the input array looks sane */
-	assert(NULL != semitones);
-
-	/* do the rotates */
-	for (i = 0; semitones[i] != UNKNOWN_SEMITONE; ++i) {
-		semitones[i] = (semitones[i] + 1) % SEMITONES_PER_OCTAVE;
-	}
-
-	/* put it back in order */
-	qsort(semitones, i, sizeof(enum semitone_t), compare_semitones);
-}
-
-static bool semitone_arrays_equal(enum semitone_t *ary1, enum semitone_t *ary2)
-{
-	int i;
-
-	assert(NULL != ary1);
-	assert(NULL != ary2);
-
-	for (i = 0; ary1[i] != UNKNOWN_SEMITONE; ++i) {
-		if (ary1[i] != ary2[i]) {
-			return false;
-		}
-	}
-
-	if (UNKNOWN_SEMITONE == ary1[i] && UNKNOWN_SEMITONE == ary2[i]) {
-		return true;
-	}
-
-	return false;
-}
-
-static enum chord_t get_chord_type(enum semitone_t *semitones)
-{
-	enum chord_t i;
-	enum semitone_t *c_chord;
-
-	assert(NULL != semitones);
-
-	for (i = (enum chord_t) 0; i != UNKNOWN_CHORD_TYPE; i = (enum chord_t) ((int) i + 1)) {
+static unsigned			chord_masks[UNKNOWN_CHORD_TYPE];
+static int			chord_inversions[UNKNOWN_CHORD_TYPE][SEMITONES_PER_OCTAVE];
 
-		c_chord = get_semitones_for_chord_with_given_tonic(C, i);
-
-		/* temp handling while all the chord enums aren't defined in get_c_chord(...) */
-		//assert(NULL != c_chord);
-		if (NULL == c_chord) {
-			FREE_SAFELY(c_chord);
-			continue;
-		}
-
-		if (semitone_arrays_equal(c_chord, semitones)) {
-			FREE_SAFELY(c_chord);
-			return i;
-		}
-
-		FREE_SAFELY(c_chord);
-	}
-
-	return UNKNOWN_CHORD_TYPE;
-}
-
-static void build_chord(enum semitone_t **chord, enum semitone_t tonic, int count, ...)
+/*
+ * Static function for building the set of semitones (as a mask with one bit per
+ * semitone) from count semitones relative to C, transposed to the given tonic.
+ */
+static unsigned get_semitone_mask(enum semitone_t tonic, int count, ...)
 {
-	va_list semitones;
-	int i;
+	va_list		semitones;
+	unsigned	mask;
+	int		i;
 
-	assert(NULL != chord);
 	assert(0 <= count);
 	assert(C <= tonic && B >= tonic);
 
+	mask = 0;
 	va_start(semitones, count); /* Requires the last fixed parameter (to get the address) */
 	for (i = 0; i < count; ++i) {
-		*(*chord)++ = (va_arg(semitones, enum semitone_t) + (int) tonic) % SEMITONES_PER_OCTAVE;
+		mask |= SEMITONE_BIT((va_arg(semitones, int) + (int) tonic) % SEMITONES_PER_OCTAVE);
 	}
 	va_end(semitones);
+
+	return mask;
 }
 
-static enum semitone_t *get_semitones_for_chord_with_given_tonic(enum semitone_t tonic, enum chord_t chord_type)
+/*
+ * Static function that transposes a set of semitones up by the given number of
+ * semitones (0 to SEMITONES_PER_OCTAVE), wrapping B around to C.
+ */
+static unsigned rotate_semitone_mask(unsigned mask, int semitones)
 {
-	enum semitone_t *ret;
-	enum semitone_t *i;
+	assert(0 <= semitones && SEMITONES_PER_OCTAVE >= semitones);
 
-	/* TODO: make asserts more robust */
-	assert(C <= tonic && B >= tonic);
-	assert(UNKNOWN_CHORD_TYPE != chord_type);
+	mask = (mask << semitones) | (mask >> (SEMITONES_PER_OCTAVE - semitones));
 
-	ret = (enum semitone_t *) MALLOC_SAFELY((SEMITONES_PER_OCTAVE + 1) * sizeof(enum semitone_t));
-	i = ret;
+	return mask & (CHORD_TABLE_SIZE - 1);
+}
 
+/*
+ * Static function that retrieves the set of semitones in the given chord type
+ * with a tonic of C.  Returns 0 for chord types that aren't defined yet.
+ */
+static unsigned get_chord_mask(enum chord_t chord_type)
+{
 	switch(chord_type) {
 
 	case(MAJOR_TRIAD):
-		build_chord(&i, tonic, 3, C, E, G);
-		break;
+		return get_semitone_mask(C, 3, C, E, G);
 
 	case(MINOR_TRIAD):
-		build_chord(&i, tonic, 3, C, Eb, G);
-		break;
+		return get_semitone_mask(C, 3, C, Eb, G);
 
 	/* TODO: the notes in the Caug chord are the same as Eaug and G#aug */
 	case(AUGMENTED_TRIAD):
-		build_chord(&i, tonic, 3, C, E, Ab);
-		break;
+		return get_semitone_mask(C, 3, C, E, Ab);
 
 	case(DIMINISHED_TRIAD):
-		build_chord(&i, tonic, 3, C, Eb, Gb);
-		break;
+		return get_semitone_mask(C, 3, C, Eb, Gb);
 
 	case(DIMINISHED_SEVENTH):
-		build_chord(&i, tonic, 4, C, Eb, Gb, A);
-		break;
+		return get_semitone_mask(C, 4, C, Eb, Gb, A);
 
 	case(HALF_DIMINISHED_SEVENTH):
-		build_chord(&i, tonic, 4, C, Eb, Gb, Bb);
-		break;
+		return get_semitone_mask(C, 4, C, Eb, Gb, Bb);
 
 	/* TODO: may be a major-add-6th */
 	case(MINOR_SEVENTH):
-		build_chord(&i, tonic, 4, C, Eb, G, Bb);
-		break;
+		return get_semitone_mask(C, 4, C, Eb, G, Bb);
 
 	case(MINOR_MAJOR_SEVENTH):
-		build_chord(&i, tonic, 4, C, Eb, G, B);
-		break;
+		return get_semitone_mask(C, 4, C, Eb, G, B);
 
 	case(DOMINANT_SEVENTH):
-		build_chord(&i, tonic, 4, C, E, G, Bb);
-		break;
+		return get_semitone_mask(C, 4, C, E, G, Bb);
 
 	case(MAJOR_SEVENTH):
-		build_chord(&i, tonic, 4, C, E, G, B);
-		break;
+		return get_semitone_mask(C, 4, C, E, G, B);
 
 	case(AUGMENTED_SEVENTH):
-		build_chord(&i, tonic, 4, C, E, Ab, Bb);
-		break;
+		return get_semitone_mask(C, 4, C, E, Ab, Bb);
 
 	case(AUGMENTED_MAJOR_SEVENTH):
-		build_chord(&i, tonic, 4, C, E, Ab, B);
-		break;
+		return get_semitone_mask(C, 4, C, E, Ab, B);
 
 	case(DOMINANT_NINTH):
-		build_chord(&i, tonic, 5, C, E, G, Bb, D);
-		break;
+		return get_semitone_mask(C, 5, C, E, G, Bb, D);
 
 	/* TODO: the third is usually omitted for this one */
 	case(DOMINANT_ELEVENTH):
-		build_chord(&i, tonic, 6, C, E, G, Bb, D, F);
-		break;
+		return get_semitone_mask(C, 6, C, E, G, Bb, D, F);
 
 	case(DOMINANT_THIRTEENTH):
-		build_chord(&i, tonic, 7, C, E, G, Bb, D, F, A);
-		break;
+		return get_semitone_mask(C, 7, C, E, G, Bb, D, F, A);
 
 	/* TODO: this is the same as AUGMENTED_SEVENTH */
 	case(SEVENTH_AUGMENTED_FIFTH):
-		build_chord(&i, tonic, 4, C, E, Ab, Bb);
-		break;
+		return get_semitone_mask(C, 4, C, E, Ab, Bb);
 
 	case(SEVENTH_FLAT_NINTH):
-		FREE_SAFELY(ret);
-		return NULL;
-
 	case(SEVENTH_SHARP_NINTH):
-		FREE_SAFELY(ret);
-		return NULL;
-
 	case(SEVENTH_AUGMENTED_ELEVENTH):
-		FREE_SAFELY(ret);
-		return NULL;
-
 	case(SEVENTH_FLAT_THIRTEENTH):
-		FREE_SAFELY(ret);
-		return NULL;
-
 	case(ADD_NINE):
-		FREE_SAFELY(ret);
-		return NULL;
-
 	case(ADD_FOURTH):
-		FREE_SAFELY(ret);
-		return NULL;
-
 	case(ADD_SIXTH):
-		FREE_SAFELY(ret);
-		return NULL;
-
 	case(SIX_NINE):
-		FREE_SAFELY(ret);
-		return NULL;
-
 	case(MIXED_THIRD):
-		FREE_SAFELY(ret);
-		return NULL;
-
 	case(SUS2):
-		FREE_SAFELY(ret);
-		return NULL;
-
 	case(SUS4):
-		FREE_SAFELY(ret);
-		return NULL;
-
 	case(JAZZ_SUS):
-		FREE_SAFELY(ret);
-		return NULL;
+		return 0;
 
 	default:
 		fprintf(stderr, "no rule for chord_type '%d'\n", chord_type);
-		FREE_SAFELY(ret);
-		return NULL;
+		return 0;
 	}
-
-	qsort(ret, i - ret, sizeof(enum semitone_t), compare_semitones);
-	*i = UNKNOWN_SEMITONE;
-
-	return ret;
 }
 
-static enum semitone_t get_tonic(enum semitone_t *semitones, enum chord_t chord_type)
+/*
+ * Static function that fills in the chord lookup table.  It is run once (see
+ * pthread_once()) before the first lookup.
+ *
+ * For every set of semitones, the chord type is found by transposing the set up
+ * one semitone at a time until it matches a C chord (the first matching chord
+ * type wins), and the tonic is the lowest semitone (by enumeration) that gives
+ * the same set of semitones for that chord type.
+ */
+static void build_chord_table(void)
 {
-	enum semitone_t tonic;
-	enum semitone_t *potential_chord_semitones;
+	unsigned	mask;
+	enum chord_t	chord_type;
+	int		rotation;
+	int		tonic;
+
+	for (chord_type = (enum chord_t) 0; chord_type != UNKNOWN_CHORD_TYPE; chord_type = (enum chord_t) ((int) chord_type + 1)) {
+		chord_masks[chord_type] = get_chord_mask(chord_type);
+		build_chord_inversions(chord_type);
+	}
 
-	assert(NULL != semitones);
-	assert((enum chord_t) 0 <= chord_type && UNKNOWN_CHORD_TYPE > chord_type);
+	for (mask = 0; mask < CHORD_TABLE_SIZE; ++mask) {
 
-	for (tonic = (enum semitone_t) 0; tonic <= B; tonic = (enum semitone_t) ((int) tonic + 1)) {
+		chord_table[mask].chord = UNKNOWN_CHORD_TYPE;
+		chord_table[mask].tonic = UNKNOWN_SEMITONE;
 
-		potential_chord_semitones = get_semitones_for_chord_with_given_tonic(tonic, chord_type);
-		assert(NULL != potential_chord_semitones);
+		for (rotation = 0; rotation < SEMITONES_PER_OCTAVE && UNKNOWN_CHORD_TYPE == chord_table[mask].chord; ++rotation) {
+			for (chord_type = (enum chord_t) 0; chord_type != UNKNOWN_CHORD_TYPE; chord_type = (enum chord_t) ((int) chord_type + 1)) {
+				if (0 != chord_masks[chord_type] && rotate_semitone_mask(mask, rotation) == chord_masks[chord_type]) {
+					chord_table[mask].chord = chord_type;
+					break;
+				}
+			}
+		}
 
-		if (semitone_arrays_equal(potential_chord_semitones, semitones)) {
-			FREE_SAFELY(potential_chord_semitones);
-			return tonic;
+		if (UNKNOWN_CHORD_TYPE == chord_table[mask].chord) {
+			continue;
 		}
 
-		FREE_SAFELY(potential_chord_semitones);
+		for (tonic = C; tonic <= B; ++tonic) {
+			if (rotate_semitone_mask(chord_masks[chord_table[mask].chord], tonic) == mask) {
+				chord_table[mask].tonic = (enum semitone_t) tonic;
+				break;
+			}
+		}
+		assert(UNKNOWN_SEMITONE != chord_table[mask].tonic);
 	}
-
-	return UNKNOWN_SEMITONE;
 }
 
-/* TODO: this should return a list of possibilities */
-static void get_chord_tonic_and_type(enum semitone_t *semitones, enum chord_t *chord, enum semitone_t *tonic)
+/*
+ * Static function that works out the inversion for each semitone of a chord
+ * type in the bass, by stacking thirds up from the tonic (C): each chord tone
+ * is the next minor or major third above the last one, or (for chords like
+ * the augmented seventh, whose seventh is a whole step above the augmented
+ * fifth) the nearest chord tone above it.  The chord mask must already be in
+ * chord_masks.
+ */
+static void build_chord_inversions(enum chord_t chord_type)
 {
-	int i;
-	enum semitone_t *semitones_cpy;
+	unsigned	remaining;
+	int		current;
+	int		next;
+	int		inversion;
+	int		i;
+
+	for (i = 0; i < SEMITONES_PER_OCTAVE; ++i) {
+		chord_inversions[chord_type][i] = CHORD_NO_INVERSION;
+	}
 
-	/* TODO: much more robust assertions */
-	assert(NULL != semitones);
-	assert(NULL != chord);
-	assert(NULL != tonic);
+	if (0 == chord_masks[chord_type]) {
+		return;
+	}
+	assert(0 != (chord_masks[chord_type] & SEMITONE_BIT(C)));
+
+	chord_inversions[chord_type][C] = 0;
+	remaining = chord_masks[chord_type] & ~SEMITONE_BIT(C);
+	current = C;
+	for (inversion = 1; 0 != remaining; ++inversion) {
+		if (remaining & SEMITONE_BIT((current + 3) % SEMITONES_PER_OCTAVE)) {
+			next = (current + 3) % SEMITONES_PER_OCTAVE;
+		} else if (remaining & SEMITONE_BIT((current + 4) % SEMITONES_PER_OCTAVE)) {
+			next = (current + 4) % SEMITONES_PER_OCTAVE;
+		} else {
+			for (i = 1; !(remaining & SEMITONE_BIT((current + i) % SEMITONES_PER_OCTAVE)); ++i)
+				;
+			next = (current + i) % SEMITONES_PER_OCTAVE;
+		}
 
-	*chord = UNKNOWN_CHORD_TYPE;
-	*tonic = UNKNOWN_SEMITONE;
+		chord_inversions[chord_type][next] = inversion;
+		remaining &= ~SEMITONE_BIT(next);
+		current = next;
+	}
+}
 
-	i = -1;
-	while (semitones[++i] != UNKNOWN_SEMITONE);  /* count the elements */
-	qsort(semitones, i, sizeof(enum semitone_t), compare_semitones);
+/*
+ * Static function that collects the semitones of the notes in the list
+ * (starting at "node") into a mask with one bit per semitone, and finds the
+ * semitone of the lowest note (the bass).  This implementation doesn't care
+ * how many Bb's are in your chord.
+ *
+ * Returns false if any of the notes is invalid.
+ */
+static bool get_semitones_in_chord(const struct note_node *node, unsigned *mask, enum semitone_t *bass)
+{
+	double	freq;
+	double	lowest_freq;
 
-	semitones_cpy = (enum semitone_t *) MALLOC_SAFELY((SEMITONES_PER_OCTAVE + 1) * sizeof(enum semitone_t));
-	for (i = 0; semitones[i] != UNKNOWN_SEMITONE; ++i) {
-		semitones_cpy[i] = semitones[i];
-	}
-	semitones_cpy[i] = UNKNOWN_SEMITONE;
+	assert(NULL != node);
+	assert(NULL != mask);
+	assert(NULL != bass);
 
-	i = 0;
-	while (i < SEMITONES_PER_OCTAVE && UNKNOWN_CHORD_TYPE == get_chord_type(semitones)) {
-		rotate_semitones(semitones);
-		++i;
-	}
+	*mask = 0;
+	*bass = UNKNOWN_SEMITONE;
+	lowest_freq = 0.0;
 
-	if (UNKNOWN_CHORD_TYPE == get_chord_type(semitones)) {
-		return;
-	}
+	while (NULL != node) {
 
-	assert(i < SEMITONES_PER_OCTAVE);
+		if (C > node->note.semitone || B < node->note.semitone) {
+			return false;
+		}
+
+		freq = get_freq(&(node->note));
+		if (INVALID_FREQUENCY == freq) {
+			return false;
+		}
+
+		if (UNKNOWN_SEMITONE == *bass || freq < lowest_freq) {
+			lowest_freq = freq;
+			*bass = node->note.semitone;
+		}
 
-	*chord = get_chord_type(semitones);
+		*mask |= SEMITONE_BIT(node->note.semitone);
+		node = node->next;  /* will be NULL after the last node */
+	}
 
-	/* TODO: get tonic correctly */
-	*tonic = get_tonic(semitones_cpy, *chord);
-	assert(UNKNOWN_SEMITONE != *tonic);
+	return true;
 }
 
 /*
@@ -426,13 +317,13 @@ static void get_chord_tonic_and_type(enum semitone_t *semitones, enum chord_t *c
  * determined, an invalid struct chord is returned.  This struct will contain
  * the UNKNOWN_* enumerations for each of its members.
  *
- * I try not to alter the node list passed in, but I make no promises unless
- * "const" is specified.
+ * The node list passed in is not altered.
  */
 struct chord get_chord(struct note_node *node)
 {
 	struct chord	ret;
-	enum semitone_t	semitones[SEMITONES_PER_OCTAVE + 1];
+	unsigned	mask;
+	enum semitone_t	bass;
 
 	/* initialize return chord to error values in case something goes wrong */
 	ret.chord = UNKNOWN_CHORD_TYPE;
@@ -446,27 +337,23 @@ struct chord get_chord(struct note_node *node)
 	}
 
 	/*
-	 * First, we put the semitones of the chord into a sorted array.  This
-	 * array will be terminated with an UNKNOWN_SEMITONE, and can have a
-	 * maximum of SEMITONES_PER_OCTAVE + 1 elements (hence the declaration
-	 * at the beginning of this function.
+	 * First, we collect the semitones of the chord into a mask with one
+	 * bit per semitone.  This is all that identifies a chord (the octave of
+	 * each note only matters for the bass).
 	 */
-	get_semitones_in_chord(node, semitones);
-
-	/* TODO: document */
-	ret.bass = get_bass_note_in_chord(node);
+	if (!get_semitones_in_chord(node, &mask, &bass)) {
+		return ret;
+	}
+	ret.bass = bass;
 
 	/*
 	 * Next, we do the real work (AKA finding the chord type and tonic).
-	 * The chord type is discovered first by shifting all the semitones and
-	 * checking for a match with a known C chord.  Once we know the chord
-	 * type, we try all possible tonic notes (this is at most 12).
-	 *
-	 * If we are able to match a chord, then we _should_ be able to match a
-	 * tonic note, since they both use
-	 * get_semitones_for_chord_with_given_tonic(...)!
+	 * Every set of semitones has been worked out ahead of time (see
+	 * build_chord_table()), so this is just a lookup.
 	 */
-	get_chord_tonic_and_type(semitones, &(ret.chord), &(ret.tonic));
+	pthread_once(&chord_table_once, build_chord_table);
+	ret.chord = chord_table[mask].chord;
+	ret.tonic = chord_table[mask].tonic;
 
 	/*
 	 * If once of our members is still UNKNOWN_* somehow, we must make them
@@ -480,3 +367,284 @@ struct chord get_chord(struct note_node *node)
 
 	return ret;
 }
+
+/*
+ * This function detects the chord in the first secs_to_sample seconds of the
+ * sound file.  Up to max_notes of the most prominent notes are picked from a
+ * single FFT (see get_notes_from_file()) and handed to get_chord().  max_notes
+ * may be at most DSP_MAX_PEAKS.
+ *
+ * If the arguments are illegal, the file can't be analyzed, or the chord can't
+ * be determined, an invalid struct chord is returned (see get_chord()).
+ */
+struct chord get_chord_from_file(const char * const filename, double secs_to_sample, long max_notes)
+{
+	struct chord		ret;
+	struct note		notes[DSP_MAX_PEAKS];
+	struct note_node	nodes[DSP_MAX_PEAKS];
+	long			num_notes;
+	long			i;
+
+	ret.chord = UNKNOWN_CHORD_TYPE;
+	ret.tonic = UNKNOWN_SEMITONE;
+	ret.bass  = UNKNOWN_SEMITONE;
+
+	if (0 >= max_notes || DSP_MAX_PEAKS < max_notes) {
+		fprintf(stderr, "max_notes must be within 1 to %d\n", DSP_MAX_PEAKS);
+		return ret;
+	}
+
+	num_notes = get_notes_from_file(filename, secs_to_sample, notes, max_notes);
+	if (0 >= num_notes) {
+		return ret;
+	}
+
+	/* the notes live on the stack, so the list does too */
+	for (i = 0; i < num_notes; ++i) {
+		nodes[i].note = notes[i];
+		nodes[i].next = (i + 1 < num_notes) ? &nodes[i + 1] : NULL;
+	}
+
+	return get_chord(nodes);
+}
+
+/*
+ * This function detects the chord in a chroma vector (one row of the matrix
+ * returned by get_chromagram_from_file()).  Every pitch class at least as
+ * strong as threshold (relative to the strongest one, so 0.0 to 1.0) is taken
+ * to be in the chord.  A chroma vector says nothing about octaves, so the
+ * chord is assumed to be in root position (the bass is the tonic).
+ *
+ * If the arguments are illegal or the chord can't be determined, an invalid
+ * struct chord is returned (see get_chord()).
+ */
+struct chord get_chord_from_chroma(const float * const chroma, double threshold)
+{
+	struct chord	ret;
+	unsigned	mask;
+	float		maximum;
+	int		i;
+
+	ret.chord = UNKNOWN_CHORD_TYPE;
+	ret.tonic = UNKNOWN_SEMITONE;
+	ret.bass  = UNKNOWN_SEMITONE;
+
+	if (NULL == chroma) {
+		fprintf(stderr, "chroma cannot be NULL\n");
+		return ret;
+	}
+
+	if (0.0 >= threshold || 1.0 < threshold) {
+		fprintf(stderr, "threshold must be within 0.0 (exclusive) to 1.0\n");
+		return ret;
+	}
+
+	maximum = 0.0f;
+	for (i = 0; i < CHROMA_NUM_BINS; ++i) {
+		maximum = MAX(maximum, chroma[i]);
+	}
+
+	mask = 0;
+	for (i = 0; 0.0f < maximum && i < CHROMA_NUM_BINS; ++i) {
+		if (chroma[i] >= threshold * maximum) {
+			mask |= SEMITONE_BIT(i);
+		}
+	}
+
+	pthread_once(&chord_table_once, build_chord_table);
+	if (UNKNOWN_CHORD_TYPE != chord_table[mask].chord) {
+		ret.chord = chord_table[mask].chord;
+		ret.tonic = chord_table[mask].tonic;
+		ret.bass  = chord_table[mask].tonic;
+	}
+
+	return ret;
+}
+
+/*
+ * Static function that counts the semitones in a set of semitones.
+ */
+static int count_semitones(unsigned mask)
+{
+	int	count;
+
+	for (count = 0; 0 != mask; ++count) {
+		mask &= mask - 1;  /* clears the lowest bit */
+	}
+
+	return count;
+}
+
+/*
+ * Static function that decides whether chord candidate a should be ranked
+ * above chord candidate b.  Candidates are ranked by score, then root position
+ * before inversions before a bass outside the chord, then by chord type and
+ * tonic (in enumeration order, like get_chord()).
+ */
+static bool is_better_candidate(const struct chord_candidate * const a, const struct chord_candidate * const b)
+{
+	int	a_position;
+	int	b_position;
+
+	assert(NULL != a);
+	assert(NULL != b);
+
+	if (a->score != b->score) {
+		return a->score > b->score;
+	}
+
+	a_position = (CHORD_NO_INVERSION == a->inversion) ? 2 : MIN(1, a->inversion);
+	b_position = (CHORD_NO_INVERSION == b->inversion) ? 2 : MIN(1, b->inversion);
+	if (a_position != b_position) {
+		return a_position < b_position;
+	}
+
+	if (a->chord != b->chord) {
+		return a->chord < b->chord;
+	}
+
+	return a->tonic < b->tonic;
+}
+
+/*
+ * Static function that ranks every reading of the set of semitones as a chord
+ * (every defined chord type on every tonic in the set) and keeps the best
+ * max_candidates of them, best first.  The chord table must already be built.
+ *
+ * Returns the number of candidates stored.
+ */
+static int find_chord_candidates(unsigned mask, enum semitone_t bass, struct chord_candidate *candidates, int max_candidates)
+{
+	struct chord_candidate	candidate;
+	enum chord_t		chord_type;
+	unsigned		chord_mask;
+	int			num_candidates;
+	int			tonic;
+	int			i;
+
+	assert(NULL != candidates);
+	assert(0 < max_candidates);
+
+	num_candidates = 0;
+	for (chord_type = (enum chord_t) 0; chord_type != UNKNOWN_CHORD_TYPE; chord_type = (enum chord_t) ((int) chord_type + 1)) {
+		if (0 == chord_masks[chord_type]) {
+			continue;
+		}
+
+		for (tonic = C; tonic <= B; ++tonic) {
+
+			/* a chord is only heard if its tonic is */
+			if (!(mask & SEMITONE_BIT(tonic))) {
+				continue;
+			}
+
+			chord_mask = rotate_semitone_mask(chord_masks[chord_type], tonic);
+			candidate.score = (double) count_semitones(mask & chord_mask) / count_semitones(mask | chord_mask);
+			if (CHORD_MIN_CANDIDATE_SCORE > candidate.score) {
+				continue;
+			}
+
+			candidate.chord = chord_type;
+			candidate.tonic = (enum semitone_t) tonic;
+			candidate.bass = bass;
+			candidate.inversion = (UNKNOWN_SEMITONE == bass) ? CHORD_NO_INVERSION :
+				chord_inversions[chord_type][(bass - tonic + SEMITONES_PER_OCTAVE) % SEMITONES_PER_OCTAVE];
+
+			/* insert it in order, dropping the worst candidate if we're full */
+			for (i = num_candidates; 0 < i && is_better_candidate(&candidate, &candidates[i - 1]); --i) {
+				if (i < max_candidates) {
+					candidates[i] = candidates[i - 1];
+				}
+			}
+			if (i < max_candidates) {
+				candidates[i] = candidate;
+				num_candidates = MIN(num_candidates + 1, max_candidates);
+			}
+		}
+	}
+
+	return num_candidates;
+}
+
+/*
+ * This function ranks the chords the notes in the list (starting at "node")
+ * could be, unlike get_chord(), which only gives the first match.  Sets that
+ * are ambiguous on their own (e.g. augmented triads and diminished sevenths,
+ * whose semitones are the same on several tonics) are told apart by the bass,
+ * and partial matches (e.g. a seventh chord missing its fifth) are ranked by
+ * how many semitones they share with the notes; see struct chord_candidate.
+ * The best max_candidates are stored in the candidates array, best first.
+ *
+ * Returns the number of candidates stored, or CHORD_CANDIDATES_FAILURE_CODE for
+ * illegal arguments (including invalid notes).
+ */
+int get_chord_candidates(const struct note_node *node, struct chord_candidate *candidates, int max_candidates)
+{
+	unsigned	mask;
+	enum semitone_t	bass;
+
+	if (NULL == node || NULL == candidates || 0 >= max_candidates) {
+		fprintf(stderr, "node and candidates cannot be NULL, and max_candidates must be positive\n");
+		return CHORD_CANDIDATES_FAILURE_CODE;
+	}
+
+	if (!get_semitones_in_chord(node, &mask, &bass)) {
+		return CHORD_CANDIDATES_FAILURE_CODE;
+	}
+
+	pthread_once(&chord_table_once, build_chord_table);
+	return find_chord_candidates(mask, bass, candidates, max_candidates);
+}
+
+/*
+ * This function is get_chord_candidates() for many sets of semitones at once
+ * (e.g. the frames of a transcription), each given as a mask with one bit per
+ * semitone (C in the lowest bit).  The bass of each set comes from the basses
+ * array, and is counted as one of its semitones; basses may be NULL (or hold
+ * UNKNOWN_SEMITONE) if the bass isn't known, in which case no candidate has an
+ * inversion.
+ *
+ * The candidates for set i are stored at candidates[i * max_candidates], so
+ * the candidates array must hold num_sets * max_candidates of them, and the
+ * number stored for set i is stored in num_candidates[i].
+ *
+ * Returns the total number of candidates stored, or
+ * CHORD_CANDIDATES_FAILURE_CODE for illegal arguments (including masks with
+ * bits above B and invalid basses).
+ */
+long get_chord_candidates_from_masks(const unsigned * const masks, const enum semitone_t * const basses, long num_sets, struct chord_candidate *candidates, int max_candidates, int *num_candidates)
+{
+	enum semitone_t	bass;
+	unsigned	mask;
+	long		total;
+	long		i;
+
+	if (NULL == masks || NULL == candidates || NULL == num_candidates || 0 > num_sets || 0 >= max_candidates) {
+		fprintf(stderr, "masks, candidates, and num_candidates cannot be NULL, and max_candidates must be positive\n");
+		return CHORD_CANDIDATES_FAILURE_CODE;
+	}
+
+	for (i = 0; i < num_sets; ++i) {
+		if (0 != (masks[i] & ~(CHORD_TABLE_SIZE - 1u)) ||
+		    (NULL != basses && (UNKNOWN_SEMITONE > basses[i] || B < basses[i]))) {
+			fprintf(stderr, "invalid set of semitones at index %ld\n", i);
+			return CHORD_CANDIDATES_FAILURE_CODE;
+		}
+	}
+
+	pthread_once(&chord_table_once, build_chord_table);
+
+	total = 0;
+	for (i = 0; i < num_sets; ++i) {
+		bass = (NULL == basses) ? UNKNOWN_SEMITONE : basses[i];
+		mask = masks[i];
+		if (UNKNOWN_SEMITONE != bass) {
+			mask |= SEMITONE_BIT(bass);
+		}
+
+		num_candidates[i] = find_chord_candidates(mask, bass, &candidates[i * max_candidates], max_candidates);
+		total += num_candidates[i];
+	}
+
+	return total;
+}
@@ -53,6 +53,36 @@ struct chord
 	enum semitone_t bass;
 };
 
+/* return value of the chord candidate functions for illegal arguments */
+#define CHORD_CANDIDATES_FAILURE_CODE	-1
+
+/* candidates sharing less than this share of semitones with the set are dropped */
+#define CHORD_MIN_CANDIDATE_SCORE	0.5
+
+/* inversion of a chord whose bass isn't one of its semitones (e.g. C/D) */
+#define CHORD_NO_INVERSION		-1
+
+/*
+ * One possible reading of a set of semitones as a chord.
+ *
+ * chord     : the chord type
+ * tonic     : the tonic (root) of the chord
+ * bass      : the semitone of the lowest note (UNKNOWN_SEMITONE if unknown)
+ * inversion : which chord tone, stacking thirds up from the tonic, is in the
+ *             bass (0 for root position, 1 for the third, 2 for the fifth, and
+ *             so on), or CHORD_NO_INVERSION
+ * score     : the semitones in both the set and the chord as a share of the
+ *             semitones in either (1.0 for an exact match)
+ */
+struct chord_candidate
+{
+	enum chord_t	chord;
+	enum semitone_t	tonic;
+	enum semitone_t	bass;
+	int		inversion;
+	double		score;
+};
+
 /*
  * A lightweight wrapper for building a singly-linked list of notes.
  *
@@ -66,5 +96,9 @@ struct note_node
 };
 
 struct chord get_chord(struct note_node *node);
+struct chord get_chord_from_file(const char * const filename, double secs_to_sample, long max_notes);
+struct chord get_chord_from_chroma(const float * const chroma, double threshold);
+int get_chord_candidates(const struct note_node *node, struct chord_candidate *candidates, int max_candidates);
+long get_chord_candidates_from_masks(const unsigned * const masks, const enum semitone_t * const basses, long num_sets, struct chord_candidate *candidates, int max_candidates, int *num_candidates);
 
 #endif
@@ -0,0 +1,321 @@
+/*
+ *  chroma.c
+ *
+ *  Copyright (C) 2016  Nathan Bossart
+ */
+
+/* needed for sysconf() under -std=c99 */
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include "chroma.h"
+#include "common.h"
+#include "dsp.h"
+#include "fft.h"
+#include <fftw3.h>
+#include <pthread.h>
+#include "source.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "utils.h"
+
+/* number of frames read at a time when a file can't be memory-mapped */
+#define CHROMA_READ_BLOCK_SIZE	4096
+
+/*
+ * The recording shared (read-only) by every chroma worker.  Memory-mapped
+ * files are analyzed in place; anything else is mixed down to mono up front.
+ *
+ * frames         : the interleaved mapped frames (NULL if not mapped)
+ * encoding       : the encoding of frames
+ * num_channels   : the number of interleaved channels in frames
+ * mono           : the mixed down samples (NULL if mapped)
+ * window_size    : number of samples in each analysis window
+ * hop_size       : number of samples between the starts of two windows
+ * hann           : cached Hann function table of length window_size
+ * pitch_classes  : the pitch class of each bin (-1 outside the note range)
+ * chroma         : the frames x CHROMA_NUM_BINS output matrix
+ */
+struct chroma_input
+{
+	const unsigned char *	frames;
+	enum sample_encoding_t	encoding;
+	int			num_channels;
+	double *		mono;
+	long			window_size;
+	long			hop_size;
+	const double *		hann;
+	int *			pitch_classes;
+	float *			chroma;
+};
+
+/*
+ * Everything a chroma worker thread needs.  Each worker computes a contiguous
+ * range of frames with its own FFT buffers.
+ *
+ * input : the recording and output matrix shared by every worker
+ * first : index of the first frame for this worker
+ * last  : one past the index of the last frame for this worker
+ */
+struct chroma_worker
+{
+	const struct chroma_input *	input;
+	long				first;
+	long				last;
+};
+
+/* function prototypes for static functions */
+static double *	read_mono_samples(struct tonedef_source *source, long num_frames);
+static int *	get_pitch_classes(long window_size, int sample_rate);
+static void *	run_chroma_worker(void *arg);
+
+/*
+ * This function computes a chroma vector (also known as a pitch class profile)
+ * every hop_size frames over the whole sound file, using Hann-windowed FFTs of
+ * window_size frames.  The power of every bin within the range of notes we can
+ * name is added to the pitch class of its nearest note, and each vector is
+ * scaled so that its strongest pitch class is 1.0.  The file is read only
+ * once, and the frames are spread over num_threads threads (one per online
+ * processor if num_threads is less than 1).
+ *
+ * The returned matrix is allocated on the heap and holds CHROMA_NUM_BINS
+ * floats (indexed by enum semitone_t) for each frame, one frame after another;
+ * the number of frames is stored in frames_returned.  Each row can be handed
+ * straight to get_chord_from_chroma().
+ *
+ * Returns NULL for illegal arguments or if the file could not be read.
+ */
+float *get_chromagram_from_file(const char * const filename, long window_size, long hop_size, int num_threads, long *frames_returned)
+{
+	struct tonedef_source	*source;
+	struct chroma_input	input;
+	struct chroma_worker	*workers;
+	pthread_t		*threads;
+	long			num_frames;
+	long			num_windows;
+	long			frames_mapped;
+	long			windows_per_worker;
+	long			remainder;
+	int			threads_started;
+	int			i;
+
+	if (NULL == frames_returned) {
+		fprintf(stderr, "frames_returned cannot be NULL\n");
+		return NULL;
+	}
+	*frames_returned = 0;
+
+	/* the Hann function is undefined for windows of less than 2 samples */
+	if (2 > window_size || 0 >= hop_size) {
+		fprintf(stderr, "window size must be at least 2 and hop size must be positive\n");
+		return NULL;
+	}
+
+	if (NULL == filename) {
+		fprintf(stderr, "filename is null\n");
+		return NULL;
+	}
+
+	if (NULL == (source = open_source(filename))) {
+		fprintf(stderr, "could not open sound file; does the file exist?\n");
+		return NULL;
+	}
+
+	num_frames = get_source_num_frames(source);
+	if (num_frames < window_size) {
+		close_source(source);
+		return NULL;
+	}
+	num_windows = (num_frames - window_size) / hop_size + 1;
+
+	input.frames = NULL;
+	input.mono = NULL;
+	input.num_channels = get_source_num_channels(source);
+	if (is_source_mapped(source)) {
+		input.frames = map_frames_from_source(source, num_frames, &frames_mapped, &input.encoding);
+	} else {
+		input.mono = read_mono_samples(source, num_frames);
+	}
+	input.window_size = window_size;
+	input.hop_size = hop_size;
+	input.hann = get_hann_window(window_size);
+	input.pitch_classes = get_pitch_classes(window_size, get_source_sample_rate(source));
+	input.chroma = (float *) CALLOC_SAFELY(num_windows * CHROMA_NUM_BINS, sizeof(float));
+
+	if (1 > num_threads) {
+		num_threads = MAX(1, sysconf(_SC_NPROCESSORS_ONLN));
+	}
+	num_threads = MIN(num_threads, num_windows);
+
+	workers = (struct chroma_worker *) MALLOC_SAFELY(num_threads * sizeof(struct chroma_worker));
+	threads = (pthread_t *) MALLOC_SAFELY(num_threads * sizeof(pthread_t));
+
+	/* every frame costs the same, so equal ranges balance the load */
+	windows_per_worker = num_windows / num_threads;
+	remainder = num_windows % num_threads;
+	for (i = 0; i < num_threads; ++i) {
+		workers[i].input = &input;
+		workers[i].first = (0 == i) ? 0 : workers[i - 1].last;
+		workers[i].last = workers[i].first + windows_per_worker + (i < remainder ? 1 : 0);
+	}
+
+	/* whatever no thread could be started for is done on this thread */
+	for (threads_started = 0; threads_started < num_threads; ++threads_started) {
+		if (0 != pthread_create(&threads[threads_started], NULL, run_chroma_worker, &workers[threads_started])) {
+			break;
+		}
+	}
+
+	for (i = threads_started; i < num_threads; ++i) {
+		run_chroma_worker(&workers[i]);
+	}
+
+	for (i = 0; i < threads_started; ++i) {
+		pthread_join(threads[i], NULL);
+	}
+
+	/* the mapped frames must stay around until every worker is done */
+	close_source(source);
+	FREE_SAFELY(threads);
+	FREE_SAFELY(workers);
+	FREE_SAFELY(input.pitch_classes);
+	FREE_SAFELY(input.mono);
+
+	*frames_returned = num_windows;
+	return input.chroma;
+}
+
+/*
+ * Static function that reads every frame of a source that isn't memory-mapped
+ * and mixes it down to mono, a block at a time.
+ *
+ * Returns the num_frames mono samples, allocated on the heap.
+ */
+static double *read_mono_samples(struct tonedef_source *source, long num_frames)
+{
+	double	*mono;
+	double	*block;
+	long	frames_read;
+	long	total;
+	int	num_channels;
+
+	num_channels = get_source_num_channels(source);
+	mono = (double *) CALLOC_SAFELY(num_frames, sizeof(double));
+	block = (double *) MALLOC_SAFELY(CHROMA_READ_BLOCK_SIZE * num_channels * sizeof(double));
+
+	for (total = 0; total < num_frames; total += frames_read) {
+		frames_read = read_frames_from_source(source, block, MIN(CHROMA_READ_BLOCK_SIZE, num_frames - total));
+		if (0 >= frames_read) {
+			break;
+		}
+		mix_down_and_window(block, frames_read, num_channels, NULL, mono + total);
+	}
+
+	FREE_SAFELY(block);
+	return mono;
+}
+
+/*
+ * Static function that works out which pitch class each bin of a window_size
+ * FFT belongs to: that of the note nearest to the bin's center frequency.  Bins
+ * outside the range of notes we can name (see get_exact_notes()) get -1.
+ *
+ * Returns the window_size / 2 + 1 pitch classes, allocated on the heap.
+ */
+static int *get_pitch_classes(long window_size, int sample_rate)
+{
+	int		*pitch_classes;
+	double		*freqs;
+	struct note	*notes;
+	long		i;
+	long		num_bins;
+
+	num_bins = window_size / 2 + 1;
+	pitch_classes = (int *) MALLOC_SAFELY(num_bins * sizeof(int));
+	freqs = (double *) MALLOC_SAFELY(num_bins * sizeof(double));
+	notes = (struct note *) MALLOC_SAFELY(num_bins * sizeof(struct note));
+
+	for (i = 0; i < num_bins; ++i) {
+		freqs[i] = (double) i * sample_rate / window_size;
+	}
+
+	/* out-of-range bins quietly get UNKNOWN_SEMITONE, which is -1 */
+	get_exact_notes(freqs, num_bins, notes);
+	for (i = 0; i < num_bins; ++i) {
+		pitch_classes[i] = notes[i].semitone;
+	}
+
+	FREE_SAFELY(freqs);
+	FREE_SAFELY(notes);
+
+	return pitch_classes;
+}
+
+/*
+ * Static function run by each chroma worker thread.  For each frame in its
+ * range, it windows the samples (converting mapped frames in the same pass),
+ * takes the FFT, folds the power of each bin into its pitch class, and scales
+ * the chroma vector to a maximum of 1.0.
+ */
+static void *run_chroma_worker(void *arg)
+{
+	const struct chroma_worker	*worker;
+	const struct chroma_input	*input;
+	double				*fft_in;
+	fftw_complex			*fft_out;
+	fftw_plan			plan;
+	double				bins[CHROMA_NUM_BINS];
+	double				maximum;
+	long				num_bins;
+	long				frame;
+	long				start;
+	long				i;
+	float				*chroma;
+
+	worker = (const struct chroma_worker *) arg;
+	input = worker->input;
+	assert(NULL != input);
+
+	num_bins = input->window_size / 2 + 1;
+	fft_in = (double *) detect_oom(fftw_malloc(input->window_size * sizeof(double)));
+	fft_out = (fftw_complex *) detect_oom(fftw_malloc(num_bins * sizeof(fftw_complex)));
+	plan = get_r2c_plan(input->window_size, fft_in, fft_out);
+
+	for (frame = worker->first; NULL != plan && frame < worker->last; ++frame) {
+		start = frame * input->hop_size;
+		if (NULL != input->frames) {
+			mix_down_and_window_encoded(input->frames + start * input->num_channels * get_encoded_sample_size(input->encoding),
+				input->encoding, input->window_size, input->num_channels, input->hann, fft_in);
+		} else {
+			mix_down_and_window(input->mono + start, input->window_size, 1, input->hann, fft_in);
+		}
+		fftw_execute_dft_r2c(plan, fft_in, fft_out);
+
+		for (i = 0; i < CHROMA_NUM_BINS; ++i) {
+			bins[i] = 0.0;
+		}
+		for (i = 0; i < num_bins; ++i) {
+			if (0 <= input->pitch_classes[i]) {
+				bins[input->pitch_classes[i]] += fft_out[i][0] * fft_out[i][0] + fft_out[i][1] * fft_out[i][1];
+			}
+		}
+
+		maximum = 0.0;
+		for (i = 0; i < CHROMA_NUM_BINS; ++i) {
+			maximum = MAX(maximum, bins[i]);
+		}
+
+		/* silent frames are left as all zeros */
+		chroma = input->chroma + frame * CHROMA_NUM_BINS;
+		for (i = 0; 0.0 < maximum && i < CHROMA_NUM_BINS; ++i) {
+			chroma[i] = (float) (bins[i] / maximum);
+		}
+	}
+
+	/* the plan is cached, so we don't destroy it here */
+	fftw_free(fft_in);
+	fftw_free(fft_out);
+
+	return NULL;
+}
@@ -0,0 +1,17 @@
+/*
+ *  chroma.h
+ *
+ *  Copyright (C) 2016  Nathan Bossart
+ */
+
+#ifndef CHROMA_H
+#define CHROMA_H
+
+#include "common.h"
+
+/* number of pitch classes in each chroma vector (one per semitone, C first) */
+#define CHROMA_NUM_BINS		SEMITONES_PER_OCTAVE
+
+float	*get_chromagram_from_file(const char * const filename, long window_size, long hop_size, int num_threads, long *frames_returned);
+
+#endif
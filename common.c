@@ -7,27 +7,86 @@
 #include <assert.h>
 #include "common.h"
 #include <ctype.h>
+#include "dsp.h"
+#include "fft.h"
 #include <fftw3.h>
 #include <math.h>
-#include <sndfile.h>
+#include <pthread.h>
+#include "scale.h"
+#include "source.h"
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
+#include "stats.h"
 #include <stdlib.h>
 #include <string.h>
 #include "utils.h"
+#include "workspace.h"
+
+/* note positions (see get_note_position()) of C0 -50 cents and B8 +50 cents */
+#define LOWEST_NOTE_POSITION	(OCTAVE_MIN * SEMITONES_PER_OCTAVE - OCTAVE_NOTE_NUM_OFFSET + C - 0.5)
+#define HIGHEST_NOTE_POSITION	(OCTAVE_MAX * SEMITONES_PER_OCTAVE - OCTAVE_NOTE_NUM_OFFSET + B + 0.5)
+
+/* constants for fast_log2(), since -std=c99 doesn't give us M_SQRT2 or M_LOG2E */
+#define FAST_LOG2_SQRT_2	1.41421356237309504880
+#define FAST_LOG2_E		1.44269504088896340736
+
+/* number of frequencies get_exact_notes() takes the logs of at a time */
+#define EXACT_NOTES_BLOCK_SIZE	64
+
+/* the note table index (see struct note_table) of a note */
+#define GET_NOTE_INDEX(octave, semitone)	(((octave) - OCTAVE_MIN) * SEMITONES_PER_OCTAVE + (semitone))
+
+/* the note table index of A4 */
+#define NOTE_INDEX_OF_A4	GET_NOTE_INDEX(4, A)
+
+/*
+ * The equal-tempered frequencies of every note we can name (C0 to B8) for a
+ * reference pitch, indexed by GET_NOTE_INDEX().  A table never changes once it
+ * has been built, so it can be read without a lock.
+ *
+ * reference : the frequency of A4
+ * freqs     : the ideal frequency of each note
+ * bounds    : bounds[i] is 50 cents below note i, and bounds[NOTE_TABLE_SIZE]
+ *             is 50 cents above B8
+ * next      : the next table built by set_reference_pitch() (NULL if we're at
+ *             the end)
+ */
+struct note_table
+{
+	double			reference;
+	double			freqs[NOTE_TABLE_SIZE];
+	double			bounds[NOTE_TABLE_SIZE + 1];
+	struct note_table *	next;
+};
 
 /* function prototypes for static functions */
-static bool			is_allowable_freq(double freq);
-static enum semitone_t *	get_scale(enum semitone_t tonic, enum semitone_t *scale, int scale_length);
-static void 			get_sample_rate_of_file(char *filename, int *sample_rate, int *num_channels);
-static double *			combine_channels(double *samples, long num_samples, int num_channels);
-static double *			get_fft_magnitudes(fftw_complex *fft_samples, long num_samples);
-static void			get_sound_file_metadata(const char * const filename, int *sample_rate, int *num_channels);
-//static double *		get_autocorrelation_function(const double * const samples, long num_samples, int sample_rate)
-//static double *		get_avg_magnitude_diff_function(const double * const samples, long num_samples, int sample_rate);
-//static double *		get_weighted_autocorrelation_function(double *acf, double *amdf, long num_samples);
-static long			get_index_of_maximum(double *array, long array_len);
+static void			build_note_table(struct note_table *table, double freq_of_a4);
+static void			build_default_note_table(void);
+static const struct note_table	*get_note_table(void);
+static bool			is_allowable_position(double position);
+static double			get_note_position(double freq);
+static void			set_note_from_position(struct note *note, double position);
+static double			fast_log2(double x);
+static enum semitone_t *	copy_scale_steps(enum scale_t scale_type, enum semitone_t tonic);
+static bool			get_spectrum_from_file(struct tonedef_workspace *workspace, const char * const filename, double secs_to_sample, double max_freq, long *num_bins, double *bin_freq, struct detection_stats *stats);
+static bool			get_mono_samples_from_file(struct tonedef_workspace *workspace, const char * const filename, double secs_to_sample, bool windowed, double max_freq, long *num_samples, int *sample_rate, struct detection_stats *stats);
+
+/*
+ * Every lookup goes through the note table for the current reference pitch.
+ * The table for FREQ_OF_A4 is built on first use, and set_reference_pitch()
+ * builds (or finds) the table for another pitch in separate storage and then
+ * swaps the current table pointer atomically, so a thread converting notes
+ * meanwhile sees either the old table or the new one, never a mix.  A reader
+ * may still hold an old table, so tables are never freed; they are kept for
+ * the next time the same pitch is set instead.
+ */
+static struct note_table	default_note_table;
+static struct note_table	*retuned_note_tables = NULL;
+static const struct note_table	*current_note_table = NULL;
+static pthread_once_t		note_table_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t		note_table_lock = PTHREAD_MUTEX_INITIALIZER;
 
 /*
  * Retrieves the semitone enumeration representative of the string argument.
@@ -130,45 +189,216 @@ char *get_semitone_str(enum semitone_t semitone, bool prefer_flat)
 }
 
 /*
- * This function verifies that the provided frequency falls within the range of
- * notes this library can represent.  This range is from C0 -50.0 cents to B12
- * +50 cents.
+ * Static function that fills in a note table for the given frequency of A4.
+ * Only pow() builds the table; looking notes up never needs it again.
  */
-static bool is_allowable_freq(double freq)
+static void build_note_table(struct note_table *table, double freq_of_a4)
 {
-	double		lowest_freq;
-	double		highest_freq;
-	struct note	lowest_note;
-	struct note	highest_note;
+	int	i;
 
-	lowest_note.semitone	= C;  /* the "lowest" semitone enumeration */
-	lowest_note.octave	= OCTAVE_MIN;
-	lowest_note.cents	= -(SEMITONE_INTERVAL_CENTS / 2.0);  /* -50.0 */
+	assert(NULL != table);
+
+	table->reference = freq_of_a4;
+
+	/*
+	 * The note index of A4 (octave * SEMITONES_PER_OCTAVE + semitone) is
+	 * NOTE_INDEX_OF_A4, and every semitone away from it multiplies the
+	 * frequency by the twelfth root of 2 in twelve-tone equal temperament.
+	 */
+	for (i = 0; i < NOTE_TABLE_SIZE; ++i) {
+		table->freqs[i] = freq_of_a4 * pow(OCTAVE_JUST_INTERVAL,
+			(i - NOTE_INDEX_OF_A4) / (double) SEMITONES_PER_OCTAVE);
+		table->bounds[i] = freq_of_a4 * pow(OCTAVE_JUST_INTERVAL,
+			(i - NOTE_INDEX_OF_A4 - 0.5) / SEMITONES_PER_OCTAVE);
+	}
+	table->bounds[NOTE_TABLE_SIZE] = freq_of_a4 * pow(OCTAVE_JUST_INTERVAL,
+		(NOTE_TABLE_SIZE - NOTE_INDEX_OF_A4 - 0.5) / SEMITONES_PER_OCTAVE);
+}
+
+/*
+ * Static function that builds the note table for FREQ_OF_A4 and makes it the
+ * current one (through pthread_once(), so it only happens once).
+ */
+static void build_default_note_table(void)
+{
+	build_note_table(&default_note_table, FREQ_OF_A4);
+	default_note_table.next = NULL;
+	__atomic_store_n(&current_note_table, &default_note_table, __ATOMIC_RELEASE);
+}
+
+/*
+ * Static function that returns the current note table, building the default
+ * one on first use.  It may be called from any thread.
+ */
+static const struct note_table *get_note_table(void)
+{
+	pthread_once(&note_table_once, build_default_note_table);
+	return __atomic_load_n(&current_note_table, __ATOMIC_ACQUIRE);
+}
+
+/*
+ * This function sets the frequency of A4 that every note is tuned to, for
+ * ensembles that don't tune to the ISO 16:1975 standard of FREQ_OF_A4 (e.g.
+ * 442 Hz).  It rebuilds the note table that get_freq(), get_approx_note(),
+ * get_exact_note(), and everything built on them use from then on.  It must
+ * be within REFERENCE_PITCH_MIN to REFERENCE_PITCH_MAX Hz.
+ *
+ * It may be called while other threads are converting notes or frequencies;
+ * each conversion uses either the old pitch or the new one throughout.  Every
+ * other pitch set keeps its table (about 2 KB) for the rest of the process.
+ * Cached constant-Q kernels are keyed by the reference pitch, so they are
+ * simply rebuilt when they are next needed.
+ *
+ * Returns REFERENCE_PITCH_SUCCESS_CODE, or REFERENCE_PITCH_FAILURE_CODE if the
+ * frequency is out of range.
+ */
+int set_reference_pitch(double freq_of_a4)
+{
+	struct note_table	*table;
+
+	if (REFERENCE_PITCH_MIN > freq_of_a4 || REFERENCE_PITCH_MAX < freq_of_a4) {
+		fprintf(stderr, "reference pitch must be within %f to %f\n",
+			REFERENCE_PITCH_MIN, REFERENCE_PITCH_MAX);
+		return REFERENCE_PITCH_FAILURE_CODE;
+	}
+
+	/* make sure the default build can't come along and undo this later */
+	pthread_once(&note_table_once, build_default_note_table);
 
-	highest_note.semitone	= B;  /* the "highest" semitone enumeration */
-	highest_note.octave	= OCTAVE_MAX;
-	highest_note.cents	= SEMITONE_INTERVAL_CENTS / 2.0;  /* +50.0 */
+	pthread_mutex_lock(&note_table_lock);
+	table = &default_note_table;
+	if (FREQ_OF_A4 != freq_of_a4) {
+		for (table = retuned_note_tables; NULL != table; table = table->next) {
+			if (freq_of_a4 == table->reference) {
+				break;
+			}
+		}
+	}
+
+	/* a new table is filled in completely before anyone can see it */
+	if (NULL == table) {
+		table = (struct note_table *) MALLOC_SAFELY(sizeof(struct note_table));
+		build_note_table(table, freq_of_a4);
+		table->next = retuned_note_tables;
+		retuned_note_tables = table;
+	}
+	__atomic_store_n(&current_note_table, table, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&note_table_lock);
+
+	return REFERENCE_PITCH_SUCCESS_CODE;
+}
+
+/*
+ * This function returns the frequency of A4 that every note is tuned to (see
+ * set_reference_pitch()).
+ */
+double get_reference_pitch(void)
+{
+	return get_note_table()->reference;
+}
+
+/*
+ * This function verifies that the provided note position (a note number as in
+ * get_freq(), with the fraction of a semitone above or below it) falls within
+ * the range of notes this library can represent.  This range is from C0 -50.0
+ * cents to B8 +50 cents.  The bounds are constants, so checking is just two
+ * comparisons.
+ */
+static bool is_allowable_position(double position)
+{
+	return (position >= LOWEST_NOTE_POSITION) && (position <= HIGHEST_NOTE_POSITION);
+}
+
+/*
+ * This function returns the position of the frequency in semitones: the note
+ * number (see get_freq()) of the nearest note, plus the fraction of a semitone
+ * the frequency is above or below it.  It's the inverse of the function used
+ * to find the frequency of a note given the note number.  Frequencies that
+ * aren't positive give -HUGE_VAL (and aren't allowable).
+ */
+static double get_note_position(double freq)
+{
+	if (0.0 >= freq) {
+		return -HUGE_VAL;
+	}
+
+	return SEMITONES_PER_OCTAVE * log2(freq / get_note_table()->reference) + NOTE_NUM_OF_A4;
+}
+
+/*
+ * This function fills in the note at the given (allowable) note position, with
+ * the fraction of a semitone as cents.
+ */
+static void set_note_from_position(struct note *note, double position)
+{
+	int	note_num;
 
-	lowest_freq	= get_freq(&lowest_note);
-	highest_freq	= get_freq(&highest_note);
+	/* exactly 50 cents outside the range rounds to a note we can't name */
+	note_num = round(position);
+	note_num = MAX(ceil(LOWEST_NOTE_POSITION), MIN(floor(HIGHEST_NOTE_POSITION), note_num));
+
+	/*
+	 * There is an octave number offset due to the conventional division
+	 * of the 0th and 1st octaves between notes 3 and 4 (B0 and C1,
+	 * respectively).  In order to retrieve the correct octave number, this
+	 * offset must be added to the note number prior to dividing the note
+	 * number by the number of notes per octave.  What remains is the
+	 * "local" note.  This is simply the conventional letter and optional
+	 * symbol identifier of the note without the octave number (e.g. B# 5).
+	 */
+	note->octave = (note_num + OCTAVE_NOTE_NUM_OFFSET) / SEMITONES_PER_OCTAVE;
+	note->semitone = (note_num + OCTAVE_NOTE_NUM_OFFSET) % SEMITONES_PER_OCTAVE;
+	note->cents = SEMITONE_INTERVAL_CENTS * (position - note_num);
+}
 
-	return (freq >= lowest_freq) && (freq <= highest_freq);
+/*
+ * This function is a log2() for positive, normal doubles that the compiler can
+ * vectorize: it has no branches and no calls.  The exponent is taken straight
+ * from the bits, and the log of the mantissa (moved into sqrt(1/2) to sqrt(2))
+ * comes from the series ln(m) = 2 atanh((m - 1) / (m + 1)), which is accurate
+ * to about 1e-15 there.
+ */
+static double fast_log2(double x)
+{
+	uint64_t	bits;
+	double		exponent;
+	double		mantissa;
+	double		z;
+	double		z2;
+	double		ln;
+	int		high;
+
+	memcpy(&bits, &x, sizeof(bits));
+	exponent = (double) ((int) ((bits >> 52) & 0x7FF) - 1023);
+	bits = (bits & UINT64_C(0x000FFFFFFFFFFFFF)) | UINT64_C(0x3FF0000000000000);
+	memcpy(&mantissa, &bits, sizeof(mantissa));
+
+	high = (mantissa > FAST_LOG2_SQRT_2);
+	mantissa = high ? 0.5 * mantissa : mantissa;
+	exponent += high;
+
+	z = (mantissa - 1.0) / (mantissa + 1.0);
+	z2 = z * z;
+	ln = 2.0 * z * (1.0 + z2 * (1.0 / 3 + z2 * (1.0 / 5 + z2 * (1.0 / 7 + z2 * (1.0 / 9
+		+ z2 * (1.0 / 11 + z2 * (1.0 / 13 + z2 * (1.0 / 15 + z2 * (1.0 / 17)))))))));
+
+	return exponent + ln * FAST_LOG2_E;
 }
 
 /*
  * This function retrieves the ideal frequency of a note given it's name and
- * octave (e.g. G# 5).  The ideal frequency is based upon the ISO 16:1975
- * standard frequency of the A4 note (i.e. 440 Hz) in twelve-tone equal
- * temperament.
+ * octave (e.g. G# 5).  The ideal frequency is based upon the reference pitch
+ * of the A4 note (by default, the ISO 16:1975 standard of 440 Hz; see
+ * set_reference_pitch()) in twelve-tone equal temperament.  The frequency of
+ * the note comes straight from the note table; only a note with cents off
+ * its ideal frequency needs any math.
  *
  * Returns the frequency if everything works as expected. Returns -1.0 for
  * illegal arguments.
  */
 double get_freq(const struct note * const note)
 {
-	int	note_num;
 	double	ideal_freq;
-	double	exact_freq;
 
 	if (note->semitone < C || note->semitone > B) {
 		fprintf(stderr, "invalid semitone '%d'\n", note->semitone);
@@ -189,63 +419,39 @@ double get_freq(const struct note * const note)
 		return INVALID_FREQUENCY;
 	}
 
-	/*
-	 * Determine the frequency of the note.
-	 *
-	 * The frequency of the note is first determined by finding the note
-	 * number.  A0 has note number 1, A#0 has note number 2, etc.  Using
-	 * the octave and the semitone enumeration, the following formula can
-	 * be used to determine the note number.
-	 *
-	 * There is an octave number offset due to the conventional division
-	 * of the 0th and 1st octaves between notes 3 and 4 (B0 and C1,
-	 * respectively).  In order to retrieve the semitone of the octave,
-	 * this offset must be subtracted from the product of the octave
-	 * number and the number of notes per octave.
-	 */
-	note_num = (note->octave * SEMITONES_PER_OCTAVE)
-		- OCTAVE_NOTE_NUM_OFFSET
-		+ note->semitone;
-
-	/*
-	 * Once we have the note number, we can use the following formula to
-	 * determine it's ideal frequency based on the standardized frequency of
-	 * the the 49th key (A4) in twelve-tone equal temperament.  This value
-	 * is defined in ISO 16:1975 as 440 Hz.
-	 *
-	 * f(n) = (sqrt[12]{2})^{n-49} * 440
-	 */
-	ideal_freq = pow(OCTAVE_JUST_INTERVAL,
-		(note_num - NOTE_NUM_OF_A4) / (double) SEMITONES_PER_OCTAVE)
-		* FREQ_OF_A4;
+	ideal_freq = get_note_table()->freqs[GET_NOTE_INDEX(note->octave, note->semitone)];
+	if (0.0 == note->cents) {
+		return ideal_freq;
+	}
 
 	/*
 	 * Now, we just have to apply the cents to retrieve the exact frequency
 	 * of the note.  This can be done using the following formula.
 	 */
-	exact_freq = ideal_freq
-		* pow(OCTAVE_JUST_INTERVAL,
-			note->cents / (SEMITONE_INTERVAL_CENTS
-				* SEMITONES_PER_OCTAVE));
-
-	return exact_freq;
+	return ideal_freq * exp2(note->cents / (SEMITONE_INTERVAL_CENTS * SEMITONES_PER_OCTAVE));
 }
 
 /*
  * This function retrieves the note closest to the given frequency. The ideal
- * frequency is based upon the ISO 16:1975 standard frequency of the A4 note
- * (i.e. 440 Hz) in twelve-tone equal temperament.
+ * frequency is based upon the reference pitch of the A4 note (by default, the
+ * ISO 16:1975 standard of 440 Hz; see set_reference_pitch()) in twelve-tone
+ * equal temperament.
  *
  * Returns the note if everything works as expected.  Returns an invalid note
  * for illegal arguments or internal error.
  */
 struct note get_approx_note(double freq)
 {
-	struct note	note;
-	int		note_num;
+	const struct note_table	*table;
+	struct note		note;
+	int			low;
+	int			high;
+	int			middle;
+
+	table = get_note_table();
 
-	/* check that the note exists between C0 and B24 */
-	if (!is_allowable_freq(freq)) {
+	/* check that the note exists between C0 and B8 */
+	if (!(freq >= table->bounds[0] && freq <= table->bounds[NOTE_TABLE_SIZE])) {
 		fprintf(stderr, "frequency %f not in acceptable range\n", freq);
 		note.semitone	= UNKNOWN_SEMITONE;
 		note.octave	= INVALID_OCTAVE;
@@ -254,34 +460,23 @@ struct note get_approx_note(double freq)
 	}
 
 	/*
-	 * Determine the approximate note number of the frequency.
-	 *
-	 * This function is simply the inverse of the function used to find the
-	 * frequency of a note given the note number.
-	 */
-	note_num = round(SEMITONES_PER_OCTAVE * log2(freq / FREQ_OF_A4)
-			+ NOTE_NUM_OF_A4);
-
-	/*
-	 * Determine the octave of the note.
-	 *
-	 * There is an octave number offset due to the conventional division
-         * of the 0th and 1st octaves between notes 3 and 4 (B0 and C1,
-         * respectively).  In order to retrieve the correct octave number,
-         * this offset must be added to the note number prior to dividing the
-	 * note number by the number of notes per octave.
-	 */
-	note.octave = (note_num + OCTAVE_NOTE_NUM_OFFSET)
-			/ SEMITONES_PER_OCTAVE;
-
-	/*
-	 * Deterine the "local" note.  This is simply the conventional letter
-	 * and optional symbol identifier of the not without the octave number
-	 * (e.g. B# 5).
+	 * Find the note whose boundaries (50 cents either side of it) hold the
+	 * frequency with a binary search of the table, so no logarithms are
+	 * needed at all.
 	 */
-	note.semitone = (note_num + OCTAVE_NOTE_NUM_OFFSET)
-			% SEMITONES_PER_OCTAVE;
+	low = 0;
+	high = NOTE_TABLE_SIZE - 1;
+	while (low < high) {
+		middle = (low + high + 1) / 2;
+		if (freq >= table->bounds[middle]) {
+			low = middle;
+		} else {
+			high = middle - 1;
+		}
+	}
 
+	note.octave = low / SEMITONES_PER_OCTAVE;
+	note.semitone = low % SEMITONES_PER_OCTAVE;
 	note.cents = 0.0;  /* since this is approximate, this is always 0 */
 
 	return note;
@@ -289,9 +484,10 @@ struct note get_approx_note(double freq)
 
 /*
  * This function retrieves the exact note for the given frequency. The ideal
- * frequency is based upon the ISO 16:1975 standard frequency of the A4 note
- * (i.e. 440 Hz) in twelve-tone equal temperament.  The cents member of the
- * note struct will be given a value in the (inclusive) range -50.0 to +50.0.
+ * frequency is based upon the reference pitch of the A4 note (by default, the
+ * ISO 16:1975 standard of 440 Hz; see set_reference_pitch()) in twelve-tone
+ * equal temperament.  The cents member of the note struct will be given a
+ * value in the (inclusive) range -50.0 to +50.0.
  *
  * Returns the note if everything works as expected.  Returns an invalid note
  * for illegal arguments or internal error.
@@ -299,37 +495,83 @@ struct note get_approx_note(double freq)
 struct note get_exact_note(double freq)
 {
 	struct note	note;
-	double		approx_note_freq;
-
-	/* use our handy-dandy get_approx_note() fxn to get a ballpark note */
-	note = get_approx_note(freq);
-	if (UNKNOWN_SEMITONE == note.semitone) {
-		return note;
-	}
+	double		position;
 
 	/*
-	 * In order to calculate the cents value for the exact note, we first
-	 * must know the ideal frequency of the approximate note.
-	 *
-	 * We assume that get_freq() is called without any illegal arguments,
-	 * since we have successfully gotten the approximate note if we have
-	 * made it this far.
+	 * The position of the frequency in semitones gives us both the nearest
+	 * note (rounding it) and the cents away from that note (what's left
+	 * over), with a single log2().
 	 */
-	approx_note_freq = get_freq(&note);
-	assert(INVALID_FREQUENCY != approx_note_freq);
+	position = get_note_position(freq);
 
-	/*
-	 * Calculate the number of cents from the ideal frequency of the
-	 * approximate note.  This is done by multiplying the number of cents
-	 * per octave by the logarithm base two of the quotient of the
-	 * frequencies.
-	 */
-	note.cents = SEMITONE_INTERVAL_CENTS * SEMITONES_PER_OCTAVE
-		* log2(freq / approx_note_freq);
+	/* check that the note exists between C0 and B8 */
+	if (!is_allowable_position(position)) {
+		fprintf(stderr, "frequency %f not in acceptable range\n", freq);
+		note.semitone	= UNKNOWN_SEMITONE;
+		note.octave	= INVALID_OCTAVE;
+		note.cents	= INVALID_CENTS	;
+		return note;
+	}
+
+	set_note_from_position(&note, position);
 
 	return note;
 }
 
+/*
+ * This function is get_exact_note() for a whole array of frequencies, for
+ * callers that convert many estimates at a time (e.g. every frame of several
+ * streams).  The notes are stored in the notes array, which must have room for
+ * num_freqs notes.  Nothing is printed: frequencies outside the range of notes
+ * this library can represent (C0 -50.0 cents to B8 +50.0 cents) simply get an
+ * invalid note, like the one get_exact_note() returns.
+ *
+ * The logarithms are computed a block at a time with a branch-free log2 that
+ * the compiler can vectorize, and agree with get_exact_note() to well within
+ * a millionth of a cent.
+ *
+ * Returns the number of frequencies that were out of range (0 if every one
+ * was converted), or GET_EXACT_NOTES_FAILURE_CODE for illegal arguments.
+ */
+long get_exact_notes(const double * const freqs, long num_freqs, struct note *notes)
+{
+	double	positions[EXACT_NOTES_BLOCK_SIZE];
+	double	reference;
+	long	num_invalid;
+	long	start;
+	long	length;
+	long	i;
+
+	if (NULL == freqs || NULL == notes || 0 > num_freqs) {
+		return GET_EXACT_NOTES_FAILURE_CODE;
+	}
+
+	reference = get_note_table()->reference;
+	num_invalid = 0;
+	for (start = 0; start < num_freqs; start += length) {
+		length = MIN(EXACT_NOTES_BLOCK_SIZE, num_freqs - start);
+
+		/* the block's logs in one tight loop... */
+		for (i = 0; i < length; ++i) {
+			positions[i] = SEMITONES_PER_OCTAVE * fast_log2(freqs[start + i] / reference) + NOTE_NUM_OF_A4;
+		}
+
+		/* ...and then the notes, checking the range as we go */
+		for (i = 0; i < length; ++i) {
+			if (0.0 < freqs[start + i] && is_allowable_position(positions[i])) {
+				set_note_from_position(&notes[start + i], positions[i]);
+			} else {
+				notes[start + i].semitone	= UNKNOWN_SEMITONE;
+				notes[start + i].octave		= INVALID_OCTAVE;
+				notes[start + i].cents		= INVALID_CENTS;
+				++num_invalid;
+			}
+		}
+	}
+
+	return num_invalid;
+}
+
 /*
  * This function returns the semitone obtained by ascending by the interval of
  * an equal tempered fifth.
@@ -365,35 +607,23 @@ enum semitone_t get_fifth(enum semitone_t semitone)
  }
 
 /*
- * Static function for getting several different types of scales.  This function
- * returns the generated scale on the heap.  The 'scale' parameter must be the
- * version of the scale with 'C' as the tonic note and it must end with
- * UNKNOWN_SEMITONE.
+ * Static function that copies the steps of a scale from the scale table (see
+ * get_scale()) to the heap, terminated by UNKNOWN_SEMITONE, for the functions
+ * below that hand out their own copy.
  *
  * Returns NULL for illegal arguments.
  */
-static enum semitone_t *get_scale(enum semitone_t tonic, enum semitone_t *scale, int scale_length)
+static enum semitone_t *copy_scale_steps(enum scale_t scale_type, enum semitone_t tonic)
 {
-	assert(NULL != scale);
-	assert(0 < scale_length);
-	assert(UNKNOWN_SEMITONE == scale[scale_length - 1]);
+	const struct scale	*scale;
+	enum semitone_t		*ret;
 
-	if (C > tonic || B < tonic) {
-		fprintf(stderr, "invalid tonic '%d'\n", tonic);
+	if (NULL == (scale = get_scale(scale_type, tonic))) {
 		return NULL;
 	}
 
-	enum semitone_t *ret = (enum semitone_t *) MALLOC_SAFELY(scale_length * sizeof(enum semitone_t));
-
-	for (int i = 0; i < scale_length; ++i) {
-
-		if (UNKNOWN_SEMITONE == scale[i]) {
-			ret[i] = UNKNOWN_SEMITONE;
-			continue;
-		}
-
-		ret[i] = (scale[i] + tonic) % SEMITONES_PER_OCTAVE;
-	}
+	ret = (enum semitone_t *) MALLOC_SAFELY((scale->length + 1) * sizeof(enum semitone_t));
+	memcpy(ret, scale->steps, (scale->length + 1) * sizeof(enum semitone_t));
 
 	return ret;
 }
@@ -401,116 +631,72 @@ static enum semitone_t *get_scale(enum semitone_t tonic, enum semitone_t *scale,
 /*
  * This function returns the major scale of the given tonic note.  The scale is
  * an array of semitone_t terminated by an UNKNOWN_SEMITONE, and it is allocated
- * on the heap.  If the tonic is an illegal argument, NULL is returned.
+ * on the heap.  If the tonic is an illegal argument, NULL is returned.  Use
+ * get_scale() instead to avoid the allocation.
  */
 enum semitone_t *get_major_scale(enum semitone_t tonic)
 {
-	enum semitone_t major_scale[] = {C, D, E, F, G, A, B, UNKNOWN_SEMITONE};
-
-	return get_scale(tonic, major_scale,
-		sizeof(major_scale) / sizeof(enum semitone_t));
+	return copy_scale_steps(MAJOR_SCALE, tonic);
 }
 
 /*
  * This function returns the natural minor scale of the given tonic note.  The
  * scale is an array of semitone_t terminated by an UNKNOWN_SEMITONE, and it is
  * allocated on the heap.  If the tonic is an illegal argument, NULL is
- * returned.
+ * returned.  Use get_scale() instead to avoid the allocation.
  */
 enum semitone_t *get_natural_minor_scale(enum semitone_t tonic)
 {
-	enum semitone_t natural_minor_scale[] = {C, D, Eb, F, G, Ab, Bb, UNKNOWN_SEMITONE};
-
-	return get_scale(tonic, natural_minor_scale,
-		sizeof(natural_minor_scale) / sizeof(enum semitone_t));
+	return copy_scale_steps(NATURAL_MINOR_SCALE, tonic);
 }
 
 /*
  * This function returns the harmonic minor scale of the given tonic note.  The
  * scale is an array of semitone_t terminated by an UNKNOWN_SEMITONE, and it is
  * allocated on the heap.  If the tonic is an illegal argument, NULL is
- * returned.
+ * returned.  Use get_scale() instead to avoid the allocation.
  */
 enum semitone_t *get_harmonic_minor_scale(enum semitone_t tonic)
 {
-	enum semitone_t harmonic_minor_scale[] = {C, D, Eb, F, G, Ab, B, UNKNOWN_SEMITONE};
-
-	return get_scale(tonic, harmonic_minor_scale,
-		sizeof(harmonic_minor_scale) / sizeof(enum semitone_t));
+	return copy_scale_steps(HARMONIC_MINOR_SCALE, tonic);
 }
 
 /*
  * This function returns the melodic minor scale of the given tonic note.  The
  * scale is an array of semitone_t terminated by an UNKNOWN_SEMITONE, and it is
  * allocated on the heap.  If the tonic is an illegal argument, NULL is
- * returned.
+ * returned.  Use get_scale() instead to avoid the allocation.
  */
 enum semitone_t *get_melodic_minor_scale(enum semitone_t tonic)
 {
-	enum semitone_t melodic_minor_scale[] = {C, D, Eb, F, G, A, B, UNKNOWN_SEMITONE};
-
-	return get_scale(tonic, melodic_minor_scale,
-		sizeof(melodic_minor_scale) / sizeof(enum semitone_t));
+	return copy_scale_steps(MELODIC_MINOR_SCALE, tonic);
 }
 
 /*
  * This function returns the chromatic scale of the given tonic note.  The scale
  * is an array of semitone_t terminated by an UNKNOWN_SEMITONE, and it is
  * allocated on the heap.  If the tonic is an illegal argument, NULL is
- * returned.
+ * returned.  Use get_scale() instead to avoid the allocation.
  */
 enum semitone_t *get_chromatic_scale(enum semitone_t tonic)
 {
-	enum semitone_t chromatic_scale[] = {C, Db, D, Eb, E, F, Gb, G, Ab, A, Bb, B, UNKNOWN_SEMITONE};
-
-	return get_scale(tonic, chromatic_scale,
-		sizeof(chromatic_scale) / sizeof(enum semitone_t));
+	return copy_scale_steps(CHROMATIC_SCALE, tonic);
 }
 
 /*
- * This function retrieves the sample rate and number of channels in the audio
- * file, storing them in the respective arguments.
+ * This function reads the first frames_requested frames of the sound file into
+ * an array allocated on the heap.  Each frame holds one sample per channel, so
+ * the samples of multi-channel files are interleaved.  The number of frames
+ * actually read (fewer than requested only if the file is shorter) is stored
+ * in frames_returned.
  *
- * If there are problems with the file, the sample rate and channel count are
- * set to -1.  Otherwise, these values should be set as expected.
+ * Returns NULL for illegal arguments or if the file could not be read.
  */
-static void get_sound_file_metadata(const char * const filename, int *sample_rate, int *num_channels)
-{
-	SF_INFO	sfinfo;
-	SNDFILE	*file;
-
-	assert(NULL != sample_rate);
-	assert(NULL != num_channels);
-	assert(NULL != filename);
-
-	/* initialize to invalid values in case we hit an error */
-	*sample_rate = -1;
-	*num_channels = -1;
-
-	memset(&sfinfo, 0, sizeof(sfinfo));
-	if (NULL == (file = sf_open(filename, SFM_READ, &sfinfo))) {
-		return;
-	}
-
-	if (0 != sf_close(file)) {
-		return;
-	}
-
-	*sample_rate = sfinfo.samplerate;
-	*num_channels = sfinfo.channels;
-}
-
-/* TODO: documentation */
 double *get_samples_from_file(const char * const filename, long frames_requested, long *frames_returned)
 {
-	SNDFILE	*file;
-	SF_INFO	sfinfo;
-	double	*buf;
-	double	*ret;
-	int	audio_channels;
-	int	rd_cnt;
-	long	frames_written;
-	long	frames_to_copy;
+	struct tonedef_source	*source;
+	double			*ret;
+	long			frames_read;
 
 	if (NULL == frames_returned) {
 		fprintf(stderr, "frames_returned cannot be NULL\n");
@@ -526,37 +712,18 @@ double *get_samples_from_file(const char * const filename, long frames_requested
 		return NULL;
 	}
 
-	memset(&sfinfo, 0, sizeof(sfinfo));
-	if (NULL == (file = sf_open(filename, SFM_READ, &sfinfo))) {
+	if (NULL == (source = open_source(filename))) {
 		return NULL;
 	}
 
 	/* each frame contains a sample per audio channel */
-	audio_channels = sfinfo.channels;
-	ret = (double *) MALLOC_SAFELY(frames_requested * audio_channels * sizeof(double));
+	ret = (double *) MALLOC_SAFELY(frames_requested * get_source_num_channels(source) * sizeof(double));
 
-	/* we use a temporary buffer for pulling the samples into memory */
-	buf = (double *) MALLOC_SAFELY(audio_channels * AUDIO_SAMPLE_BUFSIZE * sizeof(double));
-	frames_written = 0;
-	while (frames_written < frames_requested && 0 < (rd_cnt = sf_readf_double(file, buf, AUDIO_SAMPLE_BUFSIZE))) {
+	/* read straight into the return array; no need for a bounce buffer */
+	frames_read = read_frames_from_source(source, ret, frames_requested);
+	close_source(source);
 
-		/*
-		 * We'll be able to copy either all of the bytes in our
-		 * temporary buffer or only the ones that fit in our allocated
-		 * memory, whichever is smaller.
-		 */
-		frames_to_copy = MIN(rd_cnt, frames_requested - frames_written);
-		memcpy(ret + (frames_written * audio_channels), buf, frames_to_copy * audio_channels * sizeof(double));
-		frames_written += frames_to_copy;
-	}
-	FREE_SAFELY(buf);
-
-	if (0 != sf_close(file)) {
-		FREE_SAFELY(ret);
-		return NULL;
-	}
-
-	*frames_returned = frames_written;
+	*frames_returned = frames_read;
 	return ret;
 }
 
@@ -607,8 +774,9 @@ int split_stereo_channels(const double * const samples, long num_samples, double
 /* TODO: documentation */
 double *apply_hann_function(const double * const samples, long num_samples)
 {
-	long	i;
-	double *ret;
+	long		i;
+	double		*ret;
+	const double	*window;
 
 	if (NULL == samples) {
 		return NULL;
@@ -618,10 +786,11 @@ double *apply_hann_function(const double * const samples, long num_samples)
 		return NULL;
 	}
 
+	/* the window table is cached, so there's no cos() call per sample */
+	window = get_hann_window(num_samples);
 	ret = (double *) MALLOC_SAFELY(num_samples * sizeof(double));
 	for (i = 0; i < num_samples; ++i) {
-		ret[i] = samples[i]
-			* 0.5 * (1 - cos((2 * M_PI * i) / (num_samples - 1)));
+		ret[i] = samples[i] * window[i];
 	}
 
 	return ret;
@@ -642,300 +811,414 @@ fftw_complex *get_fft(double *samples, long num_samples)
 	}
 
 	ret = (fftw_complex *) MALLOC_SAFELY(num_samples * sizeof(fftw_complex));
-	if (NULL == (plan = fftw_plan_dft_r2c_1d(num_samples, samples, ret, FFTW_ESTIMATE))) {
+
+	/* plans are cached, so only the first transform of this shape plans */
+	if (NULL == (plan = get_r2c_plan(num_samples, samples, ret))) {
+		FREE_SAFELY(ret);
 		return NULL;
 	}
 
-	fftw_execute(plan);
-	fftw_destroy_plan(plan);
+	fftw_execute_dft_r2c(plan, samples, ret);
 
 	return ret;
 }
 
-static double *combine_channels(double *samples, long num_samples, int num_channels)
+/*
+ * Static function that reads the first secs_to_sample seconds of the file and
+ * mixes the channels down to one, applying the Hann function if windowed is
+ * true.  If max_freq is positive, the samples are decimated (see decimate() in
+ * dsp.h) to the lowest sample rate that still holds max_freq before the Hann
+ * function is applied.  Everything happens in the workspace (which is grown if
+ * it's too small), and the samples end up in its samples buffer, ready for an
+ * FFT.  Their number and (decimated) sample rate are stored in num_samples and
+ * sample_rate.  The time spent in each stage is added to stats (if it isn't
+ * NULL).
+ *
+ * Returns false for illegal arguments or if the file could not be read.
+ */
+static bool get_mono_samples_from_file(struct tonedef_workspace *workspace, const char * const filename, double secs_to_sample, bool windowed, double max_freq, long *num_samples, int *sample_rate, struct detection_stats *stats)
 {
-	long	i;
-	int	j;
-	double	*ret;
+	long long	start;
+	int		num_channels;
+	int		factor;
+	long		samples_returned;
+	const unsigned char	*frames;
+	enum sample_encoding_t	encoding;
+	struct tonedef_source *	source;
 
-	assert(NULL != samples);
-	assert(0 < num_samples);
-	assert(0 < num_channels);
+	assert(NULL != workspace);
+	assert(NULL != num_samples);
+	assert(NULL != sample_rate);
 
-	ret = (double *) MALLOC_SAFELY(num_samples * sizeof(double));
+	if (NULL == filename) {
+		fprintf(stderr, "filename is null\n");
+		return false;
+	}
 
-	for (i = 0; i < num_samples; ++i) {
-		ret[i] = 0.0;
-		for (j = 0; j < num_channels; ++j) {
-			ret[i] += samples[i * num_channels + j] / num_channels;
-		}
+	if (0.0 >= secs_to_sample) {
+		fprintf(stderr, "secs_to_sample is less than zero\n");
+		return false;
 	}
 
-	return ret;
-}
+	/* open the file once for both its metadata and its samples */
+	start = GET_STAGE_START(stats);
+	if (NULL == (source = open_workspace_source(workspace, filename))) {
+		fprintf(stderr, "could not open sound file; does the file exist?\n");
+		return false;
+	}
+	*sample_rate = get_source_sample_rate(source);
+	num_channels = get_source_num_channels(source);
 
-static double *get_fft_magnitudes(fftw_complex *fft_samples, long num_samples)
-{
-	long i;
-	double *ret;
+	/* get the number of samples we'll be working with */
+	*num_samples = secs_to_sample * *sample_rate;
+	if (0 >= *num_samples) {
+		fprintf(stderr, "secs_to_sample is too short to hold a single sample\n");
+		return false;
+	}
 
-	assert(NULL != fft_samples);
-	assert(0 < num_samples);
+	/* don't bother allocating if the file is too short anyway */
+	if (*num_samples > get_source_num_frames(source)) {
+		fprintf(stderr, "file does not contain the requested number of samples\n");
+		return false;
+	}
 
-	ret = (double *) MALLOC_SAFELY(num_samples * sizeof(double));
+	/*
+	 * Get the samples from the file.
+	 *
+	 * If we don't get the requested number of samples back, we give up.
+	 */
+	reserve_workspace(workspace, *num_samples, is_source_mapped(source) ? 0 : num_channels);
+	if (is_source_mapped(source)) {
+		frames = map_frames_from_source(source, *num_samples, &samples_returned, &encoding);
+	} else {
+		samples_returned = read_frames_from_source(source, workspace->frames, *num_samples);
+	}
+	ADD_STAGE_TIME(stats, decode_ns, start);
+	if (NULL != stats && 0 < samples_returned) {
+		stats->bytes_read += samples_returned * num_channels
+			* (is_source_mapped(source) ? get_encoded_sample_size(encoding) : (long) sizeof(double));
+	}
+	if (*num_samples != samples_returned) {
+		fprintf(stderr, "could not retrieve requested number of samples from file\n");
+		return false;
+	}
 
-	for (i = 0; i < num_samples; ++i) {
-		ret[i] = sqrt(fft_samples[i][0] * fft_samples[i][0] + fft_samples[i][1] * fft_samples[i][1]);
-		//ret[i] = 10 * log10(ret[i]);
+	/*
+	 * Combine all the channels into one and (maybe) apply the Hann function
+	 * to our window of samples.  This is done in a single pass with a cached
+	 * window table, writing straight into the (aligned) FFT input buffer.
+	 * Memory-mapped frames are converted in that same pass, straight from
+	 * the mapping.
+	 */
+	start = GET_STAGE_START(stats);
+	factor = (0.0 < max_freq) ? get_decimation_factor(*sample_rate, max_freq) : 1;
+	if (1 < factor && *num_samples >= factor) {
+
+		/* the window goes on after decimating, so mix down unwindowed */
+		if (is_source_mapped(source)) {
+			mix_down_and_window_encoded(frames, encoding, *num_samples, num_channels, NULL, workspace->scratch);
+		} else {
+			mix_down_and_window(workspace->frames, *num_samples, num_channels, NULL, workspace->scratch);
+		}
+		*num_samples = decimate(workspace->scratch, *num_samples, factor, workspace->samples);
+		*sample_rate /= factor;
+		if (windowed) {
+			mix_down_and_window(workspace->samples, *num_samples, 1, get_hann_window(*num_samples), workspace->samples);
+		}
+	} else if (is_source_mapped(source)) {
+		mix_down_and_window_encoded(frames, encoding, *num_samples, num_channels,
+			windowed ? get_hann_window(*num_samples) : NULL, workspace->samples);
+	} else {
+		mix_down_and_window(workspace->frames, *num_samples, num_channels,
+			windowed ? get_hann_window(*num_samples) : NULL, workspace->samples);
 	}
+	ADD_STAGE_TIME(stats, mixdown_ns, start);
 
-	return ret;
+	return true;
 }
 
 /*
- * I've commented out the functions related to autocorrelation until they are
- * used for something.  Until then, there's no use counting them in the code
- * coverage.
+ * Static function that does the work shared by get_note_from_file() and
+ * get_notes_from_file(): it reads the first secs_to_sample seconds of the file,
+ * mixes the channels down to one (decimating them if max_freq is positive),
+ * applies the Hann function, and takes the FFT.  The spectrum ends up in the
+ * workspace's spectrum buffer and holds num_bins (that is, num_samples / 2 + 1)
+ * bins, which is stored in the num_bins argument.  The frequency of each bin
+ * is a multiple of the bin_freq argument (about 1 / secs_to_sample).
+ * The time spent in each stage is added to stats (if it isn't NULL).
+ *
+ * Returns false for illegal arguments or if the file could not be analyzed.
  */
-/*
-static double *get_autocorrelation_function(const double * const samples, long num_samples, int sample_rate)
+static bool get_spectrum_from_file(struct tonedef_workspace *workspace, const char * const filename, double secs_to_sample, double max_freq, long *num_bins, double *bin_freq, struct detection_stats *stats)
 {
-	double *ret;
-	long tau;
-	struct note lowest_note;
-	struct note highest_note;
-	long min_tau;
-	long max_tau;
-	long iterations;
-	long i;
-
-	assert(NULL != samples);
-	assert(0 < num_samples);
-	assert(0 < sample_rate);
-
-	lowest_note.semitone	= C;  // the "lowest" semitone enumeration
-	lowest_note.octave	= OCTAVE_MIN;
-	lowest_note.cents	= -(SEMITONE_INTERVAL_CENTS / 2.0);  // -50.0
-	max_tau = (1.0 / get_freq(&lowest_note)) * sample_rate;
-
-	highest_note.semitone	= B;  // the "highest" semitone enumeration
-	highest_note.octave	= OCTAVE_MAX;
-	highest_note.cents	= SEMITONE_INTERVAL_CENTS / 2.0;  // +50.0
-	min_tau = (1.0 / get_freq(&highest_note)) * sample_rate;
-
-	max_tau = MIN(max_tau, num_samples);
+	long long	start;
+	int		sample_rate;
+	long		num_samples;
+	fftw_plan	plan;
 
-	/// if this isn't true, then we have bigger problems
-	assert(min_tau < max_tau);
+	assert(NULL != num_bins);
+	assert(NULL != bin_freq);
 
-	ret = (double *) CALLOC_SAFELY(num_samples, sizeof(double));
+	if (!get_mono_samples_from_file(workspace, filename, secs_to_sample, true, max_freq, &num_samples, &sample_rate, stats)) {
+		return false;
+	}
 
-	for (tau = min_tau; tau < max_tau; ++tau) {
+	/*
+	 * Without decimation, this is 1 / secs_to_sample as it always was.
+	 * Decimating truncates the number of samples a second time, so then the
+	 * bin frequency has to come from the samples we actually have.
+	 */
+	*bin_freq = (0.0 < max_freq) ? (double) sample_rate / num_samples : 1.0 / secs_to_sample;
 
-		iterations = num_samples - tau - 1;
-		ret[tau] = 0.0;
-		for (i = 0; i < iterations; ++i) {
-			ret[tau] += samples[i] * samples[i + tau];
-		}
-		// ret[tau] *= 1.0 / iterations;
+	/*
+	 * Get the Fast Fourier Transform of our samples.  Only the first
+	 * num_samples / 2 + 1 bins of a real-input FFT are meaningful (the rest
+	 * are the complex conjugates), so that's all we compute.
+	 */
+	start = GET_STAGE_START(stats);
+	*num_bins = num_samples / 2 + 1;
+	if (NULL == (plan = get_r2c_plan(num_samples, workspace->samples, workspace->spectrum))) {
+		fprintf(stderr, "could not calculate fft\n");
+		return false;
+	}
+	fftw_execute_dft_r2c(plan, workspace->samples, workspace->spectrum);
+	ADD_STAGE_TIME(stats, fft_ns, start);
+	if (NULL != stats) {
+		stats->fft_size = num_samples;
 	}
 
-	return ret;
+	return true;
 }
 
-static double *get_avg_magnitude_diff_function(const double * const samples, long num_samples, int sample_rate)
+/*
+ * This function fills in the default detection options, which give the same
+ * results as get_note_from_file().
+ */
+void init_detection_options(struct detection_options *options)
 {
-	double *	ret;
-	struct note	lowest_note;
-	struct note	highest_note;
-	long		tau;
-	long		min_tau;
-	long		max_tau;
-	long		iterations;
-	long		i;
-
-	assert(NULL != samples);
-	assert(0 < num_samples);
-	assert(0 < sample_rate);
+	if (NULL == options) {
+		return;
+	}
 
-	lowest_note.semitone	= C;  // the "lowest" semitone enumeration
-	lowest_note.octave	= OCTAVE_MIN;
-	lowest_note.cents	= -(SEMITONE_INTERVAL_CENTS / 2.0);  // -50.0
-	max_tau = (1.0 / get_freq(&lowest_note)) * sample_rate;
+	options->method		= SPECTRAL_PEAK_METHOD;
+	options->interpolation	= NO_INTERPOLATION;
+	options->yin_threshold	= YIN_DEFAULT_THRESHOLD;
+	options->stats		= NULL;
+	options->workspace	= NULL;
+	options->onset_gating	= false;
+	options->max_freq	= 0.0;
+}
 
-	highest_note.semitone	= B;  // the "highest" semitone enumeration
-	highest_note.octave	= OCTAVE_MAX;
-	highest_note.cents	= SEMITONE_INTERVAL_CENTS / 2.0;  // +50.0
-	min_tau = (1.0 / get_freq(&highest_note)) * sample_rate;
+/*
+ * This function detects the (single) most prominent note in the first
+ * secs_to_sample seconds of the sound file.
+ *
+ * Returns an invalid note for illegal arguments or if the file could not be
+ * analyzed.
+ */
+struct note get_note_from_file(const char * const filename, double secs_to_sample)
+{
+	return get_note_from_file_with_options(filename, secs_to_sample, NULL);
+}
 
-	max_tau = MIN(max_tau, num_samples);
+/*
+ * This function is get_note_from_file() with control over how the note is
+ * detected (see struct detection_options).  NULL options means the defaults.
+ *
+ * With interpolation, the frequency of the peak is no longer limited to
+ * multiples of 1 / secs_to_sample, so much shorter (and cheaper) samples give
+ * the same accuracy in cents.
+ *
+ * Returns an invalid note for illegal arguments or if the file could not be
+ * analyzed.
+ */
+struct note get_note_from_file_with_options(const char * const filename, double secs_to_sample, const struct detection_options * const options)
+{
+	long				sample_num_of_highest_magnitude;
+	long				num_bins;
+	long				search_bins;
+	double				bin_freq;
+	long				num_samples;
+	long				allocations;
+	long long			start;
+	int				sample_rate;
+	double				peak;
+	double				freq;
+	struct note			ret;
+	struct detection_options	defaults;
+	struct detection_stats *	stats;
+	struct tonedef_workspace *	workspace;
 
-	// if this isn't true, then we have bigger problems
-	assert(min_tau < max_tau);
+	/* initialize as invalid note for error checking purposes */
+	ret.semitone	= UNKNOWN_SEMITONE;
+	ret.octave	= INVALID_OCTAVE;
+	ret.cents	= INVALID_CENTS	;
 
-	ret = (double *) CALLOC_SAFELY(num_samples, sizeof(double));
+	init_detection_options(&defaults);
+	if (NULL != options) {
+		defaults = *options;
+	}
 
-	for (tau = min_tau; tau < MIN(max_tau, num_samples); ++tau) {
+	stats = defaults.stats;
+	allocations = get_allocation_count();
+	if (NULL != stats) {
+		++stats->calls;
+	}
 
-		iterations = num_samples - tau - 1;
-		ret[tau] = 0.0;
-		for (i = 0; i < iterations; ++i) {
-			ret[tau] += samples[i] - samples[i + tau];
-		}
-		// ret[tau] *= 1.0 / iterations;
+	/* without a workspace from the caller, we need one just for this call */
+	workspace = defaults.workspace;
+	if (NULL == workspace) {
+		workspace = create_workspace(0, 0);
 	}
 
-	return ret;
-}
+	/*
+	 * YIN works on the raw samples, not their spectrum.  It refines its
+	 * period between samples, which gets much less accurate with only a few
+	 * samples per period, so it never decimates.
+	 */
+	if (YIN_METHOD == defaults.method) {
+		if (get_mono_samples_from_file(workspace, filename, secs_to_sample, false, 0.0, &num_samples, &sample_rate, stats)) {
+			start = GET_STAGE_START(stats);
+			freq = get_yin_frequency_with_scratch(workspace->samples, num_samples, sample_rate, defaults.yin_threshold,
+				workspace->scratch, workspace->spectrum, workspace->scratch_spectrum);
+			if (INVALID_FREQUENCY != freq) {
+				ret = get_exact_note(freq);
+			}
+			ADD_STAGE_TIME(stats, peak_ns, start);
+			if (NULL != stats) {
+				stats->fft_size = num_samples;
+			}
+		}
+	} else if (get_spectrum_from_file(workspace, filename, secs_to_sample, defaults.max_freq, &num_bins, &bin_freq, stats)) {
 
-static double *get_weighted_autocorrelation_function(double *acf, double *amdf, long num_samples)
-{
-	double *ret;
-	long	i;
+		/*
+		 * The FFT output array is all complex numbers.  We need the
+		 * magnitude of each output value in order to reveal the
+		 * frequencies that we care about, but all we really want is the
+		 * strongest one.  Its true frequency is usually somewhere
+		 * between two bins.
+		 */
+		start = GET_STAGE_START(stats);
+		search_bins = num_bins;
+		if (0.0 < defaults.max_freq) {
+
+			/*
+			 * The decimation filter only attenuates the top of the
+			 * decimated band partway, so anything there must not
+			 * win over the frequencies we asked for.
+			 */
+			search_bins = MIN(num_bins, (long) (defaults.max_freq / bin_freq) + 1);
+		}
+		sample_num_of_highest_magnitude = get_peak_of_spectrum(workspace->spectrum, search_bins, NULL);
+		peak = interpolate_peak(workspace->spectrum, num_bins, sample_num_of_highest_magnitude, defaults.interpolation);
+		ADD_STAGE_TIME(stats, peak_ns, start);
 
-	assert(NULL != acf);
-	assert(NULL != amdf);
-	assert(0 < num_samples);
+		/*
+		 * Finally, get the note.
+		 *
+		 * The frequency is simply the sample number in our FFT divided
+		 * by the number of seconds that we sampled.  This is because we
+		 * have num_samples samples in our FFT and secs_to_sample =
+		 * num_samples / sample_rate.  It also makes sense that the
+		 * denominator here would be in seconds since hertz =
+		 * seconds^-1.  Decimating doesn't change that, since it divides
+		 * both the number of samples and the sample rate.
+		 */
+		ret = get_exact_note(peak * bin_freq);
+	}
 
-	ret = (double *) MALLOC_SAFELY(num_samples * sizeof(double));
+	if (NULL == defaults.workspace) {
+		destroy_workspace(workspace);
+	}
 
-	for (i = 0; i < num_samples; ++i) {
-		ret[i] = acf[i] / (amdf[i] + 1);
+	if (NULL != stats) {
+		stats->allocations += get_allocation_count() - allocations;
 	}
 
 	return ret;
 }
-*/
 
 /*
- * A simple convenience function for getting the index of the maximum double in
- * an array.  Since it is a static function, either the index of the maximum
- * value should be returned or an assertion should fail (causing the program to
- * exit with an error message).
+ * This function detects up to max_notes of the most prominent notes in the
+ * first secs_to_sample seconds of the sound file, all from a single read of the
+ * file and a single FFT.  The notes are the strongest spectral peaks that are
+ * within NOTE_PEAK_MIN_RELATIVE_POWER of the strongest one and aren't harmonics
+ * of a lower peak of comparable strength (see remove_harmonic_peaks() in
+ * dsp.h).  They are stored in the notes array, strongest first.
+ *
+ * Since harmonics are discarded, a note doubled at the octave (e.g. C4 and C5)
+ * is only detected once.
+ *
+ * Returns the number of notes stored, or -1 for illegal arguments or if the
+ * file could not be analyzed.
  */
-static long get_index_of_maximum(double *array, long array_len)
+long get_notes_from_file(const char * const filename, double secs_to_sample, struct note *notes, long max_notes)
 {
-	long	maximum_index;
-	long	i;
-	double	maximum;
-
-	assert(NULL != array);
-	assert(0 < array_len);
-
-	/*
-	 * We prep the return value by starting with the first element in the
-	 * array.
-	 */
-	maximum_index = 0;
-	maximum = array[0];
-
-	/* now iterate over the rest, updating each time we find a new max */
-	for (i = 1; i < array_len; ++i) {
-		if (array[i] > maximum) {
-			maximum = array[i];
-			maximum_index = i;
-		}
-	}
-
-	return maximum_index;
-}
-
-/* TODO: write version to pick up all prominent notes */
-struct note get_note_from_file(const char * const filename, double secs_to_sample)
-{
-	int		sample_rate;
-	int		num_channels;
-	long		sample_num_of_highest_magnitude;
-	long		samples_returned;
-	long		num_samples;
-	double *	samples;
-	double *	mono_samples;
-	double *	hannd_samples;
-	double *	fft_magnitudes;
-	struct note	invalid_note;
-	fftw_complex *	fft_samples;
-
-	/* initialize as invalid note for error checking purposes */
-	invalid_note.semitone	= UNKNOWN_SEMITONE;
-	invalid_note.octave	= INVALID_OCTAVE;
-	invalid_note.cents	= INVALID_CENTS	;
-
-	if (NULL == filename) {
-		fprintf(stderr, "filename is null\n");
-		return invalid_note;
-	}
+	long		peaks[DSP_MAX_PEAKS];
+	double		powers[DSP_MAX_PEAKS];
+	long		num_peaks;
+	long		num_bins;
+	double		bin_freq;
+	long		min_bin;
+	long		num_notes;
+	long		i;
+	long		j;
+	struct note	note;
+	struct note	lowest_note;
+	struct tonedef_workspace *	workspace;
 
-	if (0.0 >= secs_to_sample) {
-		fprintf(stderr, "secs_to_sample is less than zero\n");
-		return invalid_note;
+	if (NULL == notes || 0 >= max_notes) {
+		fprintf(stderr, "notes cannot be NULL and max_notes must be positive\n");
+		return -1;
 	}
 
-	/* get the sample rate and number of channels in the file */
-	get_sound_file_metadata(filename, &sample_rate, &num_channels);
-	if (-1 == sample_rate || -1 == num_channels) {
-		fprintf(stderr, "could not retrieve sound file metadata; does the file exist?\n");
-		return invalid_note;
+	workspace = create_workspace(0, 0);
+	if (!get_spectrum_from_file(workspace, filename, secs_to_sample, 0.0, &num_bins, &bin_freq, NULL)) {
+		destroy_workspace(workspace);
+		return -1;
 	}
 
-	/* get the number of samples we'll be working with */
-	num_samples = secs_to_sample * sample_rate;
+	/* nothing below C0 -50 cents can be a note, so skip those bins */
+	lowest_note.semitone	= C;
+	lowest_note.octave	= OCTAVE_MIN;
+	lowest_note.cents	= -(SEMITONE_INTERVAL_CENTS / 2.0);
+	min_bin = ceil(get_freq(&lowest_note) / bin_freq);
 
 	/*
-	 * Get the samples from the file.
-	 *
-	 * If the the file is gone or we don't get the requested number of
-	 * samples back, we return an invalid note.
+	 * Pick more peaks than we need, since some of them will turn out to be
+	 * harmonics of the others.
 	 */
-	samples = get_samples_from_file(filename, num_samples, &samples_returned);
-	if (NULL == samples || num_samples != samples_returned) {
-		fprintf(stderr, "could not access file or retrieve requested number of samples from file\n");
-		FREE_SAFELY(samples);
-		return invalid_note;
+	num_peaks = get_peaks_of_spectrum(workspace->spectrum, num_bins, min_bin,
+		NOTE_PEAK_MIN_RELATIVE_POWER, peaks, DSP_MAX_PEAKS);
+	for (i = 0; i < num_peaks; ++i) {
+		powers[i] = workspace->spectrum[peaks[i]][0] * workspace->spectrum[peaks[i]][0]
+			+ workspace->spectrum[peaks[i]][1] * workspace->spectrum[peaks[i]][1];
 	}
+	destroy_workspace(workspace);
+	num_peaks = remove_harmonic_peaks(peaks, powers, num_peaks, NOTE_HARMONIC_TOLERANCE_CENTS,
+		NOTE_HARMONIC_TOLERANCE_BINS, NOTE_HARMONIC_MIN_RELATIVE_POWER);
+
+	num_notes = 0;
+	for (i = 0; i < num_peaks && num_notes < max_notes; ++i) {
+		note = get_exact_note(peaks[i] * bin_freq);
+		if (UNKNOWN_SEMITONE == note.semitone) {
+			continue;
+		}
 
-	/* combine all the channels into one */
-	mono_samples = combine_channels(samples, num_samples, num_channels);
-	FREE_SAFELY(samples);
-
-	/* apply the Hanning function to our window of samples */
-	if (NULL == (hannd_samples = apply_hann_function(mono_samples, num_samples))) {
-		fprintf(stderr, "could not apply hanning function; chances are there is a bigger problem\n");
-		FREE_SAFELY(mono_samples);
-		FREE_SAFELY(hannd_samples);
-		return invalid_note;
-	}
-	FREE_SAFELY(mono_samples);
+		/*
+		 * A single note can show up as two neighboring peaks (e.g. the
+		 * detuned strings of a piano), so only keep the strongest.
+		 */
+		for (j = 0; j < num_notes; ++j) {
+			if (note.semitone == notes[j].semitone && note.octave == notes[j].octave) {
+				break;
+			}
+		}
 
-	/* get the Fast Fourier Transform of our samples */
-	if (NULL == (fft_samples = get_fft(hannd_samples, num_samples))) {
-		fprintf(stderr, "could not calculate fft\n");
-		FREE_SAFELY(hannd_samples);
-		FREE_SAFELY(fft_samples);
-		return invalid_note;
+		if (j == num_notes) {
+			notes[num_notes++] = note;
+		}
 	}
-	FREE_SAFELY(hannd_samples);
-
-	/*
-	 * The FFT output array is all complex numbers.  We need to calculate
-	 * the magnitude of each output value in order to reveal the frequencies
-	 * that we care about.
-	 */
-	fft_magnitudes = get_fft_magnitudes(fft_samples, num_samples);
-	fftw_free(fft_samples);
-	fft_samples = NULL;
 
-	/* get the FFT sample index that has the highest magnitude */
-	sample_num_of_highest_magnitude = get_index_of_maximum(fft_magnitudes, num_samples);
-	FREE_SAFELY(fft_magnitudes);
-
-	/*
-	 * Finally, get the note.
-	 *
-	 * The frequency is simply the sample number in our FFT divided by the
-	 * number of seconds that we sampled.  This is because we have
-	 * num_samples samples in our FFT and secs_to_sample = num_samples /
-	 * sample_rate.  It also makes sense that the denominator here would be
-	 * in seconds since hertz = seconds^-1.
-	 */
-	return get_exact_note(sample_num_of_highest_magnitude / secs_to_sample);
+	return num_notes;
 }
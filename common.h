@@ -8,7 +8,9 @@
 #define COMMON_H
 
 #include <fftw3.h>
+#include "stats.h"
 #include <stdbool.h>
+#include "workspace.h"
 
 /* lowest octave number accepted */
 #define OCTAVE_MIN		0
@@ -19,9 +21,23 @@
 /* notes/octave in 12-tone equal temperament */
 #define SEMITONES_PER_OCTAVE	12
 
-/* standard freq of A4 as defined in ISO 16:1975 */
+/* the bit for a semitone in a set of semitones (one bit per semitone) */
+#define SEMITONE_BIT(semitone)	(1u << (semitone))
+
+/* number of notes from C0 to B8 */
+#define NOTE_TABLE_SIZE		((OCTAVE_MAX - OCTAVE_MIN + 1) * SEMITONES_PER_OCTAVE)
+
+/* standard freq of A4 as defined in ISO 16:1975 (the default reference pitch) */
 #define FREQ_OF_A4		440
 
+/* range of reference pitches accepted by set_reference_pitch() */
+#define REFERENCE_PITCH_MIN	400.0
+#define REFERENCE_PITCH_MAX	480.0
+
+/* return codes for the set_reference_pitch() function */
+#define REFERENCE_PITCH_SUCCESS_CODE	0
+#define REFERENCE_PITCH_FAILURE_CODE	-1
+
 /* note number of A4 on an 88-key piano */
 #define NOTE_NUM_OF_A4		49
 
@@ -48,6 +64,9 @@
 #define M_PI			3.14159265358979323846264338327950288
 #endif
 
+/* return value of get_exact_notes() for illegal arguments */
+#define GET_EXACT_NOTES_FAILURE_CODE	-1
+
 /* return codes for the split_stereo_channels() function */
 #define SPLIT_STEREO_CHANNELS_SUCCESS_CODE	0
 #define SPLIT_STEREO_CHANNELS_FAILURE_CODE	-1
@@ -55,6 +74,18 @@
 /* number of channels in stereo audio */
 #define STEREO_NUM_CHANNELS	2
 
+/* peaks this much weaker (in power) than the strongest aren't notes (-20 dB) */
+#define NOTE_PEAK_MIN_RELATIVE_POWER	0.01
+
+/* peaks this close to a multiple of a lower peak are taken as its harmonics */
+#define NOTE_HARMONIC_TOLERANCE_CENTS	10.0
+
+/* ...as are peaks this many FFT bins from it (for low notes, a bin is a lot of cents) */
+#define NOTE_HARMONIC_TOLERANCE_BINS	1.0
+
+/* ...but only if the lower peak has at least this much of its power (-10 dB) */
+#define NOTE_HARMONIC_MIN_RELATIVE_POWER	0.1
+
 /*
  * The half step enumeration defines the difference in semitones of the note
  * from the base note in the octave.  For example, the note E is 4 semitones
@@ -79,10 +110,92 @@ struct note
 	double		cents;
 };
 
+/*
+ * How the frequency of a spectral peak is refined beyond the resolution of one
+ * FFT bin.  Without interpolation, the only way to get more accurate cents is
+ * a longer window (more latency and more work); with it, short windows give
+ * nearly the same accuracy.
+ *
+ * NO_INTERPOLATION        : the center frequency of the strongest bin
+ * QUADRATIC_INTERPOLATION : the vertex of a parabola through the magnitudes of
+ *                           the strongest bin and its two neighbors
+ * GAUSSIAN_INTERPOLATION  : the same through the log magnitudes, which is
+ *                           exact for a Gaussian window and very close for Hann
+ * PHASE_VOCODER_INTERPOLATION : the phase advance of the strongest bin between
+ *                           consecutive frames; this needs two overlapping
+ *                           frames, so it only applies to the note detector in
+ *                           stream.h (one-shot analysis uses Gaussian instead)
+ */
+enum peak_interpolation_t
+{
+	NO_INTERPOLATION,
+	QUADRATIC_INTERPOLATION,
+	GAUSSIAN_INTERPOLATION,
+	PHASE_VOCODER_INTERPOLATION
+};
+
+/*
+ * How the pitch of a note is estimated.
+ *
+ * SPECTRAL_PEAK_METHOD : the strongest bin of the FFT of the windowed samples
+ * YIN_METHOD           : the period found by the YIN algorithm (see
+ *                        get_yin_frequency() in dsp.h); this only needs two
+ *                        periods of the note, so it resolves low notes with
+ *                        far shorter samples than the spectral peak does
+ */
+enum pitch_method_t
+{
+	SPECTRAL_PEAK_METHOD,
+	YIN_METHOD
+};
+
+/* default threshold of the normalized difference function for YIN_METHOD */
+#define YIN_DEFAULT_THRESHOLD	0.1
+
+/*
+ * Options for the note detection functions.  Use init_detection_options() to
+ * fill in the defaults (which give the same results as get_note_from_file())
+ * before changing any members, so that new members get sane values too.
+ *
+ * method        : how the pitch is estimated
+ * interpolation : how the frequency of the strongest peak is refined (only
+ *                 for SPECTRAL_PEAK_METHOD; YIN always refines its period)
+ * yin_threshold : the dip in YIN's normalized difference function that counts
+ *                 as a period (lower is stricter; see get_yin_frequency())
+ * stats         : if not NULL, the time and memory spent in each stage is added
+ *                 to it (see struct detection_stats)
+ * workspace     : if not NULL, the buffers to analyze in (see struct
+ *                 tonedef_workspace); otherwise every call allocates its own
+ * onset_gating  : if true, the note detector in stream.h only analyzes a
+ *                 window after an onset or when the signal has changed, and
+ *                 repeats the previous note otherwise (see onset.h); one-shot
+ *                 analysis ignores it
+ * max_freq      : if positive, the highest frequency (in Hz) worth detecting;
+ *                 one-shot analysis with SPECTRAL_PEAK_METHOD then low-pass
+ *                 filters the samples and lowers their sample rate as far as
+ *                 that allows (see get_decimation_factor() in dsp.h) before
+ *                 the FFT, which makes the FFT several times smaller at the
+ *                 same resolution in cents, and no peak above it is detected;
+ *                 YIN_METHOD and the note detector in stream.h ignore it
+ */
+struct detection_options
+{
+	enum pitch_method_t		method;
+	enum peak_interpolation_t	interpolation;
+	double				yin_threshold;
+	struct detection_stats *	stats;
+	struct tonedef_workspace *	workspace;
+	bool				onset_gating;
+	double				max_freq;
+};
+
 /* functions provided by this library */
+int		set_reference_pitch(double freq_of_a4);
+double		get_reference_pitch(void);
 double		get_freq(const struct note * const note);
 struct note	get_approx_note(double freq);
 struct note	get_exact_note(double freq);
+long		get_exact_notes(const double * const freqs, long num_freqs, struct note *notes);
 enum semitone_t	get_semitone(const char * const semitone);
 char		*get_semitone_str(enum semitone_t semitone, bool prefer_flat);
 enum semitone_t	get_fifth(enum semitone_t semitone);
@@ -97,5 +210,8 @@ double		*apply_hann_function(const double * const samples, long num_samples);
 int		split_stereo_channels(const double * const samples, long num_samples, double **chan1, double **chan2);
 fftw_complex	*get_fft(double *samples, long num_samples);
 struct note	get_note_from_file(const char * const filename, double secs_to_sample);
+void		init_detection_options(struct detection_options *options);
+struct note	get_note_from_file_with_options(const char * const filename, double secs_to_sample, const struct detection_options * const options);
+long		get_notes_from_file(const char * const filename, double secs_to_sample, struct note *notes, long max_notes);
 
 #endif
@@ -0,0 +1,497 @@
+/*
+ *  cqt.c
+ *
+ *  Copyright (C) 2016  Nathan Bossart
+ */
+
+#include <assert.h>
+#include "common.h"
+#include "cqt.h"
+#include "dsp.h"
+#include "fft.h"
+#include <fftw3.h>
+#include <math.h>
+#include <pthread.h>
+#include "source.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "utils.h"
+
+/*
+ * Spectral kernel values smaller than this (relative to the largest value of
+ * the same kernel) are dropped.  This is what makes the kernels sparse; the
+ * dropped values add up to well under a percent of each bin's magnitude.
+ */
+#define CQT_SPARSITY_THRESHOLD	0.005
+
+/*
+ * How far from its center frequency a spectral kernel is evaluated, in units
+ * of fft_size / length FFT bins (a quarter of the width of the main lobe of a
+ * Hann window of length samples).  The sidelobes are far below
+ * CQT_SPARSITY_THRESHOLD by then.
+ */
+#define CQT_KERNEL_REACH	16
+
+/* below this, sin(theta / 2) is taken to be zero */
+#define CQT_DIRICHLET_EPSILON	1e-12
+
+/*
+ * A constant-Q kernel, stored as a sparse matrix in compressed row format: the
+ * values of row (CQT bin) k are values[row_start[k]] up to (but not including)
+ * values[row_start[k + 1]], and columns holds the FFT bin of each value.
+ *
+ * sample_rate       : the sample rate the kernel was built for
+ * reference_pitch   : the frequency of A4 the kernel was built for
+ * bins_per_semitone : number of CQT bins per semitone
+ * num_bins          : number of CQT bins (rows)
+ * fft_size          : length of the frames the kernel applies to
+ * freqs             : center frequency of each CQT bin
+ * row_start         : num_bins + 1 offsets into columns and values
+ * columns           : FFT bin of each nonzero value
+ * values            : the nonzero values of the spectral kernels
+ */
+struct cqt_kernel
+{
+	int		sample_rate;
+	double		reference_pitch;
+	int		bins_per_semitone;
+	long		num_bins;
+	long		fft_size;
+	double *	freqs;
+	long *		row_start;
+	long *		columns;
+	fftw_complex *	values;
+};
+
+/*
+ * A node in the singly-linked list of cached kernels.
+ *
+ * kernel : the cached kernel
+ * next   : the next node in the list (NULL if we're at the end)
+ */
+struct cqt_kernel_node
+{
+	struct cqt_kernel *		kernel;
+	struct cqt_kernel_node *	next;
+};
+
+/* function prototypes for static functions */
+static struct cqt_kernel	*create_cqt_kernel(int sample_rate, int bins_per_semitone);
+static void			destroy_cqt_kernel(struct cqt_kernel *kernel);
+static double			get_hann_spectrum(double theta, long length);
+static double			get_dirichlet_kernel(double theta, long length);
+
+static struct cqt_kernel_node	*cqt_kernel_cache = NULL;
+static pthread_mutex_t		cqt_kernel_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * This function retrieves the constant-Q kernel for the given sample rate and
+ * number of bins per semitone, building it the first time.  Building a kernel
+ * means evaluating the spectrum of every bin's kernel, so it is only ever done
+ * once per (sample rate, bins per semitone, reference pitch); applying it is
+ * cheap.  The kernel belongs to the cache and must not be freed by the
+ * caller; it stays valid until
+ * clear_cqt_kernel_cache() is called.  This function may be called from any
+ * thread.
+ *
+ * Returns NULL for illegal arguments.
+ */
+const struct cqt_kernel *get_cqt_kernel(int sample_rate, int bins_per_semitone)
+{
+	struct cqt_kernel_node	*node;
+	double			reference_pitch;
+
+	if (0 >= sample_rate) {
+		fprintf(stderr, "sample rate must be positive\n");
+		return NULL;
+	}
+
+	if (1 > bins_per_semitone || CQT_MAX_BINS_PER_SEMITONE < bins_per_semitone) {
+		fprintf(stderr, "bins per semitone must be within 1 to %d\n", CQT_MAX_BINS_PER_SEMITONE);
+		return NULL;
+	}
+
+	reference_pitch = get_reference_pitch();
+	pthread_mutex_lock(&cqt_kernel_cache_lock);
+	for (node = cqt_kernel_cache; NULL != node; node = node->next) {
+		if (sample_rate == node->kernel->sample_rate && bins_per_semitone == node->kernel->bins_per_semitone &&
+		    reference_pitch == node->kernel->reference_pitch) {
+			pthread_mutex_unlock(&cqt_kernel_cache_lock);
+			return node->kernel;
+		}
+	}
+
+	node = (struct cqt_kernel_node *) MALLOC_SAFELY(sizeof(struct cqt_kernel_node));
+	node->kernel = create_cqt_kernel(sample_rate, bins_per_semitone);
+	node->next = cqt_kernel_cache;
+	cqt_kernel_cache = node;
+	pthread_mutex_unlock(&cqt_kernel_cache_lock);
+
+	return node->kernel;
+}
+
+/*
+ * This function frees every cached constant-Q kernel.  No kernel previously
+ * returned by the cache may be in use (by any thread) when this is called.
+ */
+void clear_cqt_kernel_cache(void)
+{
+	struct cqt_kernel_node *node;
+
+	pthread_mutex_lock(&cqt_kernel_cache_lock);
+	while (NULL != cqt_kernel_cache) {
+		node = cqt_kernel_cache;
+		cqt_kernel_cache = node->next;
+		destroy_cqt_kernel(node->kernel);
+		FREE_SAFELY(node);
+	}
+	pthread_mutex_unlock(&cqt_kernel_cache_lock);
+}
+
+/*
+ * This function returns the number of samples in the frames the kernel applies
+ * to (the length of the FFT), or -1 if kernel is NULL.  This is a power of 2
+ * long enough to hold the kernel of the lowest bin.
+ */
+long get_cqt_fft_size(const struct cqt_kernel * const kernel)
+{
+	if (NULL == kernel) {
+		return -1;
+	}
+
+	return kernel->fft_size;
+}
+
+/*
+ * This function returns the number of bins of the constant-Q transform, or -1
+ * if kernel is NULL.
+ */
+long get_cqt_num_bins(const struct cqt_kernel * const kernel)
+{
+	if (NULL == kernel) {
+		return -1;
+	}
+
+	return kernel->num_bins;
+}
+
+/*
+ * This function returns the number of bins per semitone of the kernel, or -1
+ * if kernel is NULL.
+ */
+int get_cqt_bins_per_semitone(const struct cqt_kernel * const kernel)
+{
+	if (NULL == kernel) {
+		return -1;
+	}
+
+	return kernel->bins_per_semitone;
+}
+
+/*
+ * This function returns the center frequency of the given bin.  Bin
+ * bins_per_semitone * n + bins_per_semitone / 2 is centered on the nth note
+ * from C0 (for odd bins_per_semitone, exactly).
+ *
+ * Returns INVALID_FREQUENCY for illegal arguments.
+ */
+double get_cqt_bin_freq(const struct cqt_kernel * const kernel, long bin)
+{
+	if (NULL == kernel || 0 > bin || kernel->num_bins <= bin) {
+		return INVALID_FREQUENCY;
+	}
+
+	return kernel->freqs[bin];
+}
+
+/*
+ * This function computes the constant-Q transform of a frame from its spectrum,
+ * which must be the FFT (as from get_r2c_plan()) of get_cqt_fft_size() samples
+ * with get_cqt_fft_size() / 2 + 1 bins.  The frame should not be windowed,
+ * since every kernel carries its own window.  The magnitude of each bin is
+ * stored in the magnitudes argument, which must have room for
+ * get_cqt_num_bins() values; a sinusoid centered on a bin gives its amplitude.
+ * Bins above the Nyquist frequency are always zero.
+ */
+void apply_cqt_kernel(const struct cqt_kernel * const kernel, const fftw_complex * const spectrum, double *magnitudes)
+{
+	long	k;
+	long	i;
+	double	re;
+	double	im;
+
+	assert(NULL != kernel);
+	assert(NULL != spectrum);
+	assert(NULL != magnitudes);
+
+	for (k = 0; k < kernel->num_bins; ++k) {
+		re = 0.0;
+		im = 0.0;
+		for (i = kernel->row_start[k]; i < kernel->row_start[k + 1]; ++i) {
+			re += spectrum[kernel->columns[i]][0] * kernel->values[i][0]
+				- spectrum[kernel->columns[i]][1] * kernel->values[i][1];
+			im += spectrum[kernel->columns[i]][0] * kernel->values[i][1]
+				+ spectrum[kernel->columns[i]][1] * kernel->values[i][0];
+		}
+		magnitudes[k] = sqrt(re * re + im * im);
+	}
+}
+
+/*
+ * This function computes the constant-Q transform of the first
+ * get_cqt_fft_size() frames of the sound file (mixed down to one channel, and
+ * padded with silence if the file is shorter).  The returned magnitudes are
+ * allocated on the heap, and their number is stored in num_bins.
+ *
+ * Returns NULL for illegal arguments or if the file could not be read.
+ */
+double *get_cqt_from_file(const char * const filename, int bins_per_semitone, long *num_bins)
+{
+	const struct cqt_kernel	*kernel;
+	struct tonedef_source	*source;
+	double			*frames;
+	double			*fft_in;
+	fftw_complex		*fft_out;
+	fftw_plan		plan;
+	double			*ret;
+	long			frames_read;
+	long			offset;
+
+	if (NULL == num_bins) {
+		fprintf(stderr, "num_bins cannot be NULL\n");
+		return NULL;
+	}
+	*num_bins = -1;
+
+	if (NULL == filename) {
+		fprintf(stderr, "filename is null\n");
+		return NULL;
+	}
+
+	if (NULL == (source = open_source(filename))) {
+		fprintf(stderr, "could not open sound file; does the file exist?\n");
+		return NULL;
+	}
+
+	if (NULL == (kernel = get_cqt_kernel(get_source_sample_rate(source), bins_per_semitone))) {
+		close_source(source);
+		return NULL;
+	}
+
+	frames = (double *) MALLOC_SAFELY(kernel->fft_size * get_source_num_channels(source) * sizeof(double));
+	fft_in = (double *) detect_oom(fftw_malloc(kernel->fft_size * sizeof(double)));
+	fft_out = (fftw_complex *) detect_oom(fftw_malloc((kernel->fft_size / 2 + 1) * sizeof(fftw_complex)));
+
+	/*
+	 * The kernels of the high bins are short and centered in the frame, so a
+	 * short file is centered in the frame too.
+	 */
+	frames_read = read_frames_from_source(source, frames, kernel->fft_size);
+	frames_read = MAX(0, frames_read);
+	offset = (kernel->fft_size - frames_read) / 2;
+	memset(fft_in, 0, kernel->fft_size * sizeof(double));
+	mix_down_and_window(frames, frames_read, get_source_num_channels(source), NULL, fft_in + offset);
+	close_source(source);
+	FREE_SAFELY(frames);
+
+	ret = NULL;
+	if (NULL != (plan = get_r2c_plan(kernel->fft_size, fft_in, fft_out))) {
+		fftw_execute_dft_r2c(plan, fft_in, fft_out);
+		ret = (double *) MALLOC_SAFELY(kernel->num_bins * sizeof(double));
+		apply_cqt_kernel(kernel, fft_out, ret);
+		*num_bins = kernel->num_bins;
+	}
+
+	fftw_free(fft_in);
+	fftw_free(fft_out);
+
+	return ret;
+}
+
+/*
+ * Static function that builds the sparse spectral kernels for the given sample
+ * rate and number of bins per semitone (the method of Brown and Puckette).
+ *
+ * Every bin gets a Hann-windowed complex sinusoid at its center frequency,
+ * Q cycles long (Q being the frequency over the bandwidth of one bin), centered
+ * in a frame of fft_size samples.  By Parseval's theorem, the inner product of
+ * a frame with that temporal kernel equals the inner product of their spectra
+ * over fft_size, and since the kernel's spectrum is concentrated in a few bins
+ * around its center frequency, the rest can be dropped.
+ *
+ * The Hann window is the sum of three complex sinusoids, so the spectrum of a
+ * kernel has a closed form (see get_hann_spectrum()).  That lets us evaluate
+ * it only near the center frequency, instead of taking an FFT of fft_size
+ * samples for every bin.
+ */
+static struct cqt_kernel *create_cqt_kernel(int sample_rate, int bins_per_semitone)
+{
+	struct cqt_kernel	*kernel;
+	struct note		lowest_note;
+	double			q;
+	double			lowest_freq;
+	double			omega;
+	double			theta;
+	double			scale;
+	double			maximum;
+	double			*amplitudes;
+	double			*phases;
+	long			capacity;
+	long			num_values;
+	long			length;
+	long			start;
+	long			center;
+	long			reach;
+	long			first;
+	long			last;
+	long			num_fft_bins;
+	long			k;
+	long			i;
+
+	kernel = (struct cqt_kernel *) MALLOC_SAFELY(sizeof(struct cqt_kernel));
+	kernel->sample_rate = sample_rate;
+	kernel->reference_pitch = get_reference_pitch();
+	kernel->bins_per_semitone = bins_per_semitone;
+	kernel->num_bins = NOTE_TABLE_SIZE * bins_per_semitone;
+
+	/* center the bins of each note on it */
+	lowest_note.semitone = C;
+	lowest_note.octave = OCTAVE_MIN;
+	lowest_note.cents = 0.0;
+	lowest_freq = get_freq(&lowest_note);
+	kernel->freqs = (double *) MALLOC_SAFELY(kernel->num_bins * sizeof(double));
+	for (k = 0; k < kernel->num_bins; ++k) {
+		kernel->freqs[k] = lowest_freq * pow(OCTAVE_JUST_INTERVAL,
+			(k - (bins_per_semitone - 1) / 2.0) / (bins_per_semitone * SEMITONES_PER_OCTAVE));
+	}
+
+	/* the lowest bin has the longest kernel, and the FFT must hold it */
+	q = 1.0 / (pow(OCTAVE_JUST_INTERVAL, 1.0 / (bins_per_semitone * SEMITONES_PER_OCTAVE)) - 1.0);
+	kernel->fft_size = 1;
+	while (kernel->fft_size < (long) ceil(q * sample_rate / kernel->freqs[0])) {
+		kernel->fft_size *= 2;
+	}
+	num_fft_bins = kernel->fft_size / 2 + 1;
+
+	amplitudes = (double *) MALLOC_SAFELY(num_fft_bins * sizeof(double));
+	phases = (double *) MALLOC_SAFELY(num_fft_bins * sizeof(double));
+
+	capacity = kernel->num_bins;
+	num_values = 0;
+	kernel->row_start = (long *) MALLOC_SAFELY((kernel->num_bins + 1) * sizeof(long));
+	kernel->columns = (long *) MALLOC_SAFELY(capacity * sizeof(long));
+	kernel->values = (fftw_complex *) MALLOC_SAFELY(capacity * sizeof(fftw_complex));
+
+	for (k = 0; k < kernel->num_bins; ++k) {
+		kernel->row_start[k] = num_values;
+
+		/* bins above the Nyquist frequency would only pick up aliases */
+		if (kernel->freqs[k] >= sample_rate / 2.0) {
+			continue;
+		}
+
+		/*
+		 * A full-scale sinusoid should come out with a magnitude of 1.0:
+		 * the Hann window averages 1/2, a real sinusoid only puts half of
+		 * its amplitude at positive frequencies, and Parseval's theorem
+		 * brings in a factor of 1 / fft_size.
+		 */
+		length = (long) ceil(q * sample_rate / kernel->freqs[k]);
+		start = (kernel->fft_size - length) / 2;
+		scale = 4.0 / length / kernel->fft_size;
+		omega = 2 * M_PI * kernel->freqs[k] / sample_rate;
+
+		/* only the bins near the center frequency are worth evaluating */
+		center = (long) round(omega * kernel->fft_size / (2 * M_PI));
+		reach = CQT_KERNEL_REACH * (kernel->fft_size / length + 1);
+		first = MAX(0, center - reach);
+		last = MIN(num_fft_bins - 1, center + reach);
+
+		maximum = 0.0;
+		for (i = first; i <= last; ++i) {
+			theta = omega - 2 * M_PI * i / kernel->fft_size;
+			amplitudes[i] = scale * get_hann_spectrum(theta, length);
+			phases[i] = theta * (length - 1) / 2.0 - 2 * M_PI * ((double) i * start / kernel->fft_size);
+			maximum = MAX(maximum, fabs(amplitudes[i]));
+		}
+
+		for (i = first; i <= last; ++i) {
+			if (fabs(amplitudes[i]) < CQT_SPARSITY_THRESHOLD * maximum) {
+				continue;
+			}
+
+			if (num_values == capacity) {
+				capacity *= 2;
+				kernel->columns = (long *) REALLOC_SAFELY(kernel->columns, capacity * sizeof(long));
+				kernel->values = (fftw_complex *) REALLOC_SAFELY(kernel->values, capacity * sizeof(fftw_complex));
+			}
+
+			/* conjugated, for the inner product */
+			kernel->columns[num_values] = i;
+			kernel->values[num_values][0] = amplitudes[i] * cos(phases[i]);
+			kernel->values[num_values][1] = -amplitudes[i] * sin(phases[i]);
+			++num_values;
+		}
+	}
+	kernel->row_start[kernel->num_bins] = num_values;
+
+	FREE_SAFELY(amplitudes);
+	FREE_SAFELY(phases);
+
+	return kernel;
+}
+
+/*
+ * Static function that evaluates the (real) amplitude of the spectrum of a Hann
+ * window of the given length at an angular frequency of theta radians per
+ * sample.  The window is 1/2 - 1/4 e^(i phi n) - 1/4 e^(-i phi n) with
+ * phi = 2 pi / (length - 1), and the sum of e^(i theta n) over the window is
+ * e^(i theta (length - 1) / 2) sin(length theta / 2) / sin(theta / 2).  The
+ * shifts by phi turn that common phase factor into -1, so the three terms add
+ * up with the phase factor left out (the caller accounts for it).
+ */
+static double get_hann_spectrum(double theta, long length)
+{
+	double	phi;
+
+	if (1 >= length) {
+		return 1.0;
+	}
+
+	phi = 2 * M_PI / (length - 1);
+
+	return 0.5 * get_dirichlet_kernel(theta, length)
+		+ 0.25 * get_dirichlet_kernel(theta + phi, length)
+		+ 0.25 * get_dirichlet_kernel(theta - phi, length);
+}
+
+/*
+ * Static function that evaluates sin(length theta / 2) / sin(theta / 2), which
+ * is length at theta = 0.  theta must be within -2 pi to 2 pi.
+ */
+static double get_dirichlet_kernel(double theta, long length)
+{
+	double	denominator;
+
+	denominator = sin(theta / 2);
+	if (CQT_DIRICHLET_EPSILON > fabs(denominator)) {
+		return length;
+	}
+
+	return sin(length * theta / 2) / denominator;
+}
+
+/*
+ * Static function that frees a kernel and everything in it.
+ */
+static void destroy_cqt_kernel(struct cqt_kernel *kernel)
+{
+	assert(NULL != kernel);
+
+	FREE_SAFELY(kernel->freqs);
+	FREE_SAFELY(kernel->row_start);
+	FREE_SAFELY(kernel->columns);
+	FREE_SAFELY(kernel->values);
+	FREE_SAFELY(kernel);
+}
@@ -0,0 +1,36 @@
+/*
+ *  cqt.h
+ *
+ *  Copyright (C) 2016  Nathan Bossart
+ */
+
+#ifndef CQT_H
+#define CQT_H
+
+#include "common.h"
+#include <fftw3.h>
+
+/* the most bins per semitone a constant-Q kernel can have */
+#define CQT_MAX_BINS_PER_SEMITONE	8
+
+/*
+ * The precomputed sparse spectral kernels of a constant-Q transform covering
+ * C0 to B8 with a given number of bins per semitone at a given sample rate.
+ * With the kernels, the constant-Q transform of a frame is one FFT of
+ * get_cqt_fft_size() samples plus a sparse matrix-vector product.
+ *
+ * Kernels are built on first use and cached (see get_cqt_kernel()), so the
+ * struct itself is opaque and owned by the cache.
+ */
+struct cqt_kernel;
+
+const struct cqt_kernel	*get_cqt_kernel(int sample_rate, int bins_per_semitone);
+void			clear_cqt_kernel_cache(void);
+long			get_cqt_fft_size(const struct cqt_kernel * const kernel);
+long			get_cqt_num_bins(const struct cqt_kernel * const kernel);
+double			get_cqt_bin_freq(const struct cqt_kernel * const kernel, long bin);
+int			get_cqt_bins_per_semitone(const struct cqt_kernel * const kernel);
+void			apply_cqt_kernel(const struct cqt_kernel * const kernel, const fftw_complex * const spectrum, double *magnitudes);
+double			*get_cqt_from_file(const char * const filename, int bins_per_semitone, long *num_bins);
+
+#endif
@@ -0,0 +1,1141 @@
+/*
+ *  dsp.c
+ *
+ *  Copyright (C) 2016  Nathan Bossart
+ */
+
+#include <assert.h>
+#include "common.h"
+#include "dsp.h"
+#include "fft.h"
+#include <fftw3.h>
+#include <math.h>
+#include <pthread.h>
+#include "source.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "utils.h"
+
+/*
+ * Taps on either side of the center of the halfband filters used by
+ * decimate().  The short one keeps 0.1 of the sample rate clear of aliases and
+ * the long one keeps 0.2 of it (DSP_DECIMATION_PASSBAND of the halved Nyquist
+ * frequency), both to about 65 dB.
+ */
+#define HALFBAND_SHORT_HALF_LENGTH	7
+#define HALFBAND_LONG_HALF_LENGTH	23
+
+/* shape of the Kaiser window that every decimation filter is designed with */
+#define DECIMATION_KAISER_BETA		6.0
+
+/*
+ * Outputs worked out at a time by each stage of decimate(), which must be at
+ * least the half-length of the longest filter.
+ */
+#define DECIMATION_BLOCK_SIZE		512
+
+/* partial sums worked out side by side by decimate_odd_in_place() */
+#define DECIMATION_LANES		4
+
+/*
+ * A node in the singly-linked list of cached window tables.
+ *
+ * num_samples  : length of the window
+ * window       : the window function evaluated at every sample
+ * window_float : single-precision copy of window (NULL until first needed)
+ * next         : the next node in the list (NULL if we're at the end)
+ */
+struct window_node
+{
+	long			num_samples;
+	double *		window;
+	float *			window_float;
+	struct window_node *	next;
+};
+
+/*
+ * A node in the singly-linked list of cached decimation filters.
+ *
+ * factor : the (odd) decimation factor the filter was designed for
+ * filter : the DSP_DECIMATION_TAPS_PER_PHASE * factor + 1 filter taps
+ * next   : the next node in the list (NULL if we're at the end)
+ */
+struct filter_node
+{
+	int			factor;
+	double *		filter;
+	struct filter_node *	next;
+};
+
+/* function prototypes for static functions */
+static struct window_node	*get_hann_window_node(long num_samples);
+static double			bessel_i0(double x);
+static void			design_decimation_filter(double cutoff, long half_length, double *filter);
+static void			build_halfband_filters(void);
+static const double		*get_decimation_filter(int factor);
+static long			halve_in_place(double *samples, long num_samples, const double * const filter, long half_length);
+static long			decimate_odd_in_place(double *samples, long num_samples, int factor, const double * const filter, long half_length);
+static long			get_peak_bin(long peak);
+
+static struct window_node	*hann_window_cache = NULL;
+static struct filter_node	*decimation_filter_cache = NULL;
+static pthread_mutex_t		window_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * The halfband filters that take out each factor of 2 (see decimate()): the
+ * short one for every halving but the last, and the long one for the last.
+ */
+static double			short_halfband_filter[2 * HALFBAND_SHORT_HALF_LENGTH + 1];
+static double			long_halfband_filter[2 * HALFBAND_LONG_HALF_LENGTH + 1];
+static pthread_once_t		halfband_filters_once = PTHREAD_ONCE_INIT;
+
+/*
+ * Static function for finding (or computing and caching) the Hann window table
+ * of the given length.  The window cache lock must be held by the caller.
+ */
+static struct window_node *get_hann_window_node(long num_samples)
+{
+	struct window_node	*node;
+	long			i;
+
+	assert(0 < num_samples);
+
+	for (node = hann_window_cache; NULL != node; node = node->next) {
+		if (num_samples == node->num_samples) {
+			return node;
+		}
+	}
+
+	node = (struct window_node *) MALLOC_SAFELY(sizeof(struct window_node));
+	node->num_samples = num_samples;
+	node->window_float = NULL;
+	node->window = (double *) MALLOC_SAFELY(num_samples * sizeof(double));
+	for (i = 0; i < num_samples; ++i) {
+		node->window[i] = 0.5 * (1 - cos((2 * M_PI * i) / (num_samples - 1)));
+	}
+
+	node->next = hann_window_cache;
+	hann_window_cache = node;
+
+	return node;
+}
+
+/*
+ * This function retrieves the Hann function of the given length as a table of
+ * coefficients.  Tables are computed on first use and cached, so the cos()
+ * calls are only ever paid once per window length.  The table belongs to the
+ * cache and must not be freed by the caller; it stays valid until
+ * clear_window_cache() is called.  This function may be called from any
+ * thread.
+ *
+ * Returns NULL for illegal arguments.
+ */
+const double *get_hann_window(long num_samples)
+{
+	const double *window;
+
+	if (0 >= num_samples) {
+		return NULL;
+	}
+
+	pthread_mutex_lock(&window_cache_lock);
+	window = get_hann_window_node(num_samples)->window;
+	pthread_mutex_unlock(&window_cache_lock);
+
+	return window;
+}
+
+/*
+ * The single-precision counterpart of get_hann_window().
+ */
+const float *get_hann_window_float(long num_samples)
+{
+	struct window_node	*node;
+	long			i;
+
+	if (0 >= num_samples) {
+		return NULL;
+	}
+
+	pthread_mutex_lock(&window_cache_lock);
+	node = get_hann_window_node(num_samples);
+	if (NULL == node->window_float) {
+		node->window_float = (float *) MALLOC_SAFELY(num_samples * sizeof(float));
+		for (i = 0; i < num_samples; ++i) {
+			node->window_float[i] = (float) node->window[i];
+		}
+	}
+	pthread_mutex_unlock(&window_cache_lock);
+
+	return node->window_float;
+}
+
+/*
+ * This function frees every cached window table and decimation filter.  Any
+ * table previously returned by get_hann_window() is invalid afterwards.
+ */
+void clear_window_cache(void)
+{
+	struct window_node *node;
+	struct filter_node *filter_node;
+
+	pthread_mutex_lock(&window_cache_lock);
+	while (NULL != hann_window_cache) {
+		node = hann_window_cache;
+		hann_window_cache = node->next;
+		FREE_SAFELY(node->window);
+		FREE_SAFELY(node->window_float);
+		FREE_SAFELY(node);
+	}
+	while (NULL != decimation_filter_cache) {
+		filter_node = decimation_filter_cache;
+		decimation_filter_cache = filter_node->next;
+		FREE_SAFELY(filter_node->filter);
+		FREE_SAFELY(filter_node);
+	}
+	pthread_mutex_unlock(&window_cache_lock);
+}
+
+/*
+ * This function is the pre-FFT kernel of the detection path.  In a single pass
+ * over the interleaved frames, it averages the channels of each frame into one
+ * mono sample and multiplies it by the matching window coefficient.  The out
+ * argument must have room for num_frames samples.  If window is NULL, the
+ * samples are only mixed down.
+ */
+void mix_down_and_window(const double * const frames, long num_frames, int num_channels, const double * const window, double *out)
+{
+	long	i;
+	int	j;
+	double	scale;
+	double	sum;
+
+	assert(NULL != frames);
+	assert(NULL != out);
+	assert(0 <= num_frames);
+	assert(0 < num_channels);
+
+	scale = 1.0 / num_channels;
+
+	/*
+	 * The branches are hoisted out of the loops so that each loop stays
+	 * simple enough for the compiler to vectorize.
+	 */
+	if (1 == num_channels && NULL == window) {
+		for (i = 0; i < num_frames; ++i) {
+			out[i] = frames[i];
+		}
+	} else if (1 == num_channels) {
+		for (i = 0; i < num_frames; ++i) {
+			out[i] = frames[i] * window[i];
+		}
+	} else if (NULL == window) {
+		for (i = 0; i < num_frames; ++i) {
+			sum = 0.0;
+			for (j = 0; j < num_channels; ++j) {
+				sum += frames[i * num_channels + j];
+			}
+			out[i] = sum * scale;
+		}
+	} else {
+		for (i = 0; i < num_frames; ++i) {
+			sum = 0.0;
+			for (j = 0; j < num_channels; ++j) {
+				sum += frames[i * num_channels + j];
+			}
+			out[i] = sum * scale * window[i];
+		}
+	}
+}
+
+/*
+ * This function is the pre-FFT kernel for memory-mapped frames.  It works like
+ * mix_down_and_window(), except that the samples are converted from their
+ * encoding to double in the same pass, so the frames never need to be copied
+ * out of the mapping first.  The out argument must have room for num_frames
+ * samples.  If window is NULL, the samples are only mixed down.
+ */
+void mix_down_and_window_encoded(const unsigned char * const frames, enum sample_encoding_t encoding, long num_frames, int num_channels, const double * const window, double *out)
+{
+	long	i;
+	int	j;
+	long	sample_size;
+	double	scale;
+	double	sum;
+
+	assert(NULL != frames);
+	assert(NULL != out);
+	assert(0 <= num_frames);
+	assert(0 < num_channels);
+
+	sample_size = get_encoded_sample_size(encoding);
+	scale = 1.0 / num_channels;
+
+	for (i = 0; i < num_frames; ++i) {
+		sum = 0.0;
+		for (j = 0; j < num_channels; ++j) {
+			sum += decode_encoded_sample(frames + (i * num_channels + j) * sample_size, encoding);
+		}
+		out[i] = (1 == num_channels) ? sum : sum * scale;
+		if (NULL != window) {
+			out[i] *= window[i];
+		}
+	}
+}
+
+/*
+ * This function returns the largest factor the sample rate can be divided by
+ * while still holding every frequency up to max_freq, with room for the
+ * transition band of the decimation filter (see DSP_DECIMATION_PASSBAND).  The
+ * factor always divides the sample rate evenly, so the decimated sample rate
+ * is a whole number, and is at most DSP_MAX_DECIMATION_FACTOR; 1 means that
+ * decimating would lose part of the range.
+ *
+ * Returns -1 for illegal arguments.
+ */
+int get_decimation_factor(int sample_rate, double max_freq)
+{
+	double	limit;
+	int	factor;
+
+	if (0 >= sample_rate || 0.0 >= max_freq) {
+		return -1;
+	}
+
+	limit = floor(DSP_DECIMATION_PASSBAND * sample_rate / (2 * max_freq));
+	factor = (int) MAX(1.0, MIN(DSP_MAX_DECIMATION_FACTOR, limit));
+	while (0 != sample_rate % factor) {
+		--factor;
+	}
+
+	return factor;
+}
+
+/*
+ * Static function for the zeroth-order modified Bessel function of the first
+ * kind, which the Kaiser window is made of.  The series converges quickly for
+ * the small arguments used here.
+ */
+static double bessel_i0(double x)
+{
+	double	sum;
+	double	term;
+	int	k;
+
+	sum = 1.0;
+	term = 1.0;
+	for (k = 1; term > 1e-17 * sum; ++k) {
+		term *= (x / (2 * k)) * (x / (2 * k));
+		sum += term;
+	}
+
+	return sum;
+}
+
+/*
+ * Static function that designs a low-pass filter with the given cutoff (as a
+ * fraction of the sample rate) and half_length taps on either side of the
+ * center: a sinc windowed by a Kaiser window (see DECIMATION_KAISER_BETA).  The
+ * filter argument must have room for 2 * half_length + 1 taps, which are scaled
+ * to a gain of exactly 1.0 at DC.
+ */
+static void design_decimation_filter(double cutoff, long half_length, double *filter)
+{
+	double	x;
+	double	sum;
+	long	i;
+
+	assert(0.0 < cutoff && 0 < half_length);
+
+	sum = 0.0;
+	for (i = 0; i <= 2 * half_length; ++i) {
+		x = 2 * cutoff * (i - half_length);
+		filter[i] = (i == half_length) ? 1.0 : sin(M_PI * x) / (M_PI * x);
+		x = (double) (i - half_length) / (half_length + 1);
+		filter[i] *= bessel_i0(DECIMATION_KAISER_BETA * sqrt(1.0 - x * x)) / bessel_i0(DECIMATION_KAISER_BETA);
+		sum += filter[i];
+	}
+	for (i = 0; i <= 2 * half_length; ++i) {
+		filter[i] /= sum;
+	}
+}
+
+/*
+ * Static function that designs both halfband filters.  With the cutoff at half
+ * the Nyquist frequency, every tap an even (non-zero) distance from the center
+ * is zero, and halve_in_place() skips them.
+ */
+static void build_halfband_filters(void)
+{
+	design_decimation_filter(0.25, HALFBAND_SHORT_HALF_LENGTH, short_halfband_filter);
+	design_decimation_filter(0.25, HALFBAND_LONG_HALF_LENGTH, long_halfband_filter);
+}
+
+/*
+ * Static function for finding (or designing and caching) the low-pass filter
+ * for decimating by the given odd factor, with its cutoff at the decimated
+ * Nyquist frequency and DSP_DECIMATION_TAPS_PER_PHASE taps for each of the
+ * factor phases (plus one, so it is symmetric).
+ */
+static const double *get_decimation_filter(int factor)
+{
+	struct filter_node	*node;
+	long			half_length;
+
+	assert(0 < factor);
+
+	pthread_mutex_lock(&window_cache_lock);
+	for (node = decimation_filter_cache; NULL != node; node = node->next) {
+		if (factor == node->factor) {
+			pthread_mutex_unlock(&window_cache_lock);
+			return node->filter;
+		}
+	}
+
+	half_length = DSP_DECIMATION_TAPS_PER_PHASE * factor / 2;
+
+	node = (struct filter_node *) MALLOC_SAFELY(sizeof(struct filter_node));
+	node->factor = factor;
+	node->filter = (double *) MALLOC_SAFELY((2 * half_length + 1) * sizeof(double));
+	design_decimation_filter(0.5 / factor, half_length, node->filter);
+
+	node->next = decimation_filter_cache;
+	decimation_filter_cache = node;
+	pthread_mutex_unlock(&window_cache_lock);
+
+	return node->filter;
+}
+
+/*
+ * Static function that filters the samples with a halfband filter and keeps
+ * every other one, writing them over the start of the samples.  Returns the
+ * number of samples kept.
+ *
+ * Apart from the center tap, a halfband filter only ever touches the samples
+ * an odd distance from the sample being kept, so the outputs are worked out
+ * DECIMATION_BLOCK_SIZE at a time from a contiguous copy of just those samples
+ * (zero beyond either end).  Each pair of taps is then a plain multiply-add
+ * over the whole block, with no reduction and no edge cases, that the compiler
+ * can vectorize.  A block is only copied over the samples once it is done, and
+ * no later block reads that far back as long as the block is longer than the
+ * filter.
+ */
+static long halve_in_place(double *samples, long num_samples, const double * const filter, long half_length)
+{
+	double		block[DECIMATION_BLOCK_SIZE];
+	double		odd[DECIMATION_BLOCK_SIZE + HALFBAND_LONG_HALF_LENGTH + 1];
+	const double	*before;
+	const double	*after;
+	double		tap;
+	long		num_out;
+	long		margin;
+	long		start;
+	long		length;
+	long		source;
+	long		i;
+	long		m;
+
+	assert(NULL != samples && NULL != filter);
+	assert(HALFBAND_LONG_HALF_LENGTH >= half_length && 1 == half_length % 2);
+
+	/* odd[margin + i] is the sample just after the one kept for block[i] */
+	margin = (half_length + 1) / 2;
+
+	num_out = num_samples / 2;
+	for (start = 0; start < num_out; start += length) {
+		length = MIN(DECIMATION_BLOCK_SIZE, num_out - start);
+		for (i = 0; i < DECIMATION_BLOCK_SIZE + 2 * margin; ++i) {
+			source = 2 * (start + i - margin) + 1;
+			odd[i] = (0 <= source && num_samples > source) ? samples[source] : 0.0;
+		}
+		for (i = 0; i < DECIMATION_BLOCK_SIZE; ++i) {
+			block[i] = (length > i) ? filter[half_length] * samples[2 * (start + i)] : 0.0;
+		}
+
+		/* the samples m before and after the one kept for block[i] */
+		for (m = 1; m <= half_length; m += 2) {
+			tap = filter[half_length + m];
+			before = odd + margin - (m + 1) / 2;
+			after = odd + margin + (m - 1) / 2;
+			for (i = 0; i < DECIMATION_BLOCK_SIZE; ++i) {
+				block[i] += tap * (before[i] + after[i]);
+			}
+		}
+
+		memcpy(samples + start, block, length * sizeof(double));
+	}
+
+	return num_out;
+}
+
+/*
+ * Static function that filters the samples with the given filter and keeps
+ * every factor-th one (the polyphase form of a decimator, since only the
+ * samples that are kept are ever filtered), writing them over the start of the
+ * samples.  Returns the number of samples kept.
+ *
+ * Each output is a dot product, which the compiler can't vectorize as it
+ * stands without changing the order of the additions, so it is split into
+ * DECIMATION_LANES partial sums over consecutive taps that can be worked out
+ * side by side.  As in halve_in_place(), the outputs go through a block so
+ * that they can be written over the samples.
+ */
+static long decimate_odd_in_place(double *samples, long num_samples, int factor, const double * const filter, long half_length)
+{
+	double		block[DECIMATION_BLOCK_SIZE];
+	double		sums[DECIMATION_LANES];
+	const double	*x;
+	long		num_out;
+	long		start;
+	long		length;
+	long		center;
+	long		first;
+	long		last;
+	long		i;
+	long		k;
+	int		j;
+
+	assert(NULL != samples && NULL != filter);
+	assert(1 < factor && DECIMATION_BLOCK_SIZE >= half_length);
+
+	num_out = num_samples / factor;
+	for (start = 0; start < num_out; start += length) {
+		length = MIN(DECIMATION_BLOCK_SIZE, num_out - start);
+		for (i = 0; i < length; ++i) {
+
+			/* the taps that fall outside the samples are clipped off */
+			center = (start + i) * factor;
+			x = samples + center - half_length;
+			first = MAX(0, half_length - center);
+			last = MIN(2 * half_length + 1, num_samples - center + half_length);
+
+			for (j = 0; j < DECIMATION_LANES; ++j) {
+				sums[j] = 0.0;
+			}
+			for (k = first; k + DECIMATION_LANES <= last; k += DECIMATION_LANES) {
+				for (j = 0; j < DECIMATION_LANES; ++j) {
+					sums[j] += filter[k + j] * x[k + j];
+				}
+			}
+			for (; k < last; ++k) {
+				sums[0] += filter[k] * x[k];
+			}
+
+			block[i] = 0.0;
+			for (j = 0; j < DECIMATION_LANES; ++j) {
+				block[i] += sums[j];
+			}
+		}
+
+		memcpy(samples + start, block, length * sizeof(double));
+	}
+
+	return num_out;
+}
+
+/*
+ * This function low-pass filters the mono samples and keeps every factor-th
+ * one, lowering the sample rate by that factor without letting anything above
+ * the new Nyquist frequency alias back into the spectrum.
+ *
+ * Every factor of 2 is taken out first by a halfband filter, half of whose taps
+ * are zero.  All but the last of these only have to keep the (much lower)
+ * final band clear of aliases, so they are very short; only the last, which
+ * protects everything up to DSP_DECIMATION_PASSBAND of the decimated Nyquist
+ * frequency, is longer.  Whatever odd factor is left is then taken out at the
+ * reduced rate by a single polyphase filter with DSP_DECIMATION_TAPS_PER_PHASE
+ * taps per phase.  The filters are centered on each kept sample, so there is
+ * no delay, and samples beyond either end are taken to be zero.
+ *
+ * The samples are used as scratch space for the intermediate rates, so they
+ * are overwritten.  The out argument must have room for num_samples / factor
+ * samples, and may be samples itself.  Nothing is allocated, except for
+ * designing the filter of an odd factor the first time it is used.
+ *
+ * Returns the number of samples stored, or -1 for illegal arguments.
+ */
+long decimate(double *samples, long num_samples, int factor, double *out)
+{
+	long	num_out;
+
+	if (NULL == samples || NULL == out || 0 > num_samples || 0 >= factor) {
+		return -1;
+	}
+
+	pthread_once(&halfband_filters_once, build_halfband_filters);
+
+	num_out = num_samples / factor;
+	while (0 == factor % 2) {
+		if (2 == factor) {
+			num_samples = halve_in_place(samples, num_samples, long_halfband_filter, HALFBAND_LONG_HALF_LENGTH);
+		} else {
+			num_samples = halve_in_place(samples, num_samples, short_halfband_filter, HALFBAND_SHORT_HALF_LENGTH);
+		}
+		factor /= 2;
+	}
+	if (1 < factor) {
+		num_samples = decimate_odd_in_place(samples, num_samples, factor, get_decimation_filter(factor),
+			DSP_DECIMATION_TAPS_PER_PHASE * factor / 2);
+	}
+
+	assert(num_out == num_samples);
+	memmove(out, samples, num_out * sizeof(double));
+
+	return num_out;
+}
+
+/*
+ * This function is the post-FFT kernel of the detection path.  In a single pass
+ * over the spectrum, it computes the power (squared magnitude) of each bin and
+ * keeps track of the strongest one.  Comparing powers picks the same bin as
+ * comparing magnitudes without a sqrt() per bin.  The power of the strongest
+ * bin is stored in peak_power if it isn't NULL.
+ *
+ * Returns the index of the strongest bin, or -1 for illegal arguments.
+ */
+long get_peak_of_spectrum(const fftw_complex * const spectrum, long num_bins, double *peak_power)
+{
+	long	i;
+	long	maximum_index;
+	double	maximum;
+	double	power;
+
+	if (NULL == spectrum || 0 >= num_bins) {
+		return -1;
+	}
+
+	maximum_index = 0;
+	maximum = spectrum[0][0] * spectrum[0][0] + spectrum[0][1] * spectrum[0][1];
+	for (i = 1; i < num_bins; ++i) {
+		power = spectrum[i][0] * spectrum[i][0] + spectrum[i][1] * spectrum[i][1];
+		if (power > maximum) {
+			maximum = power;
+			maximum_index = i;
+		}
+	}
+
+	if (NULL != peak_power) {
+		*peak_power = maximum;
+	}
+
+	return maximum_index;
+}
+
+/*
+ * This function refines the position of a peak (usually the one found by
+ * get_peak_of_spectrum()) using its two neighboring bins.  See the definition
+ * of enum peak_interpolation_t for the methods.  PHASE_VOCODER_INTERPOLATION
+ * needs a second frame, so it is treated as GAUSSIAN_INTERPOLATION here (see
+ * interpolate_peak_by_phase()).
+ *
+ * Returns the (fractional) bin of the peak, which is within half a bin of the
+ * peak argument.  If the peak is at either end of the spectrum, or the method
+ * doesn't apply, the peak argument itself is returned.
+ */
+double interpolate_peak(const fftw_complex * const spectrum, long num_bins, long peak, enum peak_interpolation_t interpolation)
+{
+	double	a;
+	double	b;
+	double	c;
+	double	denominator;
+	double	delta;
+
+	if (NULL == spectrum || 0 >= peak || num_bins - 1 <= peak) {
+		return peak;
+	}
+
+	a = hypot(spectrum[peak - 1][0], spectrum[peak - 1][1]);
+	b = hypot(spectrum[peak][0], spectrum[peak][1]);
+	c = hypot(spectrum[peak + 1][0], spectrum[peak + 1][1]);
+
+	switch(interpolation) {
+
+	case(QUADRATIC_INTERPOLATION):
+		break;
+
+	case(GAUSSIAN_INTERPOLATION):
+	case(PHASE_VOCODER_INTERPOLATION):
+		/* the logarithm of a silent bin is of no use to anybody */
+		if (0.0 >= a || 0.0 >= b || 0.0 >= c) {
+			return peak;
+		}
+		a = log(a);
+		b = log(b);
+		c = log(c);
+		break;
+
+	default:
+		return peak;
+	}
+
+	/*
+	 * The vertex of the parabola through (-1, a), (0, b), and (1, c).  It
+	 * can only stray further than half a bin if the peak isn't really a
+	 * local maximum, in which case we don't trust it.
+	 */
+	denominator = a - 2 * b + c;
+	if (0.0 <= denominator) {
+		return peak;
+	}
+
+	delta = 0.5 * (a - c) / denominator;
+	if (0.5 < fabs(delta)) {
+		return peak;
+	}
+
+	return peak + delta;
+}
+
+/*
+ * This function refines the position of a peak from the advance of its phase
+ * between two frames that are hop_size samples apart (the "phase vocoder"
+ * method).  A sinusoid centered on bin k advances by 2 * pi * k * hop_size /
+ * window_size radians per hop, so the deviation from that tells us how far the
+ * true frequency is from the center of the bin.  This is only unambiguous if
+ * hop_size is at most half of window_size.
+ *
+ * Returns the (fractional) bin of the peak, or the peak argument itself if the
+ * hop is too large or an argument is illegal.
+ */
+double interpolate_peak_by_phase(const fftw_complex * const previous, const fftw_complex * const current, long peak, long window_size, long hop_size)
+{
+	double	expected;
+	double	deviation;
+
+	if (NULL == previous || NULL == current || 0 > peak || 0 >= hop_size || window_size < 2 * hop_size) {
+		return peak;
+	}
+
+	expected = 2 * M_PI * peak * hop_size / (double) window_size;
+	deviation = atan2(current[peak][1], current[peak][0])
+		- atan2(previous[peak][1], previous[peak][0]) - expected;
+
+	/* wrap the deviation into -pi to pi */
+	deviation -= 2 * M_PI * floor((deviation + M_PI) / (2 * M_PI));
+
+	return peak + deviation * window_size / (2 * M_PI * hop_size);
+}
+
+/*
+ * This function finds the most prominent peaks of the spectrum.  A peak is a
+ * bin whose power is greater than the power of both of its neighbors, and it
+ * is only kept if its power is at least min_relative_power times the power of
+ * the strongest peak (e.g. 0.01 keeps peaks within 20 dB of the strongest).
+ * Up to max_peaks bin indices are stored in peaks, strongest first.  Bins
+ * below min_bin (e.g. DC) are ignored.  No memory is allocated.
+ *
+ * Returns the number of peaks stored, or -1 for illegal arguments.
+ */
+long get_peaks_of_spectrum(const fftw_complex * const spectrum, long num_bins, long min_bin, double min_relative_power, long *peaks, long max_peaks)
+{
+	long	i;
+	long	j;
+	long	num_peaks;
+	double	powers[3];
+	double	peak_powers[DSP_MAX_PEAKS];
+
+	if (NULL == spectrum || NULL == peaks || 0 >= num_bins || 0 > min_bin) {
+		return -1;
+	}
+
+	if (0 >= max_peaks || DSP_MAX_PEAKS < max_peaks) {
+		fprintf(stderr, "max_peaks must be within 1 to %d\n", DSP_MAX_PEAKS);
+		return -1;
+	}
+
+	/*
+	 * Slide a window of three powers over the spectrum, inserting each local
+	 * maximum into the peaks array (which is kept sorted by power).
+	 */
+	num_peaks = 0;
+	min_bin = MAX(min_bin, 1);
+	for (i = min_bin; i < num_bins - 1; ++i) {
+
+		if (i == min_bin) {
+			for (j = 0; j < 3; ++j) {
+				powers[j] = spectrum[i - 1 + j][0] * spectrum[i - 1 + j][0]
+					+ spectrum[i - 1 + j][1] * spectrum[i - 1 + j][1];
+			}
+		} else {
+			powers[0] = powers[1];
+			powers[1] = powers[2];
+			powers[2] = spectrum[i + 1][0] * spectrum[i + 1][0]
+				+ spectrum[i + 1][1] * spectrum[i + 1][1];
+		}
+
+		if (powers[1] <= powers[0] || powers[1] <= powers[2]) {
+			continue;
+		}
+
+		/* skip it if it's weaker than everything we already have */
+		if (num_peaks == max_peaks && powers[1] <= peak_powers[num_peaks - 1]) {
+			continue;
+		}
+
+		if (num_peaks < max_peaks) {
+			++num_peaks;
+		}
+
+		for (j = num_peaks - 1; 0 < j && peak_powers[j - 1] < powers[1]; --j) {
+			peaks[j] = peaks[j - 1];
+			peak_powers[j] = peak_powers[j - 1];
+		}
+		peaks[j] = i;
+		peak_powers[j] = powers[1];
+	}
+
+	/* drop everything that's too quiet compared to the strongest peak */
+	while (0 < num_peaks && peak_powers[num_peaks - 1] < min_relative_power * peak_powers[0]) {
+		--num_peaks;
+	}
+
+	return num_peaks;
+}
+
+/*
+ * Static function that returns the bin of a peak in the array being worked on
+ * by remove_harmonic_peaks(), which marks the harmonics it finds by storing
+ * -1 - bin (always negative, even for bin 0) in their place.
+ */
+static long get_peak_bin(long peak)
+{
+	return (0 <= peak) ? peak : -1 - peak;
+}
+
+/*
+ * This function removes the peaks (bin indices, strongest first) that look
+ * like harmonics of other peaks, leaving (ideally) only the fundamentals.  A
+ * peak is considered a harmonic if its bin is within tolerance_cents or within
+ * tolerance_bins bins of an integer multiple (2x, 3x, ...) of the bin of a
+ * lower peak.  The bin tolerance covers the quantization of low notes, whose
+ * peaks can be tens of cents away from the exact multiple (e.g. bins 65 and
+ * 131).
+ *
+ * If powers isn't NULL, it holds the power of each peak, and a lower peak only
+ * counts as a fundamental if its power is at least min_relative_power times
+ * that of the higher one (e.g. 0.1 for within 10 dB), so that a weak peak
+ * (mains hum, or leakage at the bottom of the spectrum) can't take out the
+ * genuine notes that happen to be near its multiples.
+ *
+ * Every peak is checked against all of the others before any are removed, so
+ * the result doesn't depend on their order.  The relative order of the
+ * remaining peaks is preserved, and powers (if not NULL) is compacted along
+ * with them.
+ *
+ * Returns the number of peaks that remain.
+ */
+long remove_harmonic_peaks(long *peaks, double *powers, long num_peaks, double tolerance_cents, double tolerance_bins, double min_relative_power)
+{
+	long	i;
+	long	j;
+	long	kept;
+	long	bin;
+	long	lower;
+	double	ratio;
+	double	harmonic;
+	bool	is_harmonic;
+
+	if (NULL == peaks || 0 >= num_peaks) {
+		return 0;
+	}
+
+	for (i = 0; i < num_peaks; ++i) {
+		bin = get_peak_bin(peaks[i]);
+
+		is_harmonic = false;
+		for (j = 0; j < num_peaks && !is_harmonic; ++j) {
+			lower = get_peak_bin(peaks[j]);
+			if (0 >= lower || lower >= bin) {
+				continue;
+			}
+
+			if (NULL != powers && powers[j] < min_relative_power * powers[i]) {
+				continue;
+			}
+
+			ratio = bin / (double) lower;
+			harmonic = round(ratio);
+			is_harmonic = (2.0 <= harmonic
+				&& (fabs(bin - harmonic * lower) <= tolerance_bins
+				 || fabs(SEMITONE_INTERVAL_CENTS * SEMITONES_PER_OCTAVE * log2(ratio / harmonic)) <= tolerance_cents));
+		}
+
+		if (is_harmonic) {
+			peaks[i] = -1 - bin;
+		}
+	}
+
+	kept = 0;
+	for (i = 0; i < num_peaks; ++i) {
+		if (0 <= peaks[i]) {
+			if (NULL != powers) {
+				powers[kept] = powers[i];
+			}
+			peaks[kept++] = peaks[i];
+		}
+	}
+
+	return kept;
+}
+
+/*
+ * This function estimates the fundamental frequency of (unwindowed, mono)
+ * samples with the YIN algorithm (de Cheveigné and Kawahara, 2002).  YIN looks
+ * for the smallest lag tau at which the signal best matches itself, using the
+ * difference function
+ *
+ *	d(tau) = sum over j < W of (x[j] - x[j + tau])^2
+ *	       = e(0) + e(tau) - 2 * r(tau)
+ *
+ * where W = num_samples - max_tau, e(tau) is the energy of x[tau..tau + W),
+ * and r(tau) is the cross-correlation of x[0..W) with x.  The energies are a
+ * sliding sum and r(tau) comes from two forward FFTs and an inverse one, so
+ * the whole thing is O(N log N) instead of the O(N * tau) of the direct sums.
+ *
+ * The difference function is then normalized by its cumulative mean, and the
+ * first dip below threshold (or the deepest dip, if none are below it) gives
+ * the period, which is refined with a parabola through its neighbors.
+ *
+ * Lags are searched for notes from C0 to B8 (+/- 50 cents), but the longest
+ * lag is limited to half of the samples, so the window must hold two periods
+ * of the lowest note to be found.
+ *
+ * Returns the frequency in hertz, or INVALID_FREQUENCY if no period could be
+ * found or an argument is illegal.
+ */
+double get_yin_frequency(const double * const samples, long num_samples, int sample_rate, double threshold)
+{
+	double		ret;
+	double *	diff;
+	fftw_complex *	head_spectrum;
+	fftw_complex *	spectrum;
+
+	if (NULL == samples || 0 >= num_samples) {
+		return INVALID_FREQUENCY;
+	}
+
+	diff = (double *) detect_oom(fftw_malloc(num_samples * sizeof(double)));
+	head_spectrum = (fftw_complex *) detect_oom(fftw_malloc((num_samples / 2 + 1) * sizeof(fftw_complex)));
+	spectrum = (fftw_complex *) detect_oom(fftw_malloc((num_samples / 2 + 1) * sizeof(fftw_complex)));
+
+	ret = get_yin_frequency_with_scratch(samples, num_samples, sample_rate, threshold, diff, head_spectrum, spectrum);
+
+	fftw_free(diff);
+	fftw_free(head_spectrum);
+	fftw_free(spectrum);
+
+	return ret;
+}
+
+/*
+ * This function is get_yin_frequency() with buffers supplied by the caller, so
+ * that it doesn't allocate.  diff must hold num_samples samples and
+ * head_spectrum and spectrum must hold num_samples / 2 + 1 bins each; they
+ * should come from fftw_malloc() so that the transforms are aligned.  None of
+ * them may overlap samples.
+ *
+ * Returns the frequency in hertz, or INVALID_FREQUENCY if no period could be
+ * found or an argument is illegal.
+ */
+double get_yin_frequency_with_scratch(const double * const samples, long num_samples, int sample_rate, double threshold, double *diff, fftw_complex *head_spectrum, fftw_complex *spectrum)
+{
+	struct note	lowest_note;
+	struct note	highest_note;
+	long		min_tau;
+	long		max_tau;
+	long		width;
+	long		tau;
+	long		best_tau;
+	long		i;
+	double		energy_0;
+	double		energy_tau;
+	double		running_sum;
+	double		a;
+	double		b;
+	double		c;
+	double		denominator;
+	double		period;
+	fftw_plan	forward;
+	fftw_plan	inverse;
+
+	if (NULL == samples || NULL == diff || NULL == head_spectrum || NULL == spectrum
+			|| 0 >= sample_rate || 0.0 >= threshold) {
+		return INVALID_FREQUENCY;
+	}
+
+	lowest_note.semitone	= C;
+	lowest_note.octave	= OCTAVE_MIN;
+	lowest_note.cents	= -(SEMITONE_INTERVAL_CENTS / 2.0);
+	max_tau = MIN((long) (sample_rate / get_freq(&lowest_note)) + 1, num_samples / 2);
+
+	highest_note.semitone	= B;
+	highest_note.octave	= OCTAVE_MAX;
+	highest_note.cents	= SEMITONE_INTERVAL_CENTS / 2.0;
+	min_tau = MAX((long) (sample_rate / get_freq(&highest_note)), 2);
+
+	/* we need a lag on either side of the period to refine it */
+	if (min_tau + 1 >= max_tau) {
+		return INVALID_FREQUENCY;
+	}
+	width = num_samples - max_tau;
+
+	forward = get_r2c_plan(num_samples, diff, spectrum);
+	inverse = get_c2r_plan(num_samples, spectrum, diff);
+	if (NULL == forward || NULL == inverse) {
+		return INVALID_FREQUENCY;
+	}
+
+	/*
+	 * r(tau) = sum over j < W of x[j] * x[j + tau].  Since j + tau never
+	 * exceeds num_samples - 1 for tau <= max_tau, a transform of length
+	 * num_samples is enough to keep the circular correlation from wrapping.
+	 */
+	memcpy(diff, samples, width * sizeof(double));
+	memset(diff + width, 0, (num_samples - width) * sizeof(double));
+	fftw_execute_dft_r2c(forward, diff, head_spectrum);
+	memcpy(diff, samples, num_samples * sizeof(double));
+	fftw_execute_dft_r2c(forward, diff, spectrum);
+	for (i = 0; i < num_samples / 2 + 1; ++i) {
+		a = head_spectrum[i][0] * spectrum[i][0] + head_spectrum[i][1] * spectrum[i][1];
+		b = head_spectrum[i][0] * spectrum[i][1] - head_spectrum[i][1] * spectrum[i][0];
+		spectrum[i][0] = a;
+		spectrum[i][1] = b;
+	}
+	fftw_execute_dft_c2r(inverse, spectrum, diff);
+
+	/* the difference function, normalized by its cumulative mean */
+	energy_0 = 0.0;
+	for (i = 0; i < width; ++i) {
+		energy_0 += samples[i] * samples[i];
+	}
+	energy_tau = energy_0;
+	running_sum = 0.0;
+	diff[0] = 1.0;
+	for (tau = 1; tau <= max_tau; ++tau) {
+		energy_tau += samples[tau + width - 1] * samples[tau + width - 1]
+			- samples[tau - 1] * samples[tau - 1];
+
+		/* the inverse FFT is unnormalized */
+		diff[tau] = MAX(energy_0 + energy_tau - 2.0 * diff[tau] / num_samples, 0.0);
+		running_sum += diff[tau];
+		diff[tau] = (0.0 < running_sum) ? diff[tau] * tau / running_sum : 1.0;
+	}
+
+	/* the first dip below the threshold, followed down to its bottom */
+	best_tau = -1;
+	for (tau = min_tau; tau < max_tau; ++tau) {
+		if (diff[tau] < threshold) {
+			while (tau + 1 < max_tau && diff[tau + 1] < diff[tau]) {
+				++tau;
+			}
+			best_tau = tau;
+			break;
+		}
+	}
+
+	/*
+	 * Otherwise, the deepest dip will have to do.  If it's at either end of
+	 * the range, though, it's just the slope of something out of range.
+	 */
+	if (-1 == best_tau) {
+		best_tau = min_tau;
+		for (tau = min_tau + 1; tau < max_tau; ++tau) {
+			if (diff[tau] < diff[best_tau]) {
+				best_tau = tau;
+			}
+		}
+
+		if (min_tau == best_tau || max_tau - 1 == best_tau || 1.0 <= diff[best_tau]) {
+			return INVALID_FREQUENCY;
+		}
+	}
+
+	a = diff[best_tau - 1];
+	b = diff[best_tau];
+	c = diff[best_tau + 1];
+
+	period = best_tau;
+	denominator = a - 2 * b + c;
+	if (0.0 < denominator) {
+		period += MAX(-0.5, MIN(0.5, 0.5 * (a - c) / denominator));
+	}
+
+	return sample_rate / period;
+}
+
+/*
+ * The single-precision counterpart of mix_down_and_window().
+ */
+void mix_down_and_window_float(const float * const frames, long num_frames, int num_channels, const float * const window, float *out)
+{
+	long	i;
+	int	j;
+	float	scale;
+	float	sum;
+
+	assert(NULL != frames);
+	assert(NULL != out);
+	assert(0 <= num_frames);
+	assert(0 < num_channels);
+
+	scale = 1.0f / num_channels;
+
+	if (1 == num_channels && NULL == window) {
+		for (i = 0; i < num_frames; ++i) {
+			out[i] = frames[i];
+		}
+	} else if (1 == num_channels) {
+		for (i = 0; i < num_frames; ++i) {
+			out[i] = frames[i] * window[i];
+		}
+	} else if (NULL == window) {
+		for (i = 0; i < num_frames; ++i) {
+			sum = 0.0f;
+			for (j = 0; j < num_channels; ++j) {
+				sum += frames[i * num_channels + j];
+			}
+			out[i] = sum * scale;
+		}
+	} else {
+		for (i = 0; i < num_frames; ++i) {
+			sum = 0.0f;
+			for (j = 0; j < num_channels; ++j) {
+				sum += frames[i * num_channels + j];
+			}
+			out[i] = sum * scale * window[i];
+		}
+	}
+}
+
+/*
+ * The single-precision counterpart of get_peak_of_spectrum().
+ */
+long get_peak_of_spectrum_float(const fftwf_complex * const spectrum, long num_bins, float *peak_power)
+{
+	long	i;
+	long	maximum_index;
+	float	maximum;
+	float	power;
+
+	if (NULL == spectrum || 0 >= num_bins) {
+		return -1;
+	}
+
+	maximum_index = 0;
+	maximum = spectrum[0][0] * spectrum[0][0] + spectrum[0][1] * spectrum[0][1];
+	for (i = 1; i < num_bins; ++i) {
+		power = spectrum[i][0] * spectrum[i][0] + spectrum[i][1] * spectrum[i][1];
+		if (power > maximum) {
+			maximum = power;
+			maximum_index = i;
+		}
+	}
+
+	if (NULL != peak_power) {
+		*peak_power = maximum;
+	}
+
+	return maximum_index;
+}
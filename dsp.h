@@ -0,0 +1,47 @@
+/*
+ *  dsp.h
+ *
+ *  Copyright (C) 2016  Nathan Bossart
+ */
+
+#ifndef DSP_H
+#define DSP_H
+
+#include "common.h"
+#include <fftw3.h>
+#include "source.h"
+
+/* the most peaks get_peaks_of_spectrum() can find in one call */
+#define DSP_MAX_PEAKS		64
+
+/* taps of the filter for an odd decimation factor per unit of the factor */
+#define DSP_DECIMATION_TAPS_PER_PHASE	20
+
+/*
+ * The highest frequency kept by decimation, as a fraction of the decimated
+ * Nyquist frequency.  The rest is left for the filter's transition band.
+ */
+#define DSP_DECIMATION_PASSBAND		0.8
+
+/* the largest factor get_decimation_factor() returns */
+#define DSP_MAX_DECIMATION_FACTOR	32
+
+/* functions provided by this library */
+const double *	get_hann_window(long num_samples);
+void		clear_window_cache(void);
+void		mix_down_and_window(const double * const frames, long num_frames, int num_channels, const double * const window, double *out);
+void		mix_down_and_window_encoded(const unsigned char * const frames, enum sample_encoding_t encoding, long num_frames, int num_channels, const double * const window, double *out);
+int		get_decimation_factor(int sample_rate, double max_freq);
+long		decimate(double *samples, long num_samples, int factor, double *out);
+long		get_peak_of_spectrum(const fftw_complex * const spectrum, long num_bins, double *peak_power);
+double		interpolate_peak(const fftw_complex * const spectrum, long num_bins, long peak, enum peak_interpolation_t interpolation);
+double		interpolate_peak_by_phase(const fftw_complex * const previous, const fftw_complex * const current, long peak, long window_size, long hop_size);
+long		get_peaks_of_spectrum(const fftw_complex * const spectrum, long num_bins, long min_bin, double min_relative_power, long *peaks, long max_peaks);
+long		remove_harmonic_peaks(long *peaks, double *powers, long num_peaks, double tolerance_cents, double tolerance_bins, double min_relative_power);
+double		get_yin_frequency(const double * const samples, long num_samples, int sample_rate, double threshold);
+double		get_yin_frequency_with_scratch(const double * const samples, long num_samples, int sample_rate, double threshold, double *diff, fftw_complex *head_spectrum, fftw_complex *spectrum);
+const float *	get_hann_window_float(long num_samples);
+void		mix_down_and_window_float(const float * const frames, long num_frames, int num_channels, const float * const window, float *out);
+long		get_peak_of_spectrum_float(const fftwf_complex * const spectrum, long num_bins, float *peak_power);
+
+#endif
@@ -0,0 +1,538 @@
+/*
+ *  fft.c
+ *
+ *  Copyright (C) 2016  Nathan Bossart
+ */
+
+#include <assert.h>
+#include "cqt.h"
+#include "dsp.h"
+#include "fft.h"
+#include <fftw3.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "utils.h"
+
+/*
+ * FFTW only needs the byte offset of an array from its SIMD alignment to know
+ * if a plan can be reused for it, so we pad our scratch arrays by this much
+ * and shift them to match the caller's arrays when planning.
+ */
+#define FFT_MAX_ALIGNMENT	64
+
+/* longest filename we'll build for the single-precision wisdom file */
+#define FFT_WISDOM_FILENAME_MAX	4096
+
+/*
+ * A node in the singly-linked list of cached FFTW plans.  FFTW's new-array
+ * execute functions allow a plan to be run on any arrays with the same length,
+ * alignment, and placement as the ones it was created with, so that's what we
+ * key on.  Forward (real-to-complex) and inverse (complex-to-real) plans share
+ * the list.
+ *
+ * num_samples   : length of the real-valued transform input (or output)
+ * in_alignment  : fftw_alignment_of() the input array
+ * out_alignment : fftw_alignment_of() the output array
+ * in_place      : whether the input and output arrays are the same
+ * inverse       : whether this is a complex-to-real plan
+ * plan          : the cached plan
+ * next          : the next node in the list (NULL if we're at the end)
+ */
+struct fft_plan_node
+{
+	long			num_samples;
+	int			in_alignment;
+	int			out_alignment;
+	bool			in_place;
+	bool			inverse;
+	fftw_plan		plan;
+	struct fft_plan_node *	next;
+};
+
+/*
+ * The single-precision counterpart of struct fft_plan_node.  FFTW keeps the
+ * two precisions in entirely separate libraries, so we keep separate caches.
+ */
+struct fftf_plan_node
+{
+	long			num_samples;
+	int			in_alignment;
+	int			out_alignment;
+	bool			in_place;
+	fftwf_plan		plan;
+	struct fftf_plan_node *	next;
+};
+
+/* function prototypes for static functions */
+static unsigned		get_planner_flags(void);
+static fftw_plan	create_r2c_plan(long num_samples, int in_alignment, int out_alignment, bool in_place);
+static fftw_plan	create_c2r_plan(long num_samples, int in_alignment, int out_alignment, bool in_place);
+static fftw_plan	get_cached_plan(long num_samples, int in_alignment, int out_alignment, bool in_place, bool inverse);
+static fftwf_plan	create_r2c_plan_float(long num_samples, int in_alignment, int out_alignment, bool in_place);
+static bool		get_float_wisdom_filename(const char * const filename, char *float_filename);
+static void		destroy_cached_plans(void);
+
+static struct fft_plan_node	*r2c_plan_cache = NULL;
+static struct fftf_plan_node	*r2c_plan_cache_float = NULL;
+static enum fft_rigor_t		planning_rigor = FFT_RIGOR_ESTIMATE;
+
+/*
+ * Only FFTW's execute functions are thread-safe; everything that touches the
+ * planner (planning, destroying plans, and wisdom) must be serialized.  All of
+ * those calls go through this file, and this lock also protects the caches.
+ */
+static pthread_mutex_t		planner_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * This function initializes the library.  If wisdom_filename is not NULL,
+ * previously saved FFTW wisdom is loaded from it so that plans created later
+ * can skip the (potentially expensive) measurements.
+ *
+ * Returns FFT_WISDOM_FAILURE_CODE if the wisdom could not be loaded (e.g. the
+ * file doesn't exist yet).  The library is still usable in this case.
+ */
+int tonedef_init(const char * const wisdom_filename)
+{
+	if (NULL == wisdom_filename) {
+		return FFT_WISDOM_SUCCESS_CODE;
+	}
+
+	return load_fft_wisdom(wisdom_filename);
+}
+
+/*
+ * This function releases every cached plan, window table, and constant-Q
+ * kernel.  Accumulated wisdom is kept, so save_fft_wisdom() can still be
+ * called afterwards.  No note detector may be in use when this is called.
+ */
+void tonedef_cleanup(void)
+{
+	clear_fft_plan_cache();
+	clear_window_cache();
+	clear_cqt_kernel_cache();
+}
+
+/*
+ * Static function for building the name of the file that holds the
+ * single-precision wisdom that goes along with the given wisdom file.  FFTW
+ * keeps wisdom for each precision separately, so it is saved separately too.
+ *
+ * Returns false if the filename is too long.
+ */
+static bool get_float_wisdom_filename(const char * const filename, char *float_filename)
+{
+	assert(NULL != filename);
+	assert(NULL != float_filename);
+
+	if (strlen(filename) + strlen(FFT_FLOAT_WISDOM_SUFFIX) >= FFT_WISDOM_FILENAME_MAX) {
+		fprintf(stderr, "wisdom filename is too long\n");
+		return false;
+	}
+
+	strcpy(float_filename, filename);
+	strcat(float_filename, FFT_FLOAT_WISDOM_SUFFIX);
+
+	return true;
+}
+
+/*
+ * This function imports FFTW wisdom from the given file.  Single-precision
+ * wisdom is imported from the same filename with FFT_FLOAT_WISDOM_SUFFIX
+ * appended, if that file exists.
+ *
+ * Returns FFT_WISDOM_SUCCESS_CODE on success and FFT_WISDOM_FAILURE_CODE if the
+ * file could not be read or parsed.
+ */
+int load_fft_wisdom(const char * const filename)
+{
+	char float_filename[FFT_WISDOM_FILENAME_MAX];
+
+	if (NULL == filename) {
+		fprintf(stderr, "wisdom filename is null\n");
+		return FFT_WISDOM_FAILURE_CODE;
+	}
+
+	pthread_mutex_lock(&planner_lock);
+	if (0 == fftw_import_wisdom_from_filename(filename)) {
+		pthread_mutex_unlock(&planner_lock);
+		return FFT_WISDOM_FAILURE_CODE;
+	}
+
+	/* older wisdom files won't have any single-precision wisdom */
+	if (get_float_wisdom_filename(filename, float_filename)) {
+		fftwf_import_wisdom_from_filename(float_filename);
+	}
+	pthread_mutex_unlock(&planner_lock);
+
+	return FFT_WISDOM_SUCCESS_CODE;
+}
+
+/*
+ * This function exports all of the FFTW wisdom gathered so far (including any
+ * that was loaded) to the given file.  Single-precision wisdom is exported to
+ * the same filename with FFT_FLOAT_WISDOM_SUFFIX appended.
+ *
+ * Returns FFT_WISDOM_SUCCESS_CODE on success and FFT_WISDOM_FAILURE_CODE if
+ * either file could not be written.
+ */
+int save_fft_wisdom(const char * const filename)
+{
+	char float_filename[FFT_WISDOM_FILENAME_MAX];
+
+	if (NULL == filename) {
+		fprintf(stderr, "wisdom filename is null\n");
+		return FFT_WISDOM_FAILURE_CODE;
+	}
+
+	if (!get_float_wisdom_filename(filename, float_filename)) {
+		return FFT_WISDOM_FAILURE_CODE;
+	}
+
+	pthread_mutex_lock(&planner_lock);
+	if (0 == fftw_export_wisdom_to_filename(filename)
+			|| 0 == fftwf_export_wisdom_to_filename(float_filename)) {
+		pthread_mutex_unlock(&planner_lock);
+		return FFT_WISDOM_FAILURE_CODE;
+	}
+	pthread_mutex_unlock(&planner_lock);
+
+	return FFT_WISDOM_SUCCESS_CODE;
+}
+
+/*
+ * This function sets the rigor used for planning new transforms.  Cached plans
+ * were made with the old rigor, so the cache is cleared if the rigor changes.
+ */
+void set_fft_planning_rigor(enum fft_rigor_t rigor)
+{
+	if (FFT_RIGOR_ESTIMATE > rigor || FFT_RIGOR_PATIENT < rigor) {
+		fprintf(stderr, "invalid fft planning rigor '%d'\n", rigor);
+		return;
+	}
+
+	pthread_mutex_lock(&planner_lock);
+	if (rigor != planning_rigor) {
+		destroy_cached_plans();
+		planning_rigor = rigor;
+	}
+	pthread_mutex_unlock(&planner_lock);
+}
+
+/*
+ * This function returns the rigor currently used for planning new transforms.
+ */
+enum fft_rigor_t get_fft_planning_rigor(void)
+{
+	enum fft_rigor_t rigor;
+
+	pthread_mutex_lock(&planner_lock);
+	rigor = planning_rigor;
+	pthread_mutex_unlock(&planner_lock);
+
+	return rigor;
+}
+
+/*
+ * This function destroys every cached plan.  No plan previously returned by
+ * the cache may be in use (by any thread) when this is called.
+ */
+void clear_fft_plan_cache(void)
+{
+	pthread_mutex_lock(&planner_lock);
+	destroy_cached_plans();
+	pthread_mutex_unlock(&planner_lock);
+}
+
+/*
+ * Static function that destroys every cached plan.  The planner lock must be
+ * held by the caller.
+ */
+static void destroy_cached_plans(void)
+{
+	struct fft_plan_node	*node;
+	struct fftf_plan_node	*node_float;
+
+	while (NULL != r2c_plan_cache) {
+		node = r2c_plan_cache;
+		r2c_plan_cache = node->next;
+		fftw_destroy_plan(node->plan);
+		FREE_SAFELY(node);
+	}
+
+	while (NULL != r2c_plan_cache_float) {
+		node_float = r2c_plan_cache_float;
+		r2c_plan_cache_float = node_float->next;
+		fftwf_destroy_plan(node_float->plan);
+		FREE_SAFELY(node_float);
+	}
+}
+
+/*
+ * Static function for translating the planning rigor into FFTW flags.  The
+ * planner lock must be held by the caller.
+ */
+static unsigned get_planner_flags(void)
+{
+	switch(planning_rigor) {
+
+	case(FFT_RIGOR_MEASURE):
+		return FFTW_MEASURE;
+
+	case(FFT_RIGOR_PATIENT):
+		return FFTW_PATIENT;
+
+	default:
+		return FFTW_ESTIMATE;
+	}
+}
+
+/*
+ * Static function for creating a real-to-complex plan for arrays with the given
+ * alignments.  Anything more rigorous than FFTW_ESTIMATE overwrites the arrays
+ * while measuring, so we always plan on scratch arrays that are shifted to
+ * match the caller's alignment instead of the caller's own arrays.  The planner
+ * lock must be held by the caller.
+ *
+ * Returns NULL if FFTW could not create the plan.
+ */
+static fftw_plan create_r2c_plan(long num_samples, int in_alignment, int out_alignment, bool in_place)
+{
+	char		*in_scratch;
+	char		*out_scratch;
+	size_t		out_bytes;
+	fftw_plan	plan;
+
+	assert(0 < num_samples);
+
+	/* an in-place transform needs room for num_samples / 2 + 1 bins */
+	out_bytes = (num_samples / 2 + 1) * sizeof(fftw_complex);
+
+	in_scratch = (char *) detect_oom(fftw_malloc(out_bytes + FFT_MAX_ALIGNMENT));
+	if (in_place) {
+		plan = fftw_plan_dft_r2c_1d(num_samples,
+			(double *) (in_scratch + in_alignment),
+			(fftw_complex *) (in_scratch + in_alignment),
+			get_planner_flags());
+		fftw_free(in_scratch);
+		return plan;
+	}
+
+	out_scratch = (char *) detect_oom(fftw_malloc(out_bytes + FFT_MAX_ALIGNMENT));
+	plan = fftw_plan_dft_r2c_1d(num_samples,
+		(double *) (in_scratch + in_alignment),
+		(fftw_complex *) (out_scratch + out_alignment),
+		get_planner_flags());
+	fftw_free(in_scratch);
+	fftw_free(out_scratch);
+
+	return plan;
+}
+
+/*
+ * Static function for creating a complex-to-real plan for arrays with the given
+ * alignments.  This is the inverse of create_r2c_plan(), and the same caveats
+ * apply.  The planner lock must be held by the caller.
+ *
+ * Returns NULL if FFTW could not create the plan.
+ */
+static fftw_plan create_c2r_plan(long num_samples, int in_alignment, int out_alignment, bool in_place)
+{
+	char		*in_scratch;
+	char		*out_scratch;
+	size_t		in_bytes;
+	fftw_plan	plan;
+
+	assert(0 < num_samples);
+
+	in_bytes = (num_samples / 2 + 1) * sizeof(fftw_complex);
+
+	in_scratch = (char *) detect_oom(fftw_malloc(in_bytes + FFT_MAX_ALIGNMENT));
+	if (in_place) {
+		plan = fftw_plan_dft_c2r_1d(num_samples,
+			(fftw_complex *) (in_scratch + in_alignment),
+			(double *) (in_scratch + in_alignment),
+			get_planner_flags());
+		fftw_free(in_scratch);
+		return plan;
+	}
+
+	out_scratch = (char *) detect_oom(fftw_malloc(num_samples * sizeof(double) + FFT_MAX_ALIGNMENT));
+	plan = fftw_plan_dft_c2r_1d(num_samples,
+		(fftw_complex *) (in_scratch + in_alignment),
+		(double *) (out_scratch + out_alignment),
+		get_planner_flags());
+	fftw_free(in_scratch);
+	fftw_free(out_scratch);
+
+	return plan;
+}
+
+/*
+ * Static function that looks up a plan of the given shape in the cache, and
+ * creates (and caches) it if it isn't there yet.
+ *
+ * Returns NULL if FFTW could not create the plan.
+ */
+static fftw_plan get_cached_plan(long num_samples, int in_alignment, int out_alignment, bool in_place, bool inverse)
+{
+	struct fft_plan_node	*node;
+
+	pthread_mutex_lock(&planner_lock);
+	for (node = r2c_plan_cache; NULL != node; node = node->next) {
+		if (num_samples == node->num_samples && in_alignment == node->in_alignment
+				&& out_alignment == node->out_alignment && in_place == node->in_place
+				&& inverse == node->inverse) {
+			pthread_mutex_unlock(&planner_lock);
+			return node->plan;
+		}
+	}
+
+	node = (struct fft_plan_node *) MALLOC_SAFELY(sizeof(struct fft_plan_node));
+	node->num_samples	= num_samples;
+	node->in_alignment	= in_alignment;
+	node->out_alignment	= out_alignment;
+	node->in_place		= in_place;
+	node->inverse		= inverse;
+	if (inverse) {
+		node->plan = create_c2r_plan(num_samples, in_alignment, out_alignment, in_place);
+	} else {
+		node->plan = create_r2c_plan(num_samples, in_alignment, out_alignment, in_place);
+	}
+	if (NULL == node->plan) {
+		pthread_mutex_unlock(&planner_lock);
+		FREE_SAFELY(node);
+		return NULL;
+	}
+
+	node->next = r2c_plan_cache;
+	r2c_plan_cache = node;
+	pthread_mutex_unlock(&planner_lock);
+
+	return node->plan;
+}
+
+/*
+ * This function retrieves a real-to-complex plan that can be used for the given
+ * arrays with fftw_execute_dft_r2c().  Plans are cached by transform length
+ * and array alignment, so only the first request for a given shape pays for
+ * planning.  The returned plan belongs to the cache and must not be destroyed
+ * by the caller.  This function may be called from any thread, and the plan may
+ * be executed from any thread.
+ *
+ * Returns NULL for illegal arguments or if FFTW could not create the plan.
+ */
+fftw_plan get_r2c_plan(long num_samples, double *in, fftw_complex *out)
+{
+	if (NULL == in || NULL == out || 0 >= num_samples) {
+		return NULL;
+	}
+
+	return get_cached_plan(num_samples, fftw_alignment_of(in), fftw_alignment_of((double *) out),
+		(void *) in == (void *) out, false);
+}
+
+/*
+ * This function retrieves a complex-to-real plan (the unnormalized inverse of
+ * the plan from get_r2c_plan()) that can be used for the given arrays with
+ * fftw_execute_dft_c2r().  The in array holds num_samples / 2 + 1 bins and is
+ * overwritten by the transform.  Plans are cached just like get_r2c_plan().
+ *
+ * Returns NULL for illegal arguments or if FFTW could not create the plan.
+ */
+fftw_plan get_c2r_plan(long num_samples, fftw_complex *in, double *out)
+{
+	if (NULL == in || NULL == out || 0 >= num_samples) {
+		return NULL;
+	}
+
+	return get_cached_plan(num_samples, fftw_alignment_of((double *) in), fftw_alignment_of(out),
+		(void *) in == (void *) out, true);
+}
+
+/*
+ * The single-precision counterpart of create_r2c_plan().  The planner lock must
+ * be held by the caller.
+ */
+static fftwf_plan create_r2c_plan_float(long num_samples, int in_alignment, int out_alignment, bool in_place)
+{
+	char		*in_scratch;
+	char		*out_scratch;
+	size_t		out_bytes;
+	fftwf_plan	plan;
+
+	assert(0 < num_samples);
+
+	/* an in-place transform needs room for num_samples / 2 + 1 bins */
+	out_bytes = (num_samples / 2 + 1) * sizeof(fftwf_complex);
+
+	in_scratch = (char *) detect_oom(fftwf_malloc(out_bytes + FFT_MAX_ALIGNMENT));
+	if (in_place) {
+		plan = fftwf_plan_dft_r2c_1d(num_samples,
+			(float *) (in_scratch + in_alignment),
+			(fftwf_complex *) (in_scratch + in_alignment),
+			get_planner_flags());
+		fftwf_free(in_scratch);
+		return plan;
+	}
+
+	out_scratch = (char *) detect_oom(fftwf_malloc(out_bytes + FFT_MAX_ALIGNMENT));
+	plan = fftwf_plan_dft_r2c_1d(num_samples,
+		(float *) (in_scratch + in_alignment),
+		(fftwf_complex *) (out_scratch + out_alignment),
+		get_planner_flags());
+	fftwf_free(in_scratch);
+	fftwf_free(out_scratch);
+
+	return plan;
+}
+
+/*
+ * The single-precision counterpart of get_r2c_plan().  The returned plan is for
+ * use with fftwf_execute_dft_r2c() and belongs to the cache.
+ *
+ * Returns NULL for illegal arguments or if FFTW could not create the plan.
+ */
+fftwf_plan get_r2c_plan_float(long num_samples, float *in, fftwf_complex *out)
+{
+	struct fftf_plan_node	*node;
+	int			in_alignment;
+	int			out_alignment;
+	bool			in_place;
+
+	if (NULL == in || NULL == out || 0 >= num_samples) {
+		return NULL;
+	}
+
+	in_alignment = fftwf_alignment_of(in);
+	out_alignment = fftwf_alignment_of((float *) out);
+	in_place = ((void *) in == (void *) out);
+
+	pthread_mutex_lock(&planner_lock);
+	for (node = r2c_plan_cache_float; NULL != node; node = node->next) {
+		if (num_samples == node->num_samples && in_alignment == node->in_alignment
+				&& out_alignment == node->out_alignment && in_place == node->in_place) {
+			pthread_mutex_unlock(&planner_lock);
+			return node->plan;
+		}
+	}
+
+	node = (struct fftf_plan_node *) MALLOC_SAFELY(sizeof(struct fftf_plan_node));
+	node->num_samples	= num_samples;
+	node->in_alignment	= in_alignment;
+	node->out_alignment	= out_alignment;
+	node->in_place		= in_place;
+	if (NULL == (node->plan = create_r2c_plan_float(num_samples, in_alignment, out_alignment, in_place))) {
+		pthread_mutex_unlock(&planner_lock);
+		FREE_SAFELY(node);
+		return NULL;
+	}
+
+	node->next = r2c_plan_cache_float;
+	r2c_plan_cache_float = node;
+	pthread_mutex_unlock(&planner_lock);
+
+	return node->plan;
+}
@@ -0,0 +1,44 @@
+/*
+ *  fft.h
+ *
+ *  Copyright (C) 2016  Nathan Bossart
+ */
+
+#ifndef FFT_H
+#define FFT_H
+
+#include <fftw3.h>
+
+/* return codes for the FFTW wisdom functions */
+#define FFT_WISDOM_SUCCESS_CODE	0
+#define FFT_WISDOM_FAILURE_CODE	-1
+
+/* appended to the wisdom filename to get the single-precision wisdom file */
+#define FFT_FLOAT_WISDOM_SUFFIX	".f32"
+
+/*
+ * The planning rigor used when a new FFTW plan must be created.  Higher rigor
+ * takes (much) longer to plan but may yield a faster transform.  Since plans
+ * are cached and wisdom can be saved, the planning cost is paid only once.
+ *
+ * FFT_RIGOR_ESTIMATE : FFTW_ESTIMATE (the default; no measurement at all)
+ * FFT_RIGOR_MEASURE  : FFTW_MEASURE
+ * FFT_RIGOR_PATIENT  : FFTW_PATIENT
+ */
+enum fft_rigor_t
+{
+	FFT_RIGOR_ESTIMATE, FFT_RIGOR_MEASURE, FFT_RIGOR_PATIENT
+};
+
+int			tonedef_init(const char * const wisdom_filename);
+void			tonedef_cleanup(void);
+int			load_fft_wisdom(const char * const filename);
+int			save_fft_wisdom(const char * const filename);
+void			set_fft_planning_rigor(enum fft_rigor_t rigor);
+enum fft_rigor_t	get_fft_planning_rigor(void);
+void			clear_fft_plan_cache(void);
+fftw_plan		get_r2c_plan(long num_samples, double *in, fftw_complex *out);
+fftw_plan		get_c2r_plan(long num_samples, fftw_complex *in, double *out);
+fftwf_plan		get_r2c_plan_float(long num_samples, float *in, fftwf_complex *out);
+
+#endif
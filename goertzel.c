@@ -0,0 +1,236 @@
+/*
+ *  goertzel.c
+ *
+ *  Copyright (C) 2016  Nathan Bossart
+ */
+
+#include <assert.h>
+#include "common.h"
+#include "dsp.h"
+#include "goertzel.h"
+#include <math.h>
+#include "source.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "utils.h"
+
+/* the most filters in the bank: every partial of every note */
+#define GOERTZEL_MAX_FILTERS	(VERIFY_MAX_NOTES * (VERIFY_MAX_HARMONICS + 1))
+
+/*
+ * A bank of Goertzel filters, one per partial of every expected note.  Each
+ * filter is a two-pole resonator at its frequency, so the power of the signal
+ * at that one frequency costs one multiply-add per sample.
+ *
+ * num_filters : number of filters in the bank
+ * owner       : index of the expected note each filter belongs to
+ * coeff       : 2 cos(omega) of each filter, omega being its angular frequency
+ * s1          : the previous output of each filter
+ * s2          : the output before that
+ */
+struct goertzel_bank
+{
+	int	num_filters;
+	int	owner[GOERTZEL_MAX_FILTERS];
+	double	coeff[GOERTZEL_MAX_FILTERS];
+	double	s1[GOERTZEL_MAX_FILTERS];
+	double	s2[GOERTZEL_MAX_FILTERS];
+};
+
+/* function prototypes for static functions */
+static bool	init_goertzel_bank(struct goertzel_bank *bank, int sample_rate, const struct note * const expected, int num_expected, int num_harmonics);
+
+/*
+ * This function checks whether each of the expected notes can be heard in the
+ * mono samples, without taking an FFT.  Only the frequencies of the expected
+ * notes (and their first num_harmonics harmonics, which matter for instruments
+ * whose fundamental is weak) are evaluated, with a bank of Goertzel filters
+ * over the Hann-windowed samples, so the cost is one pass over the samples
+ * with a handful of multiply-adds per sample.  Harmonics above the Nyquist
+ * frequency are skipped.
+ *
+ * A note passes if its power is at least threshold (0.0 to 1.0) of the power
+ * of the whole signal; see struct note_verdict.  The verdicts are stored in
+ * the same order as the expected notes.  How far out of tune a note can be
+ * and still pass depends on num_samples: a Hann window's main lobe reaches
+ * 2 * sample_rate / num_samples Hz either side of the expected frequency.
+ *
+ * Returns VERIFY_NOTES_SUCCESS_CODE, or VERIFY_NOTES_FAILURE_CODE for illegal
+ * arguments (including invalid expected notes).
+ */
+int verify_notes(const double * const samples, long num_samples, int sample_rate, const struct note * const expected, int num_expected, int num_harmonics, double threshold, struct note_verdict *verdicts)
+{
+	struct goertzel_bank	bank;
+	const double		*window;
+	double			x;
+	double			s0;
+	double			window_sum;
+	double			total_power;
+	double			power;
+	long			i;
+	int			k;
+
+	if (NULL == samples || NULL == expected || NULL == verdicts) {
+		fprintf(stderr, "samples, expected notes, and verdicts cannot be NULL\n");
+		return VERIFY_NOTES_FAILURE_CODE;
+	}
+
+	/* the Hann function is undefined for windows of less than 2 samples */
+	if (2 > num_samples || 0 >= sample_rate) {
+		fprintf(stderr, "need at least 2 samples and a positive sample rate\n");
+		return VERIFY_NOTES_FAILURE_CODE;
+	}
+
+	if (1 > num_expected || VERIFY_MAX_NOTES < num_expected) {
+		fprintf(stderr, "number of expected notes must be within 1 to %d\n", VERIFY_MAX_NOTES);
+		return VERIFY_NOTES_FAILURE_CODE;
+	}
+
+	if (0 > num_harmonics || VERIFY_MAX_HARMONICS < num_harmonics) {
+		fprintf(stderr, "number of harmonics must be within 0 to %d\n", VERIFY_MAX_HARMONICS);
+		return VERIFY_NOTES_FAILURE_CODE;
+	}
+
+	if (0.0 >= threshold || 1.0 < threshold) {
+		fprintf(stderr, "threshold must be within 0.0 (exclusive) to 1.0\n");
+		return VERIFY_NOTES_FAILURE_CODE;
+	}
+
+	if (!init_goertzel_bank(&bank, sample_rate, expected, num_expected, num_harmonics)) {
+		return VERIFY_NOTES_FAILURE_CODE;
+	}
+
+	/*
+	 * Run every filter over the samples in a single pass.  The filters are
+	 * independent of each other, so the inner loop can be vectorized.
+	 */
+	window = get_hann_window(num_samples);
+	window_sum = 0.0;
+	total_power = 0.0;
+	for (i = 0; i < num_samples; ++i) {
+		x = samples[i] * window[i];
+		window_sum += window[i];
+		total_power += x * x;
+		for (k = 0; k < bank.num_filters; ++k) {
+			s0 = x + bank.coeff[k] * bank.s1[k] - bank.s2[k];
+			bank.s2[k] = bank.s1[k];
+			bank.s1[k] = s0;
+		}
+	}
+
+	/*
+	 * A sinusoid of amplitude A at a filter's frequency comes out with a
+	 * squared magnitude of (A * window_sum / 2)^2, and the sum of squares of
+	 * the windowed sinusoid is A^2 / 2 times that of the Hann window (3 / 8
+	 * of num_samples).  Both are scaled so the sinusoid has a power of
+	 * A^2 / 2 (and a relative power of 1.0).
+	 */
+	total_power /= 0.375 * num_samples;
+	for (k = 0; k < num_expected; ++k) {
+		verdicts[k].note = expected[k];
+		verdicts[k].power = 0.0;
+	}
+	for (k = 0; k < bank.num_filters; ++k) {
+		power = bank.s1[k] * bank.s1[k] + bank.s2[k] * bank.s2[k] - bank.coeff[k] * bank.s1[k] * bank.s2[k];
+		verdicts[bank.owner[k]].power += 2.0 * power / (window_sum * window_sum);
+	}
+	for (k = 0; k < num_expected; ++k) {
+		verdicts[k].relative_power = (0.0 < total_power) ? verdicts[k].power / total_power : 0.0;
+		verdicts[k].passed = (verdicts[k].relative_power >= threshold);
+	}
+
+	return VERIFY_NOTES_SUCCESS_CODE;
+}
+
+/*
+ * This function is verify_notes() for the first secs_to_sample seconds of the
+ * sound file (mixed down to one channel).
+ *
+ * Returns VERIFY_NOTES_SUCCESS_CODE, or VERIFY_NOTES_FAILURE_CODE for illegal
+ * arguments or if the file could not be read.
+ */
+int verify_notes_from_file(const char * const filename, double secs_to_sample, const struct note * const expected, int num_expected, int num_harmonics, double threshold, struct note_verdict *verdicts)
+{
+	struct tonedef_source	*source;
+	double			*frames;
+	double			*samples;
+	long			num_samples;
+	long			frames_read;
+	int			ret;
+
+	if (NULL == filename) {
+		fprintf(stderr, "filename is null\n");
+		return VERIFY_NOTES_FAILURE_CODE;
+	}
+
+	if (0.0 >= secs_to_sample) {
+		fprintf(stderr, "secs_to_sample is less than zero\n");
+		return VERIFY_NOTES_FAILURE_CODE;
+	}
+
+	if (NULL == (source = open_source(filename))) {
+		fprintf(stderr, "could not open sound file; does the file exist?\n");
+		return VERIFY_NOTES_FAILURE_CODE;
+	}
+
+	num_samples = secs_to_sample * get_source_sample_rate(source);
+	if (0 >= num_samples || num_samples > get_source_num_frames(source)) {
+		fprintf(stderr, "file does not contain the requested number of samples\n");
+		close_source(source);
+		return VERIFY_NOTES_FAILURE_CODE;
+	}
+
+	frames = (double *) MALLOC_SAFELY(num_samples * get_source_num_channels(source) * sizeof(double));
+	samples = (double *) MALLOC_SAFELY(num_samples * sizeof(double));
+
+	ret = VERIFY_NOTES_FAILURE_CODE;
+	frames_read = read_frames_from_source(source, frames, num_samples);
+	if (num_samples == frames_read) {
+		mix_down_and_window(frames, num_samples, get_source_num_channels(source), NULL, samples);
+		ret = verify_notes(samples, num_samples, get_source_sample_rate(source), expected, num_expected,
+			num_harmonics, threshold, verdicts);
+	} else {
+		fprintf(stderr, "could not retrieve requested number of samples from file\n");
+	}
+
+	close_source(source);
+	FREE_SAFELY(frames);
+	FREE_SAFELY(samples);
+
+	return ret;
+}
+
+/*
+ * Static function that sets up a filter for every partial of every expected
+ * note below the Nyquist frequency, with all of their state cleared.
+ *
+ * Returns false if one of the expected notes is invalid.
+ */
+static bool init_goertzel_bank(struct goertzel_bank *bank, int sample_rate, const struct note * const expected, int num_expected, int num_harmonics)
+{
+	double	freq;
+	int	i;
+	int	h;
+
+	assert(NULL != bank);
+	assert(NULL != expected);
+
+	bank->num_filters = 0;
+	for (i = 0; i < num_expected; ++i) {
+		if (INVALID_FREQUENCY == (freq = get_freq(&expected[i]))) {
+			fprintf(stderr, "expected note %d is invalid\n", i);
+			return false;
+		}
+
+		for (h = 1; h <= num_harmonics + 1 && h * freq < sample_rate / 2.0; ++h) {
+			bank->owner[bank->num_filters] = i;
+			bank->coeff[bank->num_filters] = 2.0 * cos(2 * M_PI * h * freq / sample_rate);
+			bank->s1[bank->num_filters] = 0.0;
+			bank->s2[bank->num_filters] = 0.0;
+			++bank->num_filters;
+		}
+	}
+
+	return true;
+}
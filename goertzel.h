@@ -0,0 +1,48 @@
+/*
+ *  goertzel.h
+ *
+ *  Copyright (C) 2016  Nathan Bossart
+ */
+
+#ifndef GOERTZEL_H
+#define GOERTZEL_H
+
+#include "common.h"
+#include <stdbool.h>
+
+/* return codes for verify_notes() and verify_notes_from_file() */
+#define VERIFY_NOTES_SUCCESS_CODE	0
+#define VERIFY_NOTES_FAILURE_CODE	-1
+
+/* the most notes that can be verified in one call */
+#define VERIFY_MAX_NOTES		8
+
+/* the most harmonics (above the fundamental) that can be checked per note */
+#define VERIFY_MAX_HARMONICS		8
+
+/* default share of the signal's power a note needs to pass */
+#define VERIFY_DEFAULT_THRESHOLD	0.1
+
+/*
+ * The verdict on one expected note.
+ *
+ * note           : the expected note
+ * power          : the power of the note's fundamental (and harmonics, if
+ *                  requested); a sinusoid of amplitude A has a power of A^2 / 2
+ * relative_power : power as a share of the power of the whole signal (about
+ *                  1.0 for a pure tone, and about 1 / n for each of n notes
+ *                  played equally loud)
+ * passed         : whether relative_power reached the threshold
+ */
+struct note_verdict
+{
+	struct note	note;
+	double		power;
+	double		relative_power;
+	bool		passed;
+};
+
+int	verify_notes(const double * const samples, long num_samples, int sample_rate, const struct note * const expected, int num_expected, int num_harmonics, double threshold, struct note_verdict *verdicts);
+int	verify_notes_from_file(const char * const filename, double secs_to_sample, const struct note * const expected, int num_expected, int num_harmonics, double threshold, struct note_verdict *verdicts);
+
+#endif
@@ -0,0 +1,307 @@
+/*
+ *  key.c
+ *
+ *  Copyright (C) 2016  Nathan Bossart
+ */
+
+#include <assert.h>
+#include "chroma.h"
+#include "common.h"
+#include "key.h"
+#include <math.h>
+#include <pthread.h>
+#include "scale.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include "utils.h"
+
+/* number of modes estimated (major and minor) */
+#define KEY_NUM_MODES		(KEY_NUM_KEYS / SEMITONES_PER_OCTAVE)
+
+/* below this, the histogram is taken to be flat (or empty) */
+#define KEY_FLAT_EPSILON	1e-12
+
+/*
+ * The internal state of a key estimator.
+ *
+ * decay     : the share of the histogram kept from one frame to the next
+ * histogram : the decayed weight of each pitch class, C first
+ */
+struct key_estimator
+{
+	double	decay;
+	double	histogram[SEMITONES_PER_OCTAVE];
+};
+
+/* function prototypes for static functions */
+static void	build_key_profiles(void);
+static void	decay_histogram(struct key_estimator *estimator);
+
+/* the scale of each mode, in the order of the rows of key_profiles */
+static const enum scale_t key_scales[KEY_NUM_MODES] = {MAJOR_SCALE, NATURAL_MINOR_SCALE};
+
+/*
+ * The Krumhansl-Kessler key profiles: how well each pitch class (counting up
+ * from the tonic) was judged to fit a major or minor key, in the order of
+ * key_scales.
+ */
+static const double krumhansl_profiles[KEY_NUM_MODES][SEMITONES_PER_OCTAVE] = {
+	{6.35, 2.23, 3.48, 2.33, 4.38, 4.09, 2.52, 5.19, 2.39, 3.66, 2.29, 2.88},
+	{6.33, 2.68, 3.52, 5.38, 2.60, 3.53, 2.54, 4.75, 3.98, 2.69, 3.34, 3.17}
+};
+
+/*
+ * The profile of every key, transposed to its tonic and rescaled to a mean of
+ * 0 and a length of 1, so that the correlation with a histogram is just a dot
+ * product divided by the length of the histogram (less its mean).  Indexed by
+ * mode * SEMITONES_PER_OCTAVE + tonic, then by pitch class.
+ */
+static double		key_profiles[KEY_NUM_KEYS][SEMITONES_PER_OCTAVE];
+static pthread_once_t	key_profiles_once = PTHREAD_ONCE_INIT;
+
+/*
+ * Static function that fills in the normalized profile of every key.
+ */
+static void build_key_profiles(void)
+{
+	double	mean;
+	double	norm;
+	int	mode;
+	int	tonic;
+	int	i;
+
+	for (mode = 0; mode < KEY_NUM_MODES; ++mode) {
+		mean = 0.0;
+		for (i = 0; i < SEMITONES_PER_OCTAVE; ++i) {
+			mean += krumhansl_profiles[mode][i];
+		}
+		mean /= SEMITONES_PER_OCTAVE;
+
+		norm = 0.0;
+		for (i = 0; i < SEMITONES_PER_OCTAVE; ++i) {
+			norm += (krumhansl_profiles[mode][i] - mean) * (krumhansl_profiles[mode][i] - mean);
+		}
+		norm = sqrt(norm);
+
+		for (tonic = C; tonic <= B; ++tonic) {
+			for (i = 0; i < SEMITONES_PER_OCTAVE; ++i) {
+				key_profiles[mode * SEMITONES_PER_OCTAVE + tonic][(tonic + i) % SEMITONES_PER_OCTAVE] =
+					(krumhansl_profiles[mode][i] - mean) / norm;
+			}
+		}
+	}
+}
+
+/*
+ * This function creates a key estimator.  Every frame pushed into it first
+ * multiplies the histogram by decay (0.0 exclusive to 1.0), so smaller values
+ * follow modulations sooner and 1.0 never forgets anything; see
+ * KEY_DEFAULT_DECAY.
+ *
+ * Returns NULL for illegal arguments.  The estimator must be freed with
+ * destroy_key_estimator().
+ */
+struct key_estimator *create_key_estimator(double decay)
+{
+	struct key_estimator	*estimator;
+
+	if (0.0 >= decay || 1.0 < decay) {
+		fprintf(stderr, "decay must be within 0.0 (exclusive) to 1.0\n");
+		return NULL;
+	}
+
+	pthread_once(&key_profiles_once, build_key_profiles);
+
+	estimator = (struct key_estimator *) MALLOC_SAFELY(sizeof(struct key_estimator));
+	estimator->decay = decay;
+	reset_key_estimator(estimator);
+
+	return estimator;
+}
+
+/*
+ * This function frees all memory associated with the key estimator.  It is
+ * safe to call with NULL.
+ */
+void destroy_key_estimator(struct key_estimator *estimator)
+{
+	FREE_SAFELY(estimator);
+}
+
+/*
+ * This function forgets everything pushed into the key estimator so that it
+ * can be reused for a new stream with the same decay.
+ */
+void reset_key_estimator(struct key_estimator *estimator)
+{
+	int	i;
+
+	if (NULL == estimator) {
+		return;
+	}
+
+	for (i = 0; i < SEMITONES_PER_OCTAVE; ++i) {
+		estimator->histogram[i] = 0.0;
+	}
+}
+
+/*
+ * Static function that ages the histogram by one frame.
+ */
+static void decay_histogram(struct key_estimator *estimator)
+{
+	int	i;
+
+	assert(NULL != estimator);
+
+	for (i = 0; i < SEMITONES_PER_OCTAVE; ++i) {
+		estimator->histogram[i] *= estimator->decay;
+	}
+}
+
+/*
+ * This function pushes one frame of detected notes (e.g. the notes a note
+ * detector returned for one hop, or the notes of a chord) into the key
+ * estimator.  Each note adds 1.0 to its pitch class after the histogram is
+ * decayed, and notes with an UNKNOWN_SEMITONE are skipped.  An empty frame
+ * (num_notes of 0) just decays the histogram, e.g. for a rest.
+ *
+ * Returns KEY_ESTIMATOR_SUCCESS_CODE, or KEY_ESTIMATOR_FAILURE_CODE for illegal
+ * arguments.
+ */
+int push_notes_to_key_estimator(struct key_estimator *estimator, const struct note * const notes, long num_notes)
+{
+	long	i;
+
+	if (NULL == estimator || 0 > num_notes || (NULL == notes && 0 < num_notes)) {
+		return KEY_ESTIMATOR_FAILURE_CODE;
+	}
+
+	decay_histogram(estimator);
+	for (i = 0; i < num_notes; ++i) {
+		if (C <= notes[i].semitone && B >= notes[i].semitone) {
+			estimator->histogram[notes[i].semitone] += 1.0;
+		}
+	}
+
+	return KEY_ESTIMATOR_SUCCESS_CODE;
+}
+
+/*
+ * This function pushes chroma frames (CHROMA_NUM_BINS values each, as returned
+ * by get_chromagram_from_file()) into the key estimator, decaying the
+ * histogram before adding each frame.  Negative values are treated as 0.0.
+ *
+ * Returns KEY_ESTIMATOR_SUCCESS_CODE, or KEY_ESTIMATOR_FAILURE_CODE for illegal
+ * arguments.
+ */
+int push_chroma_to_key_estimator(struct key_estimator *estimator, const float * const chroma, long num_frames)
+{
+	long	frame;
+	int	i;
+
+	if (NULL == estimator || NULL == chroma || 0 > num_frames) {
+		return KEY_ESTIMATOR_FAILURE_CODE;
+	}
+
+	for (frame = 0; frame < num_frames; ++frame) {
+		decay_histogram(estimator);
+		for (i = 0; i < CHROMA_NUM_BINS; ++i) {
+			estimator->histogram[i] += MAX(0.0f, chroma[frame * CHROMA_NUM_BINS + i]);
+		}
+	}
+
+	return KEY_ESTIMATOR_SUCCESS_CODE;
+}
+
+/*
+ * This function retrieves the correlation of the histogram with the profile of
+ * every key.  The correlations array must hold KEY_NUM_KEYS values: the major
+ * keys from C to B, then the minor keys from C to B.  A flat (or empty)
+ * histogram correlates with nothing, so every value is 0.0.
+ *
+ * Returns KEY_ESTIMATOR_SUCCESS_CODE, or KEY_ESTIMATOR_FAILURE_CODE for illegal
+ * arguments.
+ */
+int get_key_correlations(const struct key_estimator * const estimator, double *correlations)
+{
+	double	mean;
+	double	norm;
+	double	dot;
+	int	k;
+	int	i;
+
+	if (NULL == estimator || NULL == correlations) {
+		return KEY_ESTIMATOR_FAILURE_CODE;
+	}
+
+	mean = 0.0;
+	for (i = 0; i < SEMITONES_PER_OCTAVE; ++i) {
+		mean += estimator->histogram[i];
+	}
+	mean /= SEMITONES_PER_OCTAVE;
+
+	norm = 0.0;
+	for (i = 0; i < SEMITONES_PER_OCTAVE; ++i) {
+		norm += (estimator->histogram[i] - mean) * (estimator->histogram[i] - mean);
+	}
+	norm = sqrt(norm);
+
+	/*
+	 * The profiles have a mean of 0, so the mean of the histogram drops out
+	 * of the dot product and only its length needs to be taken out.
+	 */
+	for (k = 0; k < KEY_NUM_KEYS; ++k) {
+		if (KEY_FLAT_EPSILON >= norm) {
+			correlations[k] = 0.0;
+			continue;
+		}
+
+		dot = 0.0;
+		for (i = 0; i < SEMITONES_PER_OCTAVE; ++i) {
+			dot += estimator->histogram[i] * key_profiles[k][i];
+		}
+		correlations[k] = dot / norm;
+	}
+
+	return KEY_ESTIMATOR_SUCCESS_CODE;
+}
+
+/*
+ * This function retrieves the key that fits the histogram best.  If nothing
+ * (or every pitch class equally) has been heard, or for illegal arguments, the
+ * tonic is UNKNOWN_SEMITONE, the scale is UNKNOWN_SCALE_TYPE, and the
+ * correlation is 0.0.
+ */
+struct key get_key_estimate(const struct key_estimator * const estimator)
+{
+	struct key	key;
+	double		correlations[KEY_NUM_KEYS];
+	int		best;
+	int		k;
+
+	key.tonic = UNKNOWN_SEMITONE;
+	key.scale = UNKNOWN_SCALE_TYPE;
+	key.correlation = 0.0;
+
+	if (KEY_ESTIMATOR_SUCCESS_CODE != get_key_correlations(estimator, correlations)) {
+		return key;
+	}
+
+	best = 0;
+	for (k = 1; k < KEY_NUM_KEYS; ++k) {
+		if (correlations[k] > correlations[best]) {
+			best = k;
+		}
+	}
+
+	if (0.0 == correlations[best]) {
+		return key;
+	}
+
+	key.tonic = best % SEMITONES_PER_OCTAVE;
+	key.scale = key_scales[best / SEMITONES_PER_OCTAVE];
+	key.correlation = correlations[best];
+
+	return key;
+}
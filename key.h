@@ -0,0 +1,64 @@
+/*
+ *  key.h
+ *
+ *  Copyright (C) 2016  Nathan Bossart
+ */
+
+#ifndef KEY_H
+#define KEY_H
+
+#include "common.h"
+#include "scale.h"
+
+/* return codes for the functions that push into a key estimator */
+#define KEY_ESTIMATOR_SUCCESS_CODE	0
+#define KEY_ESTIMATOR_FAILURE_CODE	-1
+
+/* number of keys estimated (a major and a minor key on every tonic) */
+#define KEY_NUM_KEYS			(2 * SEMITONES_PER_OCTAVE)
+
+/*
+ * Default share of the histogram kept from one frame to the next.  At 0.99,
+ * a frame counts half as much after about 69 frames (a few seconds at the
+ * usual hop sizes).
+ */
+#define KEY_DEFAULT_DECAY		0.99
+
+/*
+ * A key, with how well the pitch classes heard so far fit its profile.
+ *
+ * tonic       : the tonic of the key (UNKNOWN_SEMITONE if nothing was heard)
+ * scale       : MAJOR_SCALE or NATURAL_MINOR_SCALE (UNKNOWN_SCALE_TYPE if
+ *               nothing was heard), so get_scale(scale, tonic) is the
+ *               scale of the key
+ * correlation : the correlation (-1.0 to 1.0) between the histogram and the
+ *               key's profile
+ */
+struct key
+{
+	enum semitone_t	tonic;
+	enum scale_t	scale;
+	double		correlation;
+};
+
+/*
+ * A stateful key estimator for streaming analysis.  Detected notes or chroma
+ * frames are pushed into it as they arrive, and every frame decays a 12-bin
+ * pitch-class histogram and adds to it, so recent frames count the most.  The
+ * key is the major or minor key whose Krumhansl-Kessler profile correlates
+ * best with the histogram.  Every update and every estimate costs the same no
+ * matter how long the stream has run.
+ *
+ * The struct itself is opaque; use the functions below to work with it.
+ */
+struct key_estimator;
+
+struct key_estimator	*create_key_estimator(double decay);
+void			destroy_key_estimator(struct key_estimator *estimator);
+void			reset_key_estimator(struct key_estimator *estimator);
+int			push_notes_to_key_estimator(struct key_estimator *estimator, const struct note * const notes, long num_notes);
+int			push_chroma_to_key_estimator(struct key_estimator *estimator, const float * const chroma, long num_frames);
+struct key		get_key_estimate(const struct key_estimator * const estimator);
+int			get_key_correlations(const struct key_estimator * const estimator, double *correlations);
+
+#endif
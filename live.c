@@ -0,0 +1,306 @@
+/*
+ *  live.c
+ *
+ *  Copyright (C) 2016  Nathan Bossart
+ */
+
+/* needed for nanosleep() under -std=c99 */
+#define _POSIX_C_SOURCE 200809L
+
+#include <assert.h>
+#include "common.h"
+#include "live.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stream.h"
+#include <time.h>
+#include "utils.h"
+
+/* the most notes the analyzer handles for each span of the ring it consumes */
+#define LIVE_NOTES_PER_PUSH	16
+
+/* how long the analyzer sleeps when the ring is empty */
+#define LIVE_IDLE_SLEEP_NS	1000000
+
+/* keeps the producer's and consumer's counters on separate cache lines */
+#define LIVE_CACHE_LINE_SIZE	64
+
+/*
+ * The internal state of a live detector.  head and tail count frames since the
+ * detector was created, and only their low bits (masked by capacity - 1) index
+ * the ring, so the ring is empty when they are equal and full when they are
+ * capacity apart.  Only the producer writes head and dropped, and only the
+ * analyzer writes tail and the result slot.
+ *
+ * num_channels  : number of interleaved channels in each frame
+ * capacity      : number of frames the ring holds (a power of 2)
+ * ring          : capacity interleaved frames
+ * detector      : the note detector the analyzer streams frames through
+ * callback      : called with every detected note (may be NULL)
+ * user_data     : passed to the callback
+ * thread        : the analyzer thread
+ * stop          : tells the analyzer thread to exit
+ * head          : frames pushed so far
+ * dropped       : frames dropped so far because the ring was full
+ * tail          : frames consumed by the analyzer so far
+ * sequence      : twice the number of notes published; odd while the slot is
+ *                 being written
+ * latest        : the most recently detected note
+ */
+struct live_detector
+{
+	int			num_channels;
+	long			capacity;
+	double *		ring;
+	struct note_detector *	detector;
+	live_note_callback_t	callback;
+	void *			user_data;
+	pthread_t		thread;
+	bool			stop;
+	char			producer_padding[LIVE_CACHE_LINE_SIZE];
+	long			head;
+	long			dropped;
+	char			consumer_padding[LIVE_CACHE_LINE_SIZE];
+	long			tail;
+	long			sequence;
+	struct note		latest;
+};
+
+/* function prototypes for static functions */
+static void *	run_analyzer(void *arg);
+static void	publish_note(struct live_detector *live, const struct note * const note);
+
+/*
+ * This function creates a live detector for frames with the given sample rate
+ * and number of interleaved channels and starts its analyzer thread.  A note is
+ * detected over window_size frames for every hop_size frames pushed, exactly
+ * like a note detector created with the same arguments and options (NULL
+ * selects the defaults).  The ring buffer holds at least capacity frames; it
+ * should hold a few hops' worth so that the analyzer can fall behind briefly
+ * without frames being dropped.
+ *
+ * Returns NULL for illegal arguments or if the thread could not be started.
+ * The detector must be freed with destroy_live_detector().
+ */
+struct live_detector *create_live_detector(int sample_rate, int num_channels, long window_size, long hop_size, long capacity, const struct detection_options * const options, live_note_callback_t callback, void *user_data)
+{
+	struct live_detector	*live;
+
+	if (0 >= capacity) {
+		fprintf(stderr, "capacity must be positive\n");
+		return NULL;
+	}
+
+	live = (struct live_detector *) CALLOC_SAFELY(1, sizeof(struct live_detector));
+	if (NULL == (live->detector = create_note_detector(sample_rate, num_channels, window_size, hop_size))) {
+		FREE_SAFELY(live);
+		return NULL;
+	}
+	set_note_detector_options(live->detector, options);
+
+	/* round up to a power of 2 so that indexing is a mask */
+	live->capacity = 1;
+	while (live->capacity < capacity) {
+		live->capacity *= 2;
+	}
+	live->num_channels = num_channels;
+	live->ring = (double *) MALLOC_SAFELY(live->capacity * num_channels * sizeof(double));
+	live->callback = callback;
+	live->user_data = user_data;
+
+	if (0 != pthread_create(&live->thread, NULL, run_analyzer, live)) {
+		fprintf(stderr, "could not start analyzer thread\n");
+		destroy_note_detector(live->detector);
+		FREE_SAFELY(live->ring);
+		FREE_SAFELY(live);
+		return NULL;
+	}
+
+	return live;
+}
+
+/*
+ * This function stops the analyzer thread (discarding any frames it hasn't
+ * consumed yet) and frees all memory associated with the live detector.  It
+ * must not be called while frames are being pushed.  It is safe to call with
+ * NULL.
+ */
+void destroy_live_detector(struct live_detector *live)
+{
+	if (NULL == live) {
+		return;
+	}
+
+	__atomic_store_n(&live->stop, true, __ATOMIC_RELEASE);
+	pthread_join(live->thread, NULL);
+
+	destroy_note_detector(live->detector);
+	FREE_SAFELY(live->ring);
+	FREE_SAFELY(live);
+}
+
+/*
+ * This function copies interleaved frames into the ring buffer of the live
+ * detector for the analyzer thread to pick up.  It never locks, allocates, or
+ * blocks, so it is safe to call from an audio callback, but only one thread may
+ * push frames into a given detector.  If the ring doesn't have room for all the
+ * frames, the ones that don't fit are dropped (and counted; see
+ * get_live_detector_dropped_frames()).
+ *
+ * Returns the number of frames accepted, or -1 for illegal arguments.
+ */
+long push_frames_to_live_detector(struct live_detector *live, const double * const frames, long num_frames)
+{
+	long	head;
+	long	tail;
+	long	accepted;
+	long	offset;
+	long	first;
+
+	if (NULL == live || NULL == frames || 0 > num_frames) {
+		return -1;
+	}
+
+	/* acquire pairs with the analyzer's release, so its reads are done */
+	head = live->head;
+	tail = __atomic_load_n(&live->tail, __ATOMIC_ACQUIRE);
+	accepted = MIN(num_frames, live->capacity - (head - tail));
+
+	/* the free space may wrap around the end of the ring */
+	offset = head & (live->capacity - 1);
+	first = MIN(accepted, live->capacity - offset);
+	memcpy(live->ring + offset * live->num_channels, frames, first * live->num_channels * sizeof(double));
+	memcpy(live->ring, frames + first * live->num_channels, (accepted - first) * live->num_channels * sizeof(double));
+
+	__atomic_store_n(&live->head, head + accepted, __ATOMIC_RELEASE);
+	if (accepted < num_frames) {
+		__atomic_store_n(&live->dropped, live->dropped + num_frames - accepted, __ATOMIC_RELAXED);
+	}
+
+	return accepted;
+}
+
+/*
+ * This function copies the most recently detected note of the live detector
+ * into the note argument without locking, so it can be polled from any thread
+ * (e.g. a UI timer).
+ *
+ * Returns the number of notes detected so far, which tells the caller whether
+ * the note is new since the last call, or -1 for illegal arguments.  If no note
+ * has been detected yet, 0 is returned and note is left alone.
+ */
+long get_latest_live_note(struct live_detector *live, struct note *note)
+{
+	long	before;
+	long	after;
+
+	if (NULL == live || NULL == note) {
+		return -1;
+	}
+
+	/*
+	 * This is the read side of a sequence lock: if the analyzer wrote the
+	 * slot while we were copying it, the sequence changed and we try again.
+	 * The fields are copied with relaxed atomics so a torn copy is never a
+	 * data race.
+	 */
+	do {
+		before = __atomic_load_n(&live->sequence, __ATOMIC_ACQUIRE);
+		if (0 == before) {
+			return 0;
+		}
+		if (before & 1) {
+			continue;
+		}
+		note->semitone = __atomic_load_n(&live->latest.semitone, __ATOMIC_RELAXED);
+		note->octave = __atomic_load_n(&live->latest.octave, __ATOMIC_RELAXED);
+		__atomic_load(&live->latest.cents, &note->cents, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		after = __atomic_load_n(&live->sequence, __ATOMIC_RELAXED);
+	} while ((before & 1) || before != after);
+
+	return before / 2;
+}
+
+/*
+ * This function returns the number of frames the live detector has dropped
+ * because its ring buffer was full, or -1 if live is NULL.
+ */
+long get_live_detector_dropped_frames(struct live_detector *live)
+{
+	if (NULL == live) {
+		return -1;
+	}
+
+	return __atomic_load_n(&live->dropped, __ATOMIC_RELAXED);
+}
+
+/*
+ * Static function that runs the analyzer thread.  It streams whatever frames
+ * are in the ring through the note detector, publishing every note it detects,
+ * and sleeps briefly whenever the ring is empty.
+ */
+static void *run_analyzer(void *arg)
+{
+	struct live_detector	*live;
+	struct note		notes[LIVE_NOTES_PER_PUSH];
+	struct timespec		idle;
+	long			head;
+	long			tail;
+	long			offset;
+	long			consumed;
+	long			notes_returned;
+	long			i;
+
+	live = (struct live_detector *) arg;
+	idle.tv_sec = 0;
+	idle.tv_nsec = LIVE_IDLE_SLEEP_NS;
+
+	while (!__atomic_load_n(&live->stop, __ATOMIC_ACQUIRE)) {
+
+		/* acquire pairs with the producer's release, so the frames are there */
+		head = __atomic_load_n(&live->head, __ATOMIC_ACQUIRE);
+		tail = live->tail;
+		if (head == tail) {
+			nanosleep(&idle, NULL);
+			continue;
+		}
+
+		/* consume up to the end of the ring; the rest is picked up next time */
+		offset = tail & (live->capacity - 1);
+		consumed = push_frames_to_note_detector(live->detector, live->ring + offset * live->num_channels,
+			MIN(head - tail, live->capacity - offset), notes, LIVE_NOTES_PER_PUSH, &notes_returned);
+		for (i = 0; i < notes_returned; ++i) {
+			publish_note(live, &notes[i]);
+		}
+
+		__atomic_store_n(&live->tail, tail + consumed, __ATOMIC_RELEASE);
+	}
+
+	return NULL;
+}
+
+/*
+ * Static function that stores the note in the result slot of the live detector
+ * and hands it to the callback.  This is the write side of the sequence lock
+ * in get_latest_live_note(); only the analyzer thread writes the slot.
+ */
+static void publish_note(struct live_detector *live, const struct note * const note)
+{
+	long	sequence;
+
+	sequence = live->sequence;
+	__atomic_store_n(&live->sequence, sequence + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	__atomic_store_n(&live->latest.semitone, note->semitone, __ATOMIC_RELAXED);
+	__atomic_store_n(&live->latest.octave, note->octave, __ATOMIC_RELAXED);
+	__atomic_store(&live->latest.cents, &note->cents, __ATOMIC_RELAXED);
+	__atomic_store_n(&live->sequence, sequence + 2, __ATOMIC_RELEASE);
+
+	if (NULL != live->callback) {
+		live->callback(note, sequence / 2 + 1, live->user_data);
+	}
+}
@@ -0,0 +1,37 @@
+/*
+ *  live.h
+ *
+ *  Copyright (C) 2016  Nathan Bossart
+ */
+
+#ifndef LIVE_H
+#define LIVE_H
+
+#include "common.h"
+
+/*
+ * A callback that receives every note the analyzer thread of a live detector
+ * detects.  sequence counts the notes detected so far (starting at 1), and
+ * user_data is whatever was passed to create_live_detector().  It is called on
+ * the analyzer thread, never on the thread pushing frames.
+ */
+typedef void (*live_note_callback_t)(const struct note *note, long sequence, void *user_data);
+
+/*
+ * A note detector for live input.  An audio callback pushes frames into a
+ * lock-free single-producer, single-consumer ring buffer, which never locks,
+ * allocates, or blocks, and a background analyzer thread streams them through
+ * a note detector.  Each detected note is published to a lock-free result slot
+ * (see get_latest_live_note()) and handed to the callback, if there is one.
+ *
+ * The struct itself is opaque; use the functions below to work with it.
+ */
+struct live_detector;
+
+struct live_detector	*create_live_detector(int sample_rate, int num_channels, long window_size, long hop_size, long capacity, const struct detection_options * const options, live_note_callback_t callback, void *user_data);
+void			destroy_live_detector(struct live_detector *live);
+long			push_frames_to_live_detector(struct live_detector *live, const double * const frames, long num_frames);
+long			get_latest_live_note(struct live_detector *live, struct note *note);
+long			get_live_detector_dropped_frames(struct live_detector *live);
+
+#endif
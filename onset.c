@@ -0,0 +1,226 @@
+/*
+ *  onset.c
+ *
+ *  Copyright (C) 2016  Nathan Bossart
+ */
+
+#include <assert.h>
+#include <math.h>
+#include "onset.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include "utils.h"
+
+/*
+ * The internal state of an onset detector.
+ *
+ * num_channels : number of interleaved channels in each incoming frame
+ * hop_size     : number of frames in each hop
+ * threshold_db : the rise in energy from one hop to the next for an onset
+ * sum_squares  : the sum of the squared mono samples of the current hop
+ * filled       : the number of frames of the current hop seen so far
+ * position     : the number of frames pushed before the current hop
+ * previous_db  : the energy of the previous hop
+ */
+struct onset_detector
+{
+	int	num_channels;
+	long	hop_size;
+	double	threshold_db;
+	double	sum_squares;
+	long	filled;
+	long	position;
+	double	previous_db;
+};
+
+/* function prototypes for static functions */
+static double	get_mean_square_db(double sum_squares, long num_samples);
+
+/*
+ * This function creates an onset detector for frames with the given number of
+ * interleaved channels.  An onset is reported whenever the energy of a hop of
+ * hop_size frames is at least threshold_db decibels above that of the hop
+ * before it (and isn't silence; see ONSET_SILENCE_DB).  The time resolution of
+ * the onsets is one hop.
+ *
+ * Returns NULL for illegal arguments.  The detector must be freed with
+ * destroy_onset_detector().
+ */
+struct onset_detector *create_onset_detector(int num_channels, long hop_size, double threshold_db)
+{
+	struct onset_detector	*detector;
+
+	if (0 >= num_channels || 0 >= hop_size) {
+		fprintf(stderr, "channel count and hop size must be positive\n");
+		return NULL;
+	}
+
+	if (0.0 >= threshold_db) {
+		fprintf(stderr, "threshold must be positive\n");
+		return NULL;
+	}
+
+	detector = (struct onset_detector *) MALLOC_SAFELY(sizeof(struct onset_detector));
+	detector->num_channels = num_channels;
+	detector->hop_size = hop_size;
+	detector->threshold_db = threshold_db;
+	reset_onset_detector(detector);
+
+	return detector;
+}
+
+/*
+ * This function frees all memory associated with the onset detector.  It is
+ * safe to call with NULL.
+ */
+void destroy_onset_detector(struct onset_detector *detector)
+{
+	FREE_SAFELY(detector);
+}
+
+/*
+ * This function discards the partial hop and the energy history so that the
+ * detector can be reused for a new stream with the same parameters.  Frame
+ * positions start over at zero, and the first loud hop is an onset.
+ */
+void reset_onset_detector(struct onset_detector *detector)
+{
+	if (NULL == detector) {
+		return;
+	}
+
+	detector->sum_squares = 0.0;
+	detector->filled = 0;
+	detector->position = 0;
+	detector->previous_db = ONSET_FLOOR_DB;
+}
+
+/*
+ * This function pushes interleaved frames into the onset detector.  Every time
+ * a hop is complete, its energy is compared with that of the previous hop, and
+ * if it is an onset, the position of its first frame (counting from the first
+ * frame pushed since creating or resetting the detector) is stored in the
+ * onsets array.  Divide by the sample rate to get seconds.  The number of
+ * onsets stored is returned through onsets_returned.
+ *
+ * If the onsets array fills up, this function stops early, right after the hop
+ * with the last onset.  The return value is the number of frames consumed (the
+ * caller should push the rest after handling the onsets), or -1 for illegal
+ * arguments.
+ */
+long push_frames_to_onset_detector(struct onset_detector *detector, const double * const frames, long num_frames, long *onsets, long max_onsets, long *onsets_returned)
+{
+	long	consumed;
+	int	j;
+	double	sum;
+	double	scale;
+	double	energy_db;
+
+	if (NULL == onsets_returned) {
+		fprintf(stderr, "onsets_returned cannot be NULL\n");
+		return -1;
+	}
+	*onsets_returned = 0;
+
+	if (NULL == detector || NULL == frames || 0 > num_frames) {
+		return -1;
+	}
+
+	if (NULL == onsets && 0 < max_onsets) {
+		return -1;
+	}
+
+	scale = 1.0 / detector->num_channels;
+	for (consumed = 0; consumed < num_frames; ++consumed) {
+
+		/* stop if we'd have nowhere to put an onset in the next hop */
+		if (*onsets_returned >= max_onsets && 0 == detector->filled) {
+			break;
+		}
+
+		sum = 0.0;
+		for (j = 0; j < detector->num_channels; ++j) {
+			sum += frames[consumed * detector->num_channels + j];
+		}
+		sum *= scale;
+		detector->sum_squares += sum * sum;
+
+		if (++detector->filled < detector->hop_size) {
+			continue;
+		}
+
+		energy_db = get_mean_square_db(detector->sum_squares, detector->hop_size);
+		if (ONSET_SILENCE_DB < energy_db && energy_db - detector->previous_db >= detector->threshold_db) {
+			onsets[(*onsets_returned)++] = detector->position;
+		}
+
+		detector->previous_db = energy_db;
+		detector->position += detector->hop_size;
+		detector->sum_squares = 0.0;
+		detector->filled = 0;
+	}
+
+	return consumed;
+}
+
+/*
+ * This function returns the energy of the samples (their mean square) in
+ * decibels relative to a full-scale square wave, or ONSET_FLOOR_DB for
+ * silence or illegal arguments.
+ */
+double get_energy_db(const double * const samples, long num_samples)
+{
+	double	sum_squares;
+	long	i;
+
+	if (NULL == samples || 0 >= num_samples) {
+		return ONSET_FLOOR_DB;
+	}
+
+	sum_squares = 0.0;
+	for (i = 0; i < num_samples; ++i) {
+		sum_squares += samples[i] * samples[i];
+	}
+
+	return get_mean_square_db(sum_squares, num_samples);
+}
+
+/*
+ * This function returns the fraction of consecutive pairs of samples that
+ * change sign, which is a rough (but very cheap) measure of how high the
+ * signal is pitched.  Returns 0.0 for illegal arguments.
+ */
+double get_zero_crossing_rate(const double * const samples, long num_samples)
+{
+	long	crossings;
+	long	i;
+
+	if (NULL == samples || 2 > num_samples) {
+		return 0.0;
+	}
+
+	crossings = 0;
+	for (i = 1; i < num_samples; ++i) {
+		crossings += ((0.0 <= samples[i - 1]) != (0.0 <= samples[i]));
+	}
+
+	return (double) crossings / (num_samples - 1);
+}
+
+/*
+ * Static function that converts a sum of squares over num_samples samples to
+ * decibels, clamped to ONSET_FLOOR_DB.
+ */
+static double get_mean_square_db(double sum_squares, long num_samples)
+{
+	double	energy_db;
+
+	assert(0 < num_samples);
+
+	if (0.0 >= sum_squares) {
+		return ONSET_FLOOR_DB;
+	}
+
+	energy_db = 10.0 * log10(sum_squares / num_samples);
+	return MAX(ONSET_FLOOR_DB, energy_db);
+}
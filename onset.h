@@ -0,0 +1,37 @@
+/*
+ *  onset.h
+ *
+ *  Copyright (C) 2016  Nathan Bossart
+ */
+
+#ifndef ONSET_H
+#define ONSET_H
+
+/* default rise in energy (in decibels) from one hop to the next for an onset */
+#define ONSET_DEFAULT_THRESHOLD_DB	6.0
+
+/* hops quieter than this (in decibels relative to full scale) are silence */
+#define ONSET_SILENCE_DB		-60.0
+
+/* the energy reported for digital silence instead of negative infinity */
+#define ONSET_FLOOR_DB			-120.0
+
+/*
+ * A stateful onset detector for streaming audio.  Frames are pushed into the
+ * detector in blocks of any size, and the energy of every hop_size frames is
+ * compared with that of the hop before it.  It takes no FFT, so it is cheap
+ * enough to run on every hop of a stream and decide when the (much more
+ * expensive) pitch and chord detection is worth running.
+ *
+ * The struct itself is opaque; use the functions below to work with it.
+ */
+struct onset_detector;
+
+struct onset_detector	*create_onset_detector(int num_channels, long hop_size, double threshold_db);
+void			destroy_onset_detector(struct onset_detector *detector);
+void			reset_onset_detector(struct onset_detector *detector);
+long			push_frames_to_onset_detector(struct onset_detector *detector, const double * const frames, long num_frames, long *onsets, long max_onsets, long *onsets_returned);
+double			get_energy_db(const double * const samples, long num_samples);
+double			get_zero_crossing_rate(const double * const samples, long num_samples);
+
+#endif
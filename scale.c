@@ -0,0 +1,183 @@
+/*
+ *  scale.c
+ *
+ *  Copyright (C) 2016  Nathan Bossart
+ */
+
+#include <assert.h>
+#include "common.h"
+#include <pthread.h>
+#include "scale.h"
+#include <stdbool.h>
+#include <stdio.h>
+
+/* number of kinds of scales */
+#define NUM_SCALE_TYPES		UNKNOWN_SCALE_TYPE
+
+/* every semitone in a set of semitones */
+#define ALL_SEMITONES_MASK	(SEMITONE_BIT(SEMITONES_PER_OCTAVE) - 1)
+
+/* function prototypes for static functions */
+static unsigned	rotate_scale_mask(unsigned mask, int semitones);
+static void	build_scale_table(void);
+
+/*
+ * The semitones of every kind of scale with a tonic of C, in the order of
+ * enum scale_t.  Each of the church modes is the major scale started on a
+ * different degree and moved back to C.
+ */
+static const unsigned scale_masks[NUM_SCALE_TYPES] = {
+	/* IONIAN_SCALE */
+	SEMITONE_BIT(C) | SEMITONE_BIT(D) | SEMITONE_BIT(E) | SEMITONE_BIT(F) | SEMITONE_BIT(G) | SEMITONE_BIT(A) | SEMITONE_BIT(B),
+	/* DORIAN_SCALE */
+	SEMITONE_BIT(C) | SEMITONE_BIT(D) | SEMITONE_BIT(Eb) | SEMITONE_BIT(F) | SEMITONE_BIT(G) | SEMITONE_BIT(A) | SEMITONE_BIT(Bb),
+	/* PHRYGIAN_SCALE */
+	SEMITONE_BIT(C) | SEMITONE_BIT(Db) | SEMITONE_BIT(Eb) | SEMITONE_BIT(F) | SEMITONE_BIT(G) | SEMITONE_BIT(Ab) | SEMITONE_BIT(Bb),
+	/* LYDIAN_SCALE */
+	SEMITONE_BIT(C) | SEMITONE_BIT(D) | SEMITONE_BIT(E) | SEMITONE_BIT(Gb) | SEMITONE_BIT(G) | SEMITONE_BIT(A) | SEMITONE_BIT(B),
+	/* MIXOLYDIAN_SCALE */
+	SEMITONE_BIT(C) | SEMITONE_BIT(D) | SEMITONE_BIT(E) | SEMITONE_BIT(F) | SEMITONE_BIT(G) | SEMITONE_BIT(A) | SEMITONE_BIT(Bb),
+	/* AEOLIAN_SCALE */
+	SEMITONE_BIT(C) | SEMITONE_BIT(D) | SEMITONE_BIT(Eb) | SEMITONE_BIT(F) | SEMITONE_BIT(G) | SEMITONE_BIT(Ab) | SEMITONE_BIT(Bb),
+	/* LOCRIAN_SCALE */
+	SEMITONE_BIT(C) | SEMITONE_BIT(Db) | SEMITONE_BIT(Eb) | SEMITONE_BIT(F) | SEMITONE_BIT(Gb) | SEMITONE_BIT(Ab) | SEMITONE_BIT(Bb),
+	/* HARMONIC_MINOR_SCALE */
+	SEMITONE_BIT(C) | SEMITONE_BIT(D) | SEMITONE_BIT(Eb) | SEMITONE_BIT(F) | SEMITONE_BIT(G) | SEMITONE_BIT(Ab) | SEMITONE_BIT(B),
+	/* MELODIC_MINOR_SCALE */
+	SEMITONE_BIT(C) | SEMITONE_BIT(D) | SEMITONE_BIT(Eb) | SEMITONE_BIT(F) | SEMITONE_BIT(G) | SEMITONE_BIT(A) | SEMITONE_BIT(B),
+	/* MAJOR_PENTATONIC_SCALE */
+	SEMITONE_BIT(C) | SEMITONE_BIT(D) | SEMITONE_BIT(E) | SEMITONE_BIT(G) | SEMITONE_BIT(A),
+	/* MINOR_PENTATONIC_SCALE */
+	SEMITONE_BIT(C) | SEMITONE_BIT(Eb) | SEMITONE_BIT(F) | SEMITONE_BIT(G) | SEMITONE_BIT(Bb),
+	/* BLUES_SCALE */
+	SEMITONE_BIT(C) | SEMITONE_BIT(Eb) | SEMITONE_BIT(F) | SEMITONE_BIT(Gb) | SEMITONE_BIT(G) | SEMITONE_BIT(Bb),
+	/* WHOLE_TONE_SCALE */
+	SEMITONE_BIT(C) | SEMITONE_BIT(D) | SEMITONE_BIT(E) | SEMITONE_BIT(Gb) | SEMITONE_BIT(Ab) | SEMITONE_BIT(Bb),
+	/* OCTATONIC_WHOLE_HALF_SCALE */
+	SEMITONE_BIT(C) | SEMITONE_BIT(D) | SEMITONE_BIT(Eb) | SEMITONE_BIT(F) | SEMITONE_BIT(Gb) | SEMITONE_BIT(Ab) | SEMITONE_BIT(A) | SEMITONE_BIT(B),
+	/* OCTATONIC_HALF_WHOLE_SCALE */
+	SEMITONE_BIT(C) | SEMITONE_BIT(Db) | SEMITONE_BIT(Eb) | SEMITONE_BIT(E) | SEMITONE_BIT(Gb) | SEMITONE_BIT(G) | SEMITONE_BIT(A) | SEMITONE_BIT(Bb),
+	/* CHROMATIC_SCALE */
+	ALL_SEMITONES_MASK
+};
+
+/*
+ * Every scale of every kind on every tonic, worked out once so that looking
+ * one up (or checking whether a note is in it) never allocates or loops.
+ */
+static struct scale	scale_table[NUM_SCALE_TYPES][SEMITONES_PER_OCTAVE];
+static pthread_once_t	scale_table_once = PTHREAD_ONCE_INIT;
+
+/*
+ * Static function that transposes a set of semitones up by the given number of
+ * semitones (0 to SEMITONES_PER_OCTAVE), wrapping B around to C.
+ */
+static unsigned rotate_scale_mask(unsigned mask, int semitones)
+{
+	assert(0 <= semitones && SEMITONES_PER_OCTAVE >= semitones);
+
+	mask = (mask << semitones) | (mask >> (SEMITONES_PER_OCTAVE - semitones));
+
+	return mask & ALL_SEMITONES_MASK;
+}
+
+/*
+ * Static function that fills in the scale table from the scales with a tonic
+ * of C.  The steps of each scale are its semitones in ascending order,
+ * starting at the tonic.
+ */
+static void build_scale_table(void)
+{
+	struct scale	*scale;
+	int		type;
+	int		tonic;
+	int		i;
+	int		semitone;
+
+	for (type = 0; type < NUM_SCALE_TYPES; ++type) {
+		for (tonic = C; tonic <= B; ++tonic) {
+			scale = &scale_table[type][tonic];
+			scale->scale = type;
+			scale->tonic = tonic;
+			scale->mask = rotate_scale_mask(scale_masks[type], tonic);
+			scale->length = 0;
+
+			for (i = 0; i < SEMITONES_PER_OCTAVE; ++i) {
+				semitone = (tonic + i) % SEMITONES_PER_OCTAVE;
+				if (scale->mask & SEMITONE_BIT(semitone)) {
+					scale->degrees[semitone] = scale->length;
+					scale->steps[scale->length++] = semitone;
+				} else {
+					scale->degrees[semitone] = NOT_IN_SCALE;
+				}
+			}
+			scale->steps[scale->length] = UNKNOWN_SEMITONE;
+		}
+	}
+}
+
+/*
+ * This function retrieves the scale of the given kind on the given tonic.  The
+ * scale belongs to a table that is built the first time this is called (from
+ * any thread) and never changes afterwards, so it must not be freed or
+ * modified.
+ *
+ * Returns NULL for illegal arguments.
+ */
+const struct scale *get_scale(enum scale_t scale_type, enum semitone_t tonic)
+{
+	if (0 > (int) scale_type || NUM_SCALE_TYPES <= scale_type) {
+		fprintf(stderr, "invalid scale type '%d'\n", scale_type);
+		return NULL;
+	}
+
+	if (C > tonic || B < tonic) {
+		fprintf(stderr, "invalid tonic '%d'\n", tonic);
+		return NULL;
+	}
+
+	pthread_once(&scale_table_once, build_scale_table);
+
+	return &scale_table[scale_type][tonic];
+}
+
+/*
+ * This function checks whether the semitone is in the scale with a single
+ * test of the scale's mask.  Returns false for illegal arguments.
+ */
+bool is_semitone_in_scale(const struct scale * const scale, enum semitone_t semitone)
+{
+	if (NULL == scale || C > semitone || B < semitone) {
+		return false;
+	}
+
+	return 0 != (scale->mask & SEMITONE_BIT(semitone));
+}
+
+/*
+ * This function checks whether every semitone in the mask (one bit per
+ * semitone, e.g. a chord) is in the scale.  An empty mask is always in the
+ * scale.  Returns false for illegal arguments.
+ */
+bool are_semitones_in_scale(const struct scale * const scale, unsigned mask)
+{
+	if (NULL == scale || 0 != (mask & ~ALL_SEMITONES_MASK)) {
+		return false;
+	}
+
+	return 0 == (mask & ~scale->mask);
+}
+
+/*
+ * This function returns the degree of the semitone in the scale, counting the
+ * tonic as 0 (so the dominant of a major scale is 4).  Returns NOT_IN_SCALE if
+ * the semitone isn't in the scale or for illegal arguments.
+ */
+int get_scale_degree(const struct scale * const scale, enum semitone_t semitone)
+{
+	if (NULL == scale || C > semitone || B < semitone) {
+		return NOT_IN_SCALE;
+	}
+
+	return scale->degrees[semitone];
+}
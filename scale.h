@@ -0,0 +1,81 @@
+/*
+ *  scale.h
+ *
+ *  Copyright (C) 2016  Nathan Bossart
+ */
+
+#ifndef SCALE_H
+#define SCALE_H
+
+#include "common.h"
+#include <stdbool.h>
+
+/* the most semitones in a scale (the chromatic scale has them all) */
+#define SCALE_MAX_LENGTH	SEMITONES_PER_OCTAVE
+
+/* degree of a semitone that isn't in the scale */
+#define NOT_IN_SCALE		-1
+
+/*
+ * The kinds of scales.  The seven church modes come first, in the order of
+ * the degree of the major scale they start on (so IONIAN_SCALE is the major
+ * scale and AEOLIAN_SCALE is the natural minor scale).
+ *
+ * MELODIC_MINOR_SCALE        : the ascending form
+ * BLUES_SCALE                : the minor pentatonic scale plus the flat fifth
+ * OCTATONIC_WHOLE_HALF_SCALE : alternating whole and half steps
+ * OCTATONIC_HALF_WHOLE_SCALE : alternating half and whole steps
+ */
+enum scale_t
+{
+	IONIAN_SCALE,
+	DORIAN_SCALE,
+	PHRYGIAN_SCALE,
+	LYDIAN_SCALE,
+	MIXOLYDIAN_SCALE,
+	AEOLIAN_SCALE,
+	LOCRIAN_SCALE,
+	HARMONIC_MINOR_SCALE,
+	MELODIC_MINOR_SCALE,
+	MAJOR_PENTATONIC_SCALE,
+	MINOR_PENTATONIC_SCALE,
+	BLUES_SCALE,
+	WHOLE_TONE_SCALE,
+	OCTATONIC_WHOLE_HALF_SCALE,
+	OCTATONIC_HALF_WHOLE_SCALE,
+	CHROMATIC_SCALE,
+	UNKNOWN_SCALE_TYPE
+};
+
+/* the usual names of the first and sixth church modes */
+#define MAJOR_SCALE		IONIAN_SCALE
+#define NATURAL_MINOR_SCALE	AEOLIAN_SCALE
+
+/*
+ * A scale with a given tonic.  Every scale lives in a table that is built on
+ * first use (see get_scale()), so nothing needs to be allocated or freed.
+ *
+ * scale   : the kind of scale
+ * tonic   : the first semitone of the scale
+ * mask    : the semitones in the scale, one bit each (see SEMITONE_BIT())
+ * length  : the number of semitones in the scale
+ * steps   : the semitones in the scale in ascending order from the tonic,
+ *           terminated by UNKNOWN_SEMITONE
+ * degrees : the index in steps of each semitone, or NOT_IN_SCALE
+ */
+struct scale
+{
+	enum scale_t	scale;
+	enum semitone_t	tonic;
+	unsigned	mask;
+	int		length;
+	enum semitone_t	steps[SCALE_MAX_LENGTH + 1];
+	int		degrees[SEMITONES_PER_OCTAVE];
+};
+
+const struct scale	*get_scale(enum scale_t scale_type, enum semitone_t tonic);
+bool			is_semitone_in_scale(const struct scale * const scale, enum semitone_t semitone);
+bool			are_semitones_in_scale(const struct scale * const scale, unsigned mask);
+int			get_scale_degree(const struct scale * const scale, enum semitone_t semitone);
+
+#endif
@@ -0,0 +1,181 @@
+/*
+ *  singleprec.c
+ *
+ *  Copyright (C) 2016  Nathan Bossart
+ */
+
+#include "common.h"
+#include "dsp.h"
+#include "fft.h"
+#include <fftw3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "singleprec.h"
+#include "source.h"
+#include "utils.h"
+
+/*
+ * The single-precision counterpart of get_samples_from_file().
+ */
+float *get_samples_from_file_float(const char * const filename, long frames_requested, long *frames_returned)
+{
+	struct tonedef_source	*source;
+	float			*ret;
+
+	if (NULL == frames_returned) {
+		fprintf(stderr, "frames_returned cannot be NULL\n");
+		return NULL;
+	}
+	*frames_returned = -1;
+
+	if (NULL == filename) {
+		return NULL;
+	}
+
+	if (0 >= frames_requested) {
+		return NULL;
+	}
+
+	if (NULL == (source = open_source(filename))) {
+		return NULL;
+	}
+
+	ret = (float *) MALLOC_SAFELY(frames_requested * get_source_num_channels(source) * sizeof(float));
+	*frames_returned = read_float_frames_from_source(source, ret, frames_requested);
+	close_source(source);
+
+	return ret;
+}
+
+/*
+ * The single-precision counterpart of apply_hann_function().
+ */
+float *apply_hann_function_float(const float * const samples, long num_samples)
+{
+	long		i;
+	float		*ret;
+	const float	*window;
+
+	if (NULL == samples) {
+		return NULL;
+	}
+
+	if (0 > num_samples) {
+		return NULL;
+	}
+
+	window = get_hann_window_float(num_samples);
+	ret = (float *) MALLOC_SAFELY(num_samples * sizeof(float));
+	for (i = 0; i < num_samples; ++i) {
+		ret[i] = samples[i] * window[i];
+	}
+
+	return ret;
+}
+
+/*
+ * The single-precision counterpart of get_fft().  The returned array holds the
+ * num_samples / 2 + 1 meaningful bins of the real-input transform.
+ */
+fftwf_complex *get_fft_float(float *samples, long num_samples)
+{
+	fftwf_complex *	ret;
+	fftwf_plan	plan;
+
+	if (NULL == samples) {
+		return NULL;
+	}
+
+	if (0 > num_samples) {
+		return NULL;
+	}
+
+	ret = (fftwf_complex *) MALLOC_SAFELY((num_samples / 2 + 1) * sizeof(fftwf_complex));
+	if (NULL == (plan = get_r2c_plan_float(num_samples, samples, ret))) {
+		FREE_SAFELY(ret);
+		return NULL;
+	}
+
+	fftwf_execute_dft_r2c(plan, samples, ret);
+
+	return ret;
+}
+
+/*
+ * The single-precision counterpart of get_note_from_file().  Only the samples,
+ * window, and transform are single-precision; the frequency (and therefore the
+ * note) is still computed in double precision.
+ */
+struct note get_note_from_file_float(const char * const filename, double secs_to_sample)
+{
+	int		sample_rate;
+	int		num_channels;
+	long		sample_num_of_highest_magnitude;
+	long		samples_returned;
+	long		num_samples;
+	float *		samples;
+	float *		hannd_samples;
+	struct note	invalid_note;
+	fftwf_complex *	fft_samples;
+	fftwf_plan	plan;
+	struct tonedef_source *	source;
+
+	/* initialize as invalid note for error checking purposes */
+	invalid_note.semitone	= UNKNOWN_SEMITONE;
+	invalid_note.octave	= INVALID_OCTAVE;
+	invalid_note.cents	= INVALID_CENTS;
+
+	if (NULL == filename) {
+		fprintf(stderr, "filename is null\n");
+		return invalid_note;
+	}
+
+	if (0.0 >= secs_to_sample) {
+		fprintf(stderr, "secs_to_sample is less than zero\n");
+		return invalid_note;
+	}
+
+	if (NULL == (source = open_source(filename))) {
+		fprintf(stderr, "could not open sound file; does the file exist?\n");
+		return invalid_note;
+	}
+	sample_rate = get_source_sample_rate(source);
+	num_channels = get_source_num_channels(source);
+
+	num_samples = secs_to_sample * sample_rate;
+	if (0 >= num_samples || num_samples > get_source_num_frames(source)) {
+		fprintf(stderr, "file does not contain the requested number of samples\n");
+		close_source(source);
+		return invalid_note;
+	}
+
+	samples = (float *) MALLOC_SAFELY(num_samples * num_channels * sizeof(float));
+	samples_returned = read_float_frames_from_source(source, samples, num_samples);
+	close_source(source);
+	if (num_samples != samples_returned) {
+		fprintf(stderr, "could not retrieve requested number of samples from file\n");
+		FREE_SAFELY(samples);
+		return invalid_note;
+	}
+
+	/* mix down and window in one pass, straight into the FFT input */
+	hannd_samples = (float *) detect_oom(fftwf_malloc(num_samples * sizeof(float)));
+	mix_down_and_window_float(samples, num_samples, num_channels, get_hann_window_float(num_samples), hannd_samples);
+	FREE_SAFELY(samples);
+
+	fft_samples = (fftwf_complex *) detect_oom(fftwf_malloc((num_samples / 2 + 1) * sizeof(fftwf_complex)));
+	if (NULL == (plan = get_r2c_plan_float(num_samples, hannd_samples, fft_samples))) {
+		fprintf(stderr, "could not calculate fft\n");
+		fftwf_free(hannd_samples);
+		fftwf_free(fft_samples);
+		return invalid_note;
+	}
+	fftwf_execute_dft_r2c(plan, hannd_samples, fft_samples);
+	fftwf_free(hannd_samples);
+
+	sample_num_of_highest_magnitude = get_peak_of_spectrum_float(fft_samples, num_samples / 2 + 1, NULL);
+	fftwf_free(fft_samples);
+
+	/* see get_note_from_file() for why this is the frequency */
+	return get_exact_note(sample_num_of_highest_magnitude / secs_to_sample);
+}
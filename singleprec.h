@@ -0,0 +1,25 @@
+/*
+ *  singleprec.h
+ *
+ *  Copyright (C) 2016  Nathan Bossart
+ */
+
+#ifndef SINGLEPREC_H
+#define SINGLEPREC_H
+
+#include "common.h"
+#include <fftw3.h>
+
+/*
+ * Single-precision counterparts of the analysis functions in common.h.  They
+ * are built on sf_readf_float() and the fftwf_* API and detect notes exactly
+ * the same way, but move half as many bytes through memory and let FFTW use
+ * twice as many lanes per SIMD instruction.  32-bit floats are more than
+ * precise enough for pitch detection.
+ */
+float *		get_samples_from_file_float(const char * const filename, long frames_requested, long *frames_returned);
+float *		apply_hann_function_float(const float * const samples, long num_samples);
+fftwf_complex *	get_fft_float(float *samples, long num_samples);
+struct note	get_note_from_file_float(const char * const filename, double secs_to_sample);
+
+#endif
@@ -0,0 +1,530 @@
+/*
+ *  source.c
+ *
+ *  Copyright (C) 2016  Nathan Bossart
+ */
+
+/* needed for mmap(), open(), and fstat() under -std=c99 */
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <sndfile.h>
+#include "source.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "utils.h"
+
+/* format tags from the fmt chunk of a RIFF/WAVE file */
+#define WAVE_FORMAT_PCM		0x0001
+#define WAVE_FORMAT_IEEE_FLOAT	0x0003
+#define WAVE_FORMAT_EXTENSIBLE	0xFFFE
+
+/* the sizes of the RIFF/WAVE structures we parse */
+#define RIFF_HEADER_SIZE	12
+#define CHUNK_HEADER_SIZE	8
+#define FMT_CHUNK_MIN_SIZE	16
+#define FMT_EXTENSIBLE_SIZE	40
+
+/* the factors libsndfile divides by when normalizing integer samples */
+#define PCM_16_SCALE		(1.0 / 0x8000)
+#define PCM_24_SCALE		(1.0 / 0x800000)
+
+/*
+ * The internal state of an audio source.
+ *
+ * file            : the libsndfile handle, or NULL if the file is mapped
+ * sfinfo          : the metadata parsed from the header when opening
+ * map             : the memory-mapped file, or NULL if libsndfile reads it
+ * map_size        : the length of the mapping in bytes
+ * data            : the first frame of the data chunk within the mapping
+ * encoding        : the encoding of the mapped samples
+ * bytes_per_frame : the size of one interleaved mapped frame
+ * position        : the index of the next mapped frame to read
+ */
+struct tonedef_source
+{
+	SNDFILE			*file;
+	SF_INFO			sfinfo;
+	unsigned char		*map;
+	size_t			map_size;
+	const unsigned char	*data;
+	enum sample_encoding_t	encoding;
+	long			bytes_per_frame;
+	long			position;
+};
+
+static bool	open_file(struct tonedef_source *source, const char * const filename);
+static void	close_file(struct tonedef_source *source);
+static bool	map_wave_file(struct tonedef_source *source, const char * const filename);
+static bool	parse_wave_header(struct tonedef_source *source);
+static uint16_t	get_le_16(const unsigned char * const bytes);
+static uint32_t	get_le_32(const unsigned char * const bytes);
+
+/*
+ * This function opens the sound file for reading.  Uncompressed PCM16, PCM24,
+ * and 32-bit float WAV files are memory-mapped and read in place; everything
+ * else goes through libsndfile.
+ *
+ * Returns NULL if the file doesn't exist or isn't a sound file we can read.
+ * The source must be closed with close_source().
+ */
+struct tonedef_source *open_source(const char * const filename)
+{
+	struct tonedef_source *source;
+
+	if (NULL == filename) {
+		fprintf(stderr, "filename is null\n");
+		return NULL;
+	}
+
+	source = (struct tonedef_source *) MALLOC_SAFELY(sizeof(struct tonedef_source));
+	if (!open_file(source, filename)) {
+		FREE_SAFELY(source);
+		return NULL;
+	}
+
+	return source;
+}
+
+/*
+ * This function closes the sound file the source has open (if any) and opens
+ * another one in its place, so that a source can be reused for many files
+ * without allocating a new one each time.
+ *
+ * Returns SOURCE_FAILURE_CODE if the file doesn't exist or isn't a sound file
+ * we can read.  The source then has no file open (reading from it fails), but
+ * it can still be reopened or closed.
+ */
+int reopen_source(struct tonedef_source *source, const char * const filename)
+{
+	if (NULL == source) {
+		return SOURCE_FAILURE_CODE;
+	}
+
+	close_file(source);
+
+	if (NULL == filename) {
+		fprintf(stderr, "filename is null\n");
+		return SOURCE_FAILURE_CODE;
+	}
+
+	if (!open_file(source, filename)) {
+		return SOURCE_FAILURE_CODE;
+	}
+
+	return SOURCE_SUCCESS_CODE;
+}
+
+/*
+ * This function closes the sound file and frees the source.  It is safe to call
+ * with NULL.
+ */
+void close_source(struct tonedef_source *source)
+{
+	if (NULL == source) {
+		return;
+	}
+
+	close_file(source);
+	FREE_SAFELY(source);
+}
+
+/*
+ * This function returns the sample rate of the source, or -1 if source is NULL.
+ */
+int get_source_sample_rate(const struct tonedef_source * const source)
+{
+	if (NULL == source) {
+		return -1;
+	}
+
+	return source->sfinfo.samplerate;
+}
+
+/*
+ * This function returns the number of interleaved channels in each frame of the
+ * source, or -1 if source is NULL.
+ */
+int get_source_num_channels(const struct tonedef_source * const source)
+{
+	if (NULL == source) {
+		return -1;
+	}
+
+	return source->sfinfo.channels;
+}
+
+/*
+ * This function returns the total number of frames in the source, or -1 if
+ * source is NULL.
+ */
+long get_source_num_frames(const struct tonedef_source * const source)
+{
+	if (NULL == source) {
+		return -1;
+	}
+
+	return source->sfinfo.frames;
+}
+
+/*
+ * This function returns true if the source is memory-mapped, in which case its
+ * frames can be used in place with map_frames_from_source().
+ */
+bool is_source_mapped(const struct tonedef_source * const source)
+{
+	return NULL != source && NULL != source->map;
+}
+
+/*
+ * This function reads up to num_frames interleaved frames from the current
+ * position of the source directly into the frames argument, which must have
+ * room for num_frames * get_source_num_channels() samples.
+ *
+ * Returns the number of frames read (fewer than num_frames only at the end of
+ * the file), or -1 for illegal arguments.
+ */
+long read_frames_from_source(struct tonedef_source *source, double *frames, long num_frames)
+{
+	const unsigned char	*bytes;
+	long			frames_read;
+	long			i;
+	long			sample_size;
+	sf_count_t		rd_cnt;
+
+	if (NULL == source || NULL == frames || 0 > num_frames) {
+		return -1;
+	}
+
+	/* mapped samples are converted straight from the page cache */
+	if (NULL != source->map) {
+		bytes = map_frames_from_source(source, num_frames, &frames_read, NULL);
+		sample_size = get_encoded_sample_size(source->encoding);
+		for (i = 0; i < frames_read * source->sfinfo.channels; ++i) {
+			frames[i] = decode_encoded_sample(bytes + i * sample_size, source->encoding);
+		}
+		return frames_read;
+	}
+
+	if (NULL == source->file) {
+		return -1;
+	}
+
+	frames_read = 0;
+	while (frames_read < num_frames && 0 < (rd_cnt = sf_readf_double(source->file,
+			frames + frames_read * source->sfinfo.channels, num_frames - frames_read))) {
+		frames_read += rd_cnt;
+	}
+
+	return frames_read;
+}
+
+/*
+ * The single-precision counterpart of read_frames_from_source().  libsndfile
+ * converts straight to float, so there is no double-precision intermediate.
+ */
+long read_float_frames_from_source(struct tonedef_source *source, float *frames, long num_frames)
+{
+	const unsigned char	*bytes;
+	long			frames_read;
+	long			i;
+	long			sample_size;
+	sf_count_t		rd_cnt;
+
+	if (NULL == source || NULL == frames || 0 > num_frames) {
+		return -1;
+	}
+
+	if (NULL != source->map) {
+		bytes = map_frames_from_source(source, num_frames, &frames_read, NULL);
+		sample_size = get_encoded_sample_size(source->encoding);
+		for (i = 0; i < frames_read * source->sfinfo.channels; ++i) {
+			frames[i] = (float) decode_encoded_sample(bytes + i * sample_size, source->encoding);
+		}
+		return frames_read;
+	}
+
+	if (NULL == source->file) {
+		return -1;
+	}
+
+	frames_read = 0;
+	while (frames_read < num_frames && 0 < (rd_cnt = sf_readf_float(source->file,
+			frames + frames_read * source->sfinfo.channels, num_frames - frames_read))) {
+		frames_read += rd_cnt;
+	}
+
+	return frames_read;
+}
+
+/*
+ * This function exposes up to num_frames interleaved frames from the current
+ * position of a memory-mapped source without copying or converting them, and
+ * advances the position past them.  The number of frames available (fewer than
+ * num_frames only at the end of the file) is stored in frames_mapped, and the
+ * encoding of the samples is stored in encoding if it isn't NULL.  The bytes
+ * stay valid until the source is reopened or closed.
+ *
+ * Returns NULL if the source isn't memory-mapped or for illegal arguments; use
+ * read_frames_from_source() instead in that case.
+ */
+const unsigned char *map_frames_from_source(struct tonedef_source *source, long num_frames, long *frames_mapped, enum sample_encoding_t *encoding)
+{
+	const unsigned char *ret;
+
+	if (NULL == frames_mapped) {
+		return NULL;
+	}
+	*frames_mapped = 0;
+
+	if (NULL == source || NULL == source->map || 0 > num_frames) {
+		return NULL;
+	}
+
+	ret = source->data + source->position * source->bytes_per_frame;
+	*frames_mapped = MIN(num_frames, source->sfinfo.frames - source->position);
+	source->position += *frames_mapped;
+
+	if (NULL != encoding) {
+		*encoding = source->encoding;
+	}
+
+	return ret;
+}
+
+/*
+ * This function returns the number of bytes in one sample of the encoding.
+ */
+long get_encoded_sample_size(enum sample_encoding_t encoding)
+{
+	switch(encoding) {
+	case(PCM_16_ENCODING):
+		return 2;
+	case(PCM_24_ENCODING):
+		return 3;
+	default:
+		return 4;
+	}
+}
+
+/*
+ * This function converts one little-endian sample of the encoding (e.g. from
+ * map_frames_from_source()) to a double, normalizing integer samples to
+ * [-1.0, 1.0) the way libsndfile does.
+ */
+double decode_encoded_sample(const unsigned char * const bytes, enum sample_encoding_t encoding)
+{
+	int32_t		value;
+	uint32_t	bits;
+	float		sample;
+
+	switch(encoding) {
+	case(PCM_16_ENCODING):
+		value = get_le_16(bytes);
+		if (value & 0x8000) {
+			value -= 0x10000;
+		}
+		return value * PCM_16_SCALE;
+	case(PCM_24_ENCODING):
+		value = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16);
+		if (value & 0x800000) {
+			value -= 0x1000000;
+		}
+		return value * PCM_24_SCALE;
+	default:
+		bits = get_le_32(bytes);
+		memcpy(&sample, &bits, sizeof(sample));
+		return sample;
+	}
+}
+
+/*
+ * Static function that opens the file for the source, preferring the
+ * memory-mapped reader and falling back to libsndfile for anything it doesn't
+ * handle.
+ *
+ * Returns false if neither can read the file.
+ */
+static bool open_file(struct tonedef_source *source, const char * const filename)
+{
+	memset(source, 0, sizeof(struct tonedef_source));
+
+	if (map_wave_file(source, filename)) {
+		return true;
+	}
+
+	if (NULL == (source->file = sf_open(filename, SFM_READ, &(source->sfinfo)))) {
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Static function that releases whatever the source has open and leaves it
+ * with no file, so that reads fail until it is reopened.
+ */
+static void close_file(struct tonedef_source *source)
+{
+	if (NULL != source->file) {
+		sf_close(source->file);
+	}
+	if (NULL != source->map) {
+		munmap(source->map, source->map_size);
+	}
+	memset(source, 0, sizeof(struct tonedef_source));
+}
+
+/*
+ * Static function that maps the file into memory and parses its header.  The
+ * file descriptor is closed right away, since the mapping keeps the file open.
+ *
+ * Returns false (leaving nothing mapped) if the file can't be mapped or isn't
+ * a WAV file the memory-mapped reader handles.
+ */
+static bool map_wave_file(struct tonedef_source *source, const char * const filename)
+{
+	int		fd;
+	struct stat	st;
+	void		*map;
+
+	if (-1 == (fd = open(filename, O_RDONLY))) {
+		return false;
+	}
+
+	if (-1 == fstat(fd, &st) || !S_ISREG(st.st_mode) || CHUNK_HEADER_SIZE + RIFF_HEADER_SIZE > st.st_size) {
+		close(fd);
+		return false;
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (MAP_FAILED == map) {
+		return false;
+	}
+
+	source->map = (unsigned char *) map;
+	source->map_size = st.st_size;
+	if (!parse_wave_header(source)) {
+		munmap(map, st.st_size);
+		memset(source, 0, sizeof(struct tonedef_source));
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Static function that walks the chunks of the mapped RIFF/WAVE file, skipping
+ * any it doesn't need (e.g. JUNK or LIST), and fills in the metadata and data
+ * pointer of the source from the fmt and data chunks.
+ *
+ * Returns false if the file isn't a PCM16, PCM24, or 32-bit float WAV file.
+ */
+static bool parse_wave_header(struct tonedef_source *source)
+{
+	const unsigned char	*chunk;
+	const unsigned char	*end;
+	uint32_t		chunk_size;
+	uint16_t		format;
+	uint16_t		bits_per_sample;
+	uint16_t		block_align;
+	bool			have_fmt;
+
+	if (0 != memcmp(source->map, "RIFF", 4) || 0 != memcmp(source->map + 8, "WAVE", 4)) {
+		return false;
+	}
+
+	have_fmt = false;
+	format = 0;
+	bits_per_sample = 0;
+	block_align = 0;
+	end = source->map + source->map_size;
+	chunk = source->map + RIFF_HEADER_SIZE;
+	while (CHUNK_HEADER_SIZE <= end - chunk) {
+		chunk_size = get_le_32(chunk + 4);
+
+		if (0 == memcmp(chunk, "fmt ", 4)) {
+			if (FMT_CHUNK_MIN_SIZE > chunk_size || (long) chunk_size > end - chunk - CHUNK_HEADER_SIZE) {
+				return false;
+			}
+			format = get_le_16(chunk + 8);
+			source->sfinfo.channels = get_le_16(chunk + 10);
+			source->sfinfo.samplerate = get_le_32(chunk + 12);
+			block_align = get_le_16(chunk + 20);
+			bits_per_sample = get_le_16(chunk + 22);
+
+			/* the real format tag is the start of the sub-format GUID */
+			if (WAVE_FORMAT_EXTENSIBLE == format) {
+				if (FMT_EXTENSIBLE_SIZE > chunk_size) {
+					return false;
+				}
+				format = get_le_16(chunk + 32);
+			}
+			have_fmt = true;
+		} else if (0 == memcmp(chunk, "data", 4)) {
+			if (!have_fmt) {
+				return false;
+			}
+
+			/* streamed files may not have filled in the size */
+			if ((long) chunk_size > end - chunk - CHUNK_HEADER_SIZE) {
+				chunk_size = end - chunk - CHUNK_HEADER_SIZE;
+			}
+			source->data = chunk + CHUNK_HEADER_SIZE;
+			source->sfinfo.frames = (0 < block_align) ? chunk_size / block_align : 0;
+			break;
+		}
+
+		/* chunks are padded to an even number of bytes */
+		if ((long) (chunk_size + (chunk_size & 1)) > end - chunk - CHUNK_HEADER_SIZE) {
+			return false;
+		}
+		chunk += CHUNK_HEADER_SIZE + chunk_size + (chunk_size & 1);
+	}
+
+	if (NULL == source->data || 0 >= source->sfinfo.channels || 0 >= source->sfinfo.samplerate) {
+		return false;
+	}
+
+	if (WAVE_FORMAT_PCM == format && 16 == bits_per_sample) {
+		source->encoding = PCM_16_ENCODING;
+	} else if (WAVE_FORMAT_PCM == format && 24 == bits_per_sample) {
+		source->encoding = PCM_24_ENCODING;
+	} else if (WAVE_FORMAT_IEEE_FLOAT == format && 32 == bits_per_sample) {
+		source->encoding = FLOAT_32_ENCODING;
+	} else {
+		return false;
+	}
+
+	/* we only handle tightly packed frames */
+	source->bytes_per_frame = block_align;
+	if (source->sfinfo.channels * (bits_per_sample / 8) != block_align) {
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Static function that reads a little-endian 16-bit integer.
+ */
+static uint16_t get_le_16(const unsigned char * const bytes)
+{
+	return (uint16_t) (bytes[0] | (bytes[1] << 8));
+}
+
+/*
+ * Static function that reads a little-endian 32-bit integer.
+ */
+static uint32_t get_le_32(const unsigned char * const bytes)
+{
+	return (uint32_t) bytes[0] | ((uint32_t) bytes[1] << 8)
+		| ((uint32_t) bytes[2] << 16) | ((uint32_t) bytes[3] << 24);
+}
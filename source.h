@@ -0,0 +1,47 @@
+/*
+ *  source.h
+ *
+ *  Copyright (C) 2016  Nathan Bossart
+ */
+
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include <stdbool.h>
+
+/* return codes for reopen_source() */
+#define SOURCE_SUCCESS_CODE	0
+#define SOURCE_FAILURE_CODE	-1
+
+/* the sample encodings the memory-mapped WAV reader exposes in place */
+enum sample_encoding_t
+{
+	PCM_16_ENCODING,	/* signed 16-bit little-endian integers */
+	PCM_24_ENCODING,	/* signed 24-bit little-endian integers */
+	FLOAT_32_ENCODING	/* 32-bit little-endian IEEE floats */
+};
+
+/*
+ * An open sound file that frames can be read from.  The file is opened (and
+ * its header parsed) exactly once, and frames are read straight into buffers
+ * owned by the caller.  Uncompressed PCM16, PCM24, and 32-bit float WAV files
+ * are memory-mapped instead, so their frames can also be used in place.
+ *
+ * The struct itself is opaque; use the functions below to work with it.
+ */
+struct tonedef_source;
+
+struct tonedef_source	*open_source(const char * const filename);
+int			reopen_source(struct tonedef_source *source, const char * const filename);
+void			close_source(struct tonedef_source *source);
+int			get_source_sample_rate(const struct tonedef_source * const source);
+int			get_source_num_channels(const struct tonedef_source * const source);
+long			get_source_num_frames(const struct tonedef_source * const source);
+long			read_frames_from_source(struct tonedef_source *source, double *frames, long num_frames);
+long			read_float_frames_from_source(struct tonedef_source *source, float *frames, long num_frames);
+bool			is_source_mapped(const struct tonedef_source * const source);
+const unsigned char	*map_frames_from_source(struct tonedef_source *source, long num_frames, long *frames_mapped, enum sample_encoding_t *encoding);
+long			get_encoded_sample_size(enum sample_encoding_t encoding);
+double			decode_encoded_sample(const unsigned char * const bytes, enum sample_encoding_t encoding);
+
+#endif
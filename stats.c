@@ -0,0 +1,38 @@
+/*
+ *  stats.c
+ *
+ *  Copyright (C) 2016  Nathan Bossart
+ */
+
+/* for clock_gettime() */
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdlib.h>
+#include <string.h>
+#include "stats.h"
+#include <time.h>
+
+/*
+ * This function zeroes all the counters of the stats.
+ */
+void reset_detection_stats(struct detection_stats *stats)
+{
+	if (NULL == stats) {
+		return;
+	}
+
+	memset(stats, 0, sizeof(struct detection_stats));
+}
+
+/*
+ * This function returns a monotonic timestamp in nanoseconds.  Only the
+ * difference between two timestamps means anything.
+ */
+long long get_timestamp_ns(void)
+{
+	struct timespec	now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
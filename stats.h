@@ -0,0 +1,59 @@
+/*
+ *  stats.h
+ *
+ *  Copyright (C) 2016  Nathan Bossart
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+/*
+ * Where the time (and memory) of note detection goes.  Point the stats member
+ * of struct detection_options at one of these to have it filled in; every
+ * analysis adds to it, so it can be kept for a single call or for a whole
+ * note detector (see reset_detection_stats()).
+ *
+ * calls       : number of analyses (sound files or detector windows)
+ * decode_ns   : nanoseconds spent opening and decoding the sound file
+ * mixdown_ns  : nanoseconds spent mixing the channels down to one (and, where
+ *               the two are fused into one pass, applying the window)
+ * window_ns   : nanoseconds spent applying the window on its own
+ * fft_ns      : nanoseconds spent getting a plan for and running the FFT
+ * peak_ns     : nanoseconds spent finding and refining the peak (or running
+ *               YIN, which also covers its own FFTs)
+ * bytes_read  : bytes of samples read from the file (as stored, for
+ *               memory-mapped files, or decoded otherwise) or pushed into
+ *               the detector
+ * allocations : heap allocations made by the library
+ * fft_size    : length of the most recent FFT
+ * gated       : detector windows the onset gate skipped (see onset_gating in
+ *               struct detection_options); these aren't counted in calls
+ */
+struct detection_stats
+{
+	long		calls;
+	long long	decode_ns;
+	long long	mixdown_ns;
+	long long	window_ns;
+	long long	fft_ns;
+	long long	peak_ns;
+	long long	bytes_read;
+	long		allocations;
+	long		fft_size;
+	long		gated;
+};
+
+/* the start of a stage for ADD_STAGE_TIME() (no timestamp is taken if stats is NULL) */
+#define GET_STAGE_START(stats)			((NULL != (stats)) ? get_timestamp_ns() : 0)
+
+/* adds the time since start to the stage member of stats (if it isn't NULL) */
+#define ADD_STAGE_TIME(stats, stage, start)	do {								\
+							if (NULL != (stats)) {					\
+								(stats)->stage += get_timestamp_ns() - (start);	\
+							}							\
+						} while (0)
+
+void		reset_detection_stats(struct detection_stats *stats);
+long long	get_timestamp_ns(void);
+
+#endif
@@ -0,0 +1,563 @@
+/*
+ *  stream.c
+ *
+ *  Copyright (C) 2016  Nathan Bossart
+ */
+
+#include <assert.h>
+#include "common.h"
+#include "dsp.h"
+#include "fft.h"
+#include <fftw3.h>
+#include <math.h>
+#include "onset.h"
+#include "source.h"
+#include "stats.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "stream.h"
+#include "utils.h"
+
+/*
+ * The internal state of a note detector.
+ *
+ * sample_rate     : sample rate of the incoming frames
+ * num_channels    : number of interleaved channels in each incoming frame
+ * window_size     : number of (mono) samples in each analysis window
+ * hop_size        : number of frames between the starts of two windows
+ * window          : the mono samples buffered for the next analysis window
+ * buffered        : the number of samples currently held in window
+ * frames_to_skip  : frames to drop before buffering again (hop > window)
+ * hann            : cached Hann function table of length window_size
+ * fft_in          : FFTW input buffer (the windowed samples)
+ * fft_out         : FFTW output buffer (window_size / 2 + 1 bins)
+ * previous_out    : the spectrum of the previous window (same size as fft_out)
+ * have_previous   : whether previous_out holds the window one hop back
+ * plan            : cached FFTW plan matching fft_in and fft_out
+ * options         : detection options (see set_note_detector_options())
+ * have_note       : whether last_note holds the note of an analyzed window
+ * last_note       : the note of the most recently analyzed window
+ * onsets          : onset detector fed the mono samples (with onset gating)
+ * onset_pending   : whether there has been an onset since last_note
+ * gate_energy_db  : energy of the newest hop when last_note was analyzed
+ * gate_crossings  : zero-crossing rate of the whole window at the same time
+ * windows_gated   : windows skipped in a row since last_note was analyzed
+ */
+struct note_detector
+{
+	int		sample_rate;
+	int		num_channels;
+	long		window_size;
+	long		hop_size;
+	double *	window;
+	long		buffered;
+	long		frames_to_skip;
+	const double *	hann;
+	double *	fft_in;
+	fftw_complex *	fft_out;
+	fftw_complex *	previous_out;
+	bool		have_previous;
+	fftw_plan	plan;
+	struct detection_options	options;
+	bool		have_note;
+	struct note	last_note;
+	struct onset_detector *	onsets;
+	bool		onset_pending;
+	double		gate_energy_db;
+	double		gate_crossings;
+	long		windows_gated;
+};
+
+/*
+ * The relative change in zero-crossing rate at which the onset gate takes the
+ * signal to have changed pitch, even though its energy hasn't changed.  A
+ * semitone is a change of about 6% in frequency, so this is about a third of
+ * one.
+ */
+#define GATE_CROSSING_CHANGE	0.02
+
+/*
+ * The most windows the onset gate skips in a row, so that a pitch drifting too
+ * slowly to trip it is still followed.
+ */
+#define GATE_MAX_WINDOWS_GATED	8
+
+/* onsets taken from the onset detector in one call */
+#define GATE_MAX_ONSETS		8
+
+/* function prototypes for static functions */
+static void		push_to_onset_detector(struct note_detector *detector, long num_samples);
+static bool		gate_window(struct note_detector *detector);
+static struct note	analyze_window(struct note_detector *detector);
+
+/*
+ * This function creates a note detector for frames with the given sample rate
+ * and number of interleaved channels.  A note is detected over window_size
+ * frames for every hop_size frames pushed into the detector.
+ *
+ * Returns NULL for illegal arguments.  The detector must be freed with
+ * destroy_note_detector().
+ */
+struct note_detector *create_note_detector(int sample_rate, int num_channels, long window_size, long hop_size)
+{
+	struct note_detector	*detector;
+
+	if (0 >= sample_rate || 0 >= num_channels) {
+		fprintf(stderr, "sample rate and channel count must be positive\n");
+		return NULL;
+	}
+
+	/* the Hann function is undefined for windows of less than 2 samples */
+	if (2 > window_size || 0 >= hop_size) {
+		fprintf(stderr, "window size must be at least 2 and hop size must be positive\n");
+		return NULL;
+	}
+
+	detector = (struct note_detector *) MALLOC_SAFELY(sizeof(struct note_detector));
+	detector->sample_rate	= sample_rate;
+	detector->num_channels	= num_channels;
+	detector->window_size	= window_size;
+	detector->hop_size	= hop_size;
+	detector->buffered	= 0;
+	detector->frames_to_skip = 0;
+	detector->have_previous	= false;
+	detector->have_note	= false;
+	detector->onset_pending	= false;
+	detector->windows_gated	= 0;
+	init_detection_options(&detector->options);
+
+	/* the window buffer is already mono, so that's what the onsets are found in */
+	detector->onsets = create_onset_detector(1, hop_size, ONSET_DEFAULT_THRESHOLD_DB);
+
+	detector->window = (double *) MALLOC_SAFELY(window_size * sizeof(double));
+
+	/* the Hann function only depends on the window size, so do it once */
+	detector->hann = get_hann_window(window_size);
+
+	detector->fft_in = (double *) detect_oom(fftw_malloc(window_size * sizeof(double)));
+	detector->fft_out = (fftw_complex *) detect_oom(fftw_malloc((window_size / 2 + 1) * sizeof(fftw_complex)));
+	detector->previous_out = (fftw_complex *) detect_oom(fftw_malloc((window_size / 2 + 1) * sizeof(fftw_complex)));
+	detector->plan = get_r2c_plan(window_size, detector->fft_in, detector->fft_out);
+	if (NULL == detector->plan) {
+		fprintf(stderr, "could not plan fft\n");
+		destroy_note_detector(detector);
+		return NULL;
+	}
+
+	return detector;
+}
+
+/*
+ * This function frees all memory associated with the note detector.  It is
+ * safe to call with NULL.
+ */
+void destroy_note_detector(struct note_detector *detector)
+{
+	if (NULL == detector) {
+		return;
+	}
+
+	/* the plan and Hann table are cached, so we don't free them here */
+	fftw_free(detector->fft_in);
+	fftw_free(detector->fft_out);
+	fftw_free(detector->previous_out);
+	destroy_onset_detector(detector->onsets);
+	FREE_SAFELY(detector->window);
+	FREE_SAFELY(detector);
+}
+
+/*
+ * This function discards any buffered frames so that the detector can be
+ * reused for a new stream with the same parameters.
+ */
+void reset_note_detector(struct note_detector *detector)
+{
+	if (NULL == detector) {
+		return;
+	}
+
+	detector->buffered = 0;
+	detector->frames_to_skip = 0;
+	detector->have_previous = false;
+	detector->have_note = false;
+	detector->onset_pending = false;
+	detector->windows_gated = 0;
+	reset_onset_detector(detector->onsets);
+}
+
+/*
+ * This function changes the detection options of the note detector.  NULL
+ * restores the defaults (see init_detection_options()).
+ *
+ * With PHASE_VOCODER_INTERPOLATION, the frequency is refined from the phase
+ * advance between consecutive windows, which requires hop_size to be at most
+ * half of window_size.  Otherwise (and for the first window after creating or
+ * resetting the detector) GAUSSIAN_INTERPOLATION is used instead.
+ *
+ * If the options have stats, every window (and every frame pushed) adds to
+ * them until the options are changed again, so they must outlive that.
+ */
+void set_note_detector_options(struct note_detector *detector, const struct detection_options * const options)
+{
+	if (NULL == detector) {
+		return;
+	}
+
+	if (NULL == options) {
+		init_detection_options(&detector->options);
+	} else {
+		detector->options = *options;
+	}
+}
+
+/*
+ * Static function that feeds the num_samples mono samples most recently added
+ * to the detector's window buffer to its onset detector, and remembers whether
+ * any of them started an onset.
+ */
+static void push_to_onset_detector(struct note_detector *detector, long num_samples)
+{
+	const double	*samples;
+	long		onsets[GATE_MAX_ONSETS];
+	long		onsets_returned;
+	long		pushed;
+
+	assert(NULL != detector);
+	assert(num_samples <= detector->buffered);
+
+	samples = detector->window + detector->buffered - num_samples;
+	while (0 < num_samples) {
+		pushed = push_frames_to_onset_detector(detector->onsets, samples, num_samples,
+			onsets, GATE_MAX_ONSETS, &onsets_returned);
+		if (0 < onsets_returned) {
+			detector->onset_pending = true;
+		}
+		samples += pushed;
+		num_samples -= pushed;
+	}
+}
+
+/*
+ * Static function that decides whether the detector's (full) window needs to
+ * be analyzed at all.  With onset gating, the window is analyzed if:
+ *
+ * - the onset detector has found an onset since the last analysis
+ * - the energy of the newest hop has risen or fallen by
+ *   ONSET_DEFAULT_THRESHOLD_DB since the last analysis (e.g. a note dying away)
+ * - the zero-crossing rate of the whole window has changed by
+ *   GATE_CROSSING_CHANGE since the last analysis (a new pitch at the same level)
+ * - GATE_MAX_WINDOWS_GATED windows in a row have been skipped already
+ *
+ * The zero-crossing rate is taken over the whole window, like the analysis
+ * itself, so that a change is followed until the window holds nothing else,
+ * and so that a semitone is several crossings even for low notes.  All of this
+ * costs a pass over the window, which is far cheaper than an FFT and a peak
+ * search.
+ *
+ * Returns true if the window can be skipped (the previous note still holds).
+ */
+static bool gate_window(struct note_detector *detector)
+{
+	const double	*newest;
+	long		span;
+	double		energy_db;
+	double		crossings;
+
+	assert(NULL != detector);
+
+	if (!detector->options.onset_gating) {
+		return false;
+	}
+
+	span = MIN(detector->hop_size, detector->window_size);
+	newest = detector->window + detector->window_size - span;
+	energy_db = get_energy_db(newest, span);
+	crossings = get_zero_crossing_rate(detector->window, detector->window_size);
+
+	if (detector->have_note
+			&& !detector->onset_pending
+			&& GATE_MAX_WINDOWS_GATED > detector->windows_gated
+			&& ONSET_DEFAULT_THRESHOLD_DB > fabs(energy_db - detector->gate_energy_db)
+			&& GATE_CROSSING_CHANGE * detector->gate_crossings >= fabs(crossings - detector->gate_crossings)) {
+		if (NULL != detector->options.stats) {
+			++detector->options.stats->gated;
+		}
+		++detector->windows_gated;
+
+		/* the phase vocoder needs the spectrum of the window one hop back */
+		detector->have_previous = false;
+		return true;
+	}
+
+	detector->onset_pending = false;
+	detector->gate_energy_db = energy_db;
+	detector->gate_crossings = crossings;
+	detector->windows_gated = 0;
+	return false;
+}
+
+/*
+ * Static function that detects the note in the detector's (full) window
+ * buffer.  The strongest bin of the FFT is taken as the frequency of the note,
+ * just like get_note_from_file(), and refined according to the detector's
+ * options (or, with YIN_METHOD, the window is handed to get_yin_frequency()).
+ * If the options have stats, the time spent in each stage is added to them.
+ */
+static struct note analyze_window(struct note_detector *detector)
+{
+	long			i;
+	long			maximum_index;
+	long			num_bins;
+	long			allocations;
+	long long		start;
+	double			peak;
+	double			freq;
+	fftw_complex		*spectrum;
+	struct note		ret;
+	struct detection_stats	*stats;
+
+	assert(NULL != detector);
+	assert(detector->buffered == detector->window_size);
+
+	stats = detector->options.stats;
+	allocations = get_allocation_count();
+	if (NULL != stats) {
+		++stats->calls;
+		stats->fft_size = detector->window_size;
+	}
+
+	/*
+	 * YIN works on the raw samples, so there's no spectrum to keep, and the
+	 * FFT buffers can be its scratch space.  Silent or unvoiced windows have
+	 * no YIN frequency, and so give an invalid note.
+	 */
+	if (YIN_METHOD == detector->options.method) {
+		detector->have_previous = false;
+		ret.semitone	= UNKNOWN_SEMITONE;
+		ret.octave	= INVALID_OCTAVE;
+		ret.cents	= INVALID_CENTS;
+		start = GET_STAGE_START(stats);
+		freq = get_yin_frequency_with_scratch(detector->window, detector->window_size,
+			detector->sample_rate, detector->options.yin_threshold,
+			detector->fft_in, detector->fft_out, detector->previous_out);
+		if (INVALID_FREQUENCY != freq) {
+			ret = get_exact_note(freq);
+		}
+		ADD_STAGE_TIME(stats, peak_ns, start);
+		if (NULL != stats) {
+			stats->allocations += get_allocation_count() - allocations;
+		}
+		return ret;
+	}
+
+	start = GET_STAGE_START(stats);
+	for (i = 0; i < detector->window_size; ++i) {
+		detector->fft_in[i] = detector->window[i] * detector->hann[i];
+	}
+	ADD_STAGE_TIME(stats, window_ns, start);
+
+	start = GET_STAGE_START(stats);
+	fftw_execute_dft_r2c(detector->plan, detector->fft_in, detector->fft_out);
+	ADD_STAGE_TIME(stats, fft_ns, start);
+
+	/* a real-input FFT only yields window_size / 2 + 1 meaningful bins */
+	start = GET_STAGE_START(stats);
+	num_bins = detector->window_size / 2 + 1;
+	maximum_index = get_peak_of_spectrum(detector->fft_out, num_bins, NULL);
+
+	if (PHASE_VOCODER_INTERPOLATION == detector->options.interpolation
+			&& detector->have_previous
+			&& detector->window_size >= 2 * detector->hop_size) {
+		peak = interpolate_peak_by_phase(detector->previous_out, detector->fft_out,
+			maximum_index, detector->window_size, detector->hop_size);
+	} else {
+		peak = interpolate_peak(detector->fft_out, num_bins, maximum_index,
+			detector->options.interpolation);
+	}
+	ADD_STAGE_TIME(stats, peak_ns, start);
+
+	/* keep this spectrum around for the next window's phase */
+	spectrum = detector->previous_out;
+	detector->previous_out = detector->fft_out;
+	detector->fft_out = spectrum;
+	detector->have_previous = (detector->hop_size < detector->window_size);
+
+	if (NULL != stats) {
+		stats->allocations += get_allocation_count() - allocations;
+	}
+
+	return get_exact_note(peak * detector->sample_rate / detector->window_size);
+}
+
+/*
+ * This function pushes interleaved frames into the note detector.  Every time
+ * a full window is available, a note is detected and stored in the notes array
+ * and the window is advanced by hop_size frames.  The number of notes stored is
+ * returned through notes_returned.
+ *
+ * If the notes array fills up before all the frames have been consumed, this
+ * function stops early.  The return value is the number of frames consumed
+ * (the caller should push the rest after handling the notes), or -1 for
+ * illegal arguments.
+ */
+long push_frames_to_note_detector(struct note_detector *detector, const double * const frames, long num_frames, struct note *notes, long max_notes, long *notes_returned)
+{
+	long		consumed;
+	long		to_copy;
+	long long	start;
+	int		num_channels;
+
+	if (NULL == notes_returned) {
+		fprintf(stderr, "notes_returned cannot be NULL\n");
+		return -1;
+	}
+	*notes_returned = 0;
+
+	if (NULL == detector || NULL == frames || 0 > num_frames) {
+		return -1;
+	}
+
+	if (NULL == notes && 0 < max_notes) {
+		return -1;
+	}
+
+	num_channels = detector->num_channels;
+	consumed = 0;
+	while (consumed < num_frames) {
+
+		/* with a hop larger than the window, some frames are never used */
+		if (0 < detector->frames_to_skip) {
+			to_copy = MIN(detector->frames_to_skip, num_frames - consumed);
+			detector->frames_to_skip -= to_copy;
+			consumed += to_copy;
+			continue;
+		}
+
+		/* stop if we'd have nowhere to put the next note */
+		if (detector->buffered == detector->window_size && *notes_returned >= max_notes) {
+			break;
+		}
+
+		/* mix down as many frames as fit in the window buffer */
+		start = GET_STAGE_START(detector->options.stats);
+		to_copy = MIN(detector->window_size - detector->buffered, num_frames - consumed);
+		mix_down_and_window(frames + consumed * num_channels, to_copy, num_channels,
+			NULL, detector->window + detector->buffered);
+		ADD_STAGE_TIME(detector->options.stats, mixdown_ns, start);
+		if (NULL != detector->options.stats) {
+			detector->options.stats->bytes_read += to_copy * num_channels * sizeof(double);
+		}
+		detector->buffered += to_copy;
+		consumed += to_copy;
+		if (detector->options.onset_gating) {
+			push_to_onset_detector(detector, to_copy);
+		}
+
+		if (detector->buffered < detector->window_size) {
+			continue;
+		}
+
+		if (*notes_returned >= max_notes) {
+			break;
+		}
+
+		if (!gate_window(detector)) {
+			detector->last_note = analyze_window(detector);
+			detector->have_note = true;
+		}
+		notes[(*notes_returned)++] = detector->last_note;
+
+		/* slide the window forward by one hop */
+		if (detector->hop_size < detector->window_size) {
+			memmove(detector->window, detector->window + detector->hop_size,
+				(detector->window_size - detector->hop_size) * sizeof(double));
+			detector->buffered -= detector->hop_size;
+		} else {
+			detector->frames_to_skip = detector->hop_size - detector->window_size;
+			detector->buffered = 0;
+		}
+	}
+
+	return consumed;
+}
+
+/*
+ * This function detects a note every hop_size frames over the whole sound file,
+ * using windows of window_size frames.  The file is opened only once and is
+ * streamed through a single note detector.  The returned array is allocated on
+ * the heap and holds one note per hop; its length is stored in notes_returned.
+ *
+ * Returns NULL for illegal arguments or if the file could not be read.
+ */
+struct note *get_note_track_from_file(const char * const filename, long window_size, long hop_size, long *notes_returned)
+{
+	struct tonedef_source	*source;
+	struct note_detector	*detector;
+	struct note		*ret;
+	double			*buf;
+	int			num_channels;
+	long			num_frames;
+	long			max_notes;
+	long			rd_cnt;
+	long			consumed;
+	long			pushed;
+	long			new_notes;
+
+	if (NULL == notes_returned) {
+		fprintf(stderr, "notes_returned cannot be NULL\n");
+		return NULL;
+	}
+	*notes_returned = -1;
+
+	if (NULL == filename) {
+		return NULL;
+	}
+
+	if (NULL == (source = open_source(filename))) {
+		return NULL;
+	}
+	num_channels = get_source_num_channels(source);
+	num_frames = get_source_num_frames(source);
+
+	if (NULL == (detector = create_note_detector(get_source_sample_rate(source), num_channels, window_size, hop_size))) {
+		close_source(source);
+		return NULL;
+	}
+
+	/* we get one note for the first window and one for every hop after */
+	max_notes = 0;
+	if (num_frames >= window_size) {
+		max_notes = (num_frames - window_size) / hop_size + 1;
+	}
+	ret = (struct note *) MALLOC_SAFELY((max_notes + 1) * sizeof(struct note));
+	*notes_returned = 0;
+
+	/* read a hop at a time so that every read yields at most one new note */
+	buf = (double *) MALLOC_SAFELY(hop_size * num_channels * sizeof(double));
+	while (0 < (rd_cnt = read_frames_from_source(source, buf, hop_size))) {
+
+		pushed = 0;
+		while (pushed < rd_cnt) {
+			consumed = push_frames_to_note_detector(detector, buf + pushed * num_channels,
+				rd_cnt - pushed, ret + *notes_returned, max_notes - *notes_returned, &new_notes);
+			*notes_returned += new_notes;
+
+			/* we've got every note we expected, so we're done */
+			if (0 >= consumed) {
+				break;
+			}
+			pushed += consumed;
+		}
+
+		if (pushed < rd_cnt) {
+			break;
+		}
+	}
+	FREE_SAFELY(buf);
+	destroy_note_detector(detector);
+	close_source(source);
+
+	return ret;
+}
@@ -0,0 +1,30 @@
+/*
+ *  stream.h
+ *
+ *  Copyright (C) 2016  Nathan Bossart
+ */
+
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "common.h"
+
+/*
+ * A stateful note detector for streaming audio.  Frames are pushed into the
+ * detector in blocks of any size, and a note is detected every time hop_size
+ * new frames have arrived (once the first window_size frames are buffered).
+ * The window buffer, Hann table, and FFT plan are allocated once when the
+ * detector is created and reused for every frame of analysis.
+ *
+ * The struct itself is opaque; use the functions below to work with it.
+ */
+struct note_detector;
+
+struct note_detector	*create_note_detector(int sample_rate, int num_channels, long window_size, long hop_size);
+void			destroy_note_detector(struct note_detector *detector);
+void			reset_note_detector(struct note_detector *detector);
+void			set_note_detector_options(struct note_detector *detector, const struct detection_options * const options);
+long			push_frames_to_note_detector(struct note_detector *detector, const double * const frames, long num_frames, struct note *notes, long max_notes, long *notes_returned);
+struct note *		get_note_track_from_file(const char * const filename, long window_size, long hop_size, long *notes_returned);
+
+#endif
@@ -4,6 +4,9 @@
  *  Copyright (C) 2016  Nathan Bossart
  */
 
+/* for mkstemp() and fdopen() */
+#define _POSIX_C_SOURCE 200809L
+
 #include <assert.h>
 #include <fftw3.h>
 #include <math.h>
@@ -11,6 +14,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include "tonedef.h"
 
 #define HALF_SECOND_SAMPLE_COUNT		22050
@@ -30,6 +34,13 @@
 							note.cents = cent;	\
 						}
 
+/* records the sequence number of the last note handed to a live callback */
+static void record_live_note(const struct note *note, long sequence, void *user_data)
+{
+	assert(NULL != note);
+	*((long *) user_data) = sequence;
+}
+
 int main(int argc, const char *argv[])
 {
 	double bogus_samples[1];
@@ -46,8 +57,62 @@ int main(int argc, const char *argv[])
 	enum semitone_t e_chromatic_scale[] = {E, F, Gb, G, Ab, A, Bb, B, C, Db, D, Eb, UNKNOWN_SEMITONE};
 	enum semitone_t a_harmonic_minor_scale[] = {A, B, C, D, E, F, Ab, UNKNOWN_SEMITONE};
 	enum semitone_t g_melodic_minor_scale[] = {G, A, Bb, C, D, E, Gb, UNKNOWN_SEMITONE};
+	enum semitone_t d_dorian_scale[] = {D, E, F, G, A, B, C, UNKNOWN_SEMITONE};
+	enum semitone_t a_blues_scale[] = {A, C, D, Eb, E, G, UNKNOWN_SEMITONE};
+	enum semitone_t db_octatonic_scale[] = {Db, D, E, F, G, Ab, Bb, B, UNKNOWN_SEMITONE};
+	const struct scale *scale_info;
 	struct chord chord;
 	struct note_node node, node2, node3, node4;
+	struct note *note_track;
+	struct note_detector *detector;
+	long notes_returned;
+	struct tonedef_source *source;
+	struct live_detector *live;
+	struct onset_detector *onset_detector;
+	long onsets[4];
+	float *chroma;
+	long live_sequence, i;
+	clock_t live_start;
+	const unsigned char *mapped_frames;
+	enum sample_encoding_t encoding;
+	FILE *wav_file;
+	char mapped_filename[] = "/tmp/tonedef-mapped-XXXXXX";
+	int mapped_fd;
+	long peaks[4];
+	double peak_powers[4];
+	char low_filename[] = "/tmp/tonedef-low-XXXXXX";
+	unsigned char low_wav_header[44];
+	float low_wav_sample;
+	unsigned char float_wav[] = {'R', 'I', 'F', 'F', 44, 0, 0, 0, 'W', 'A', 'V', 'E',
+		'f', 'm', 't', ' ', 16, 0, 0, 0, 3, 0, 1, 0, 0x40, 0x1f, 0, 0, 0, 0x7d, 0, 0, 4, 0, 32, 0,
+		'd', 'a', 't', 'a', 8, 0, 0, 0, 0, 0, 0, 0x3f, 0, 0, 0x80, 0xbe};
+	const double *hann_window;
+	double mixed_samples[24];
+	double peak_power;
+	float *wav_samples_float, *wav_samples_float_hannd;
+	fftwf_complex *fft_output_float;
+	const char *batch_filenames[] = {"a4.wav", "g#5-piano.wav", "does_not_exist.wav", "f4-piano.wav", "a4.wav", NULL, "f4-piano.wav"};
+	struct note batch_results[7];
+	struct note notes_from_file[8];
+	struct detection_options options;
+	struct detection_stats stats;
+	struct tonedef_workspace *workspace;
+	double *fft_input;
+	fftw_complex *fft_output, *fft_output_2;
+	const struct cqt_kernel *cqt_kernel;
+	double *cqt;
+	long cqt_bins;
+	struct note expected_notes[VERIFY_MAX_NOTES + 1];
+	struct note_verdict verdicts[VERIFY_MAX_NOTES + 1];
+	double lowest_freq, highest_freq;
+	struct key_estimator *key_estimator;
+	struct key key;
+	double key_correlations[KEY_NUM_KEYS], key_correlation_sum;
+	float key_chroma[2 * CHROMA_NUM_BINS];
+	struct chord_candidate chord_candidates[3 * 4];
+	unsigned chord_masks[3];
+	enum semitone_t chord_basses[3];
+	int num_chord_candidates[3];
 
 	LOG("get_exact_note");
 
@@ -70,6 +135,49 @@ int main(int argc, const char *argv[])
 
 	test_note = get_approx_note(15.0);
 	assert(test_note.semitone == UNKNOWN_SEMITONE && test_note.octave == -1 && DOUBLE_EQUALS(test_note.cents, -255.0));
+	test_note = get_approx_note(2016.15);
+	assert(test_note.semitone == B && test_note.octave == 6 && DOUBLE_EQUALS(test_note.cents, 0.0));
+
+	LOG("get_exact_notes");
+
+	assert(NULL != (wav_samples = (double *) malloc(1000 * sizeof(double))));
+	assert(NULL != (note_track = (struct note *) malloc(1000 * sizeof(struct note))));
+	for (i = 0; i < 1000; ++i) {
+		wav_samples[i] = 15.0 * pow(1.0075, i);
+	}
+	wav_samples[3] = 0.0;
+	wav_samples[4] = -440.0;
+	assert(GET_EXACT_NOTES_FAILURE_CODE == get_exact_notes(NULL, 1000, note_track));
+	assert(GET_EXACT_NOTES_FAILURE_CODE == get_exact_notes(wav_samples, 1000, NULL));
+	assert(GET_EXACT_NOTES_FAILURE_CODE == get_exact_notes(wav_samples, -1, note_track));
+	assert(0 == get_exact_notes(wav_samples, 0, note_track));
+	test_note.semitone = C;
+	test_note.octave = OCTAVE_MIN;
+	test_note.cents = -50.0;
+	lowest_freq = get_freq(&test_note);
+	test_note.semitone = B;
+	test_note.octave = OCTAVE_MAX;
+	test_note.cents = 50.0;
+	highest_freq = get_freq(&test_note);
+	samples_returned = 0;
+	for (i = 0; i < 1000; ++i) {
+		if (lowest_freq > wav_samples[i] || highest_freq < wav_samples[i]) {
+			++samples_returned;
+		}
+	}
+	assert(samples_returned == get_exact_notes(wav_samples, 1000, note_track));
+	for (i = 0; i < 1000; ++i) {
+		test_note = (lowest_freq <= wav_samples[i] && highest_freq >= wav_samples[i]) ? get_exact_note(wav_samples[i]) : note_track[i];
+		assert(test_note.semitone == note_track[i].semitone && test_note.octave == note_track[i].octave);
+		assert(0.000001 > fabs(test_note.cents - note_track[i].cents));
+	}
+	assert(UNKNOWN_SEMITONE == note_track[3].semitone && INVALID_OCTAVE == note_track[4].octave && DOUBLE_EQUALS(note_track[4].cents, INVALID_CENTS));
+	assert(UNKNOWN_SEMITONE == note_track[0].semitone && UNKNOWN_SEMITONE == note_track[999].semitone);
+	wav_samples[0] = highest_freq;
+	assert(0 == get_exact_notes(wav_samples, 1, note_track));
+	assert(B == note_track[0].semitone && OCTAVE_MAX == note_track[0].octave && 0.000001 > fabs(note_track[0].cents - 50.0));
+	FREE_SAFELY(note_track);
+	FREE_SAFELY(wav_samples);
 
 	LOG("get_semitone");
 
@@ -101,6 +209,45 @@ int main(int argc, const char *argv[])
 	SET_NOTE(test_note, B, 3, SEMITONE_INTERVAL_CENTS);
 	assert(-1 == get_freq(&test_note));
 
+	SET_NOTE(test_note, A, 4, 0.0);
+	assert(DOUBLE_EQUALS(get_freq(&test_note), 440.0));
+	SET_NOTE(test_note, C, OCTAVE_MIN, 0.0);
+	assert(DOUBLE_EQUALS(get_freq(&test_note), 440.0 * pow(2.0, -57.0 / 12.0)));
+	SET_NOTE(test_note, A, 4, -25.0);
+	assert(DOUBLE_EQUALS(get_freq(&test_note), 440.0 * pow(2.0, -25.0 / 1200.0)));
+
+	LOG("set_reference_pitch");
+
+	assert(DOUBLE_EQUALS(get_reference_pitch(), FREQ_OF_A4));
+	assert(REFERENCE_PITCH_FAILURE_CODE == set_reference_pitch(0.0));
+	assert(REFERENCE_PITCH_FAILURE_CODE == set_reference_pitch(REFERENCE_PITCH_MAX + 1.0));
+	assert(DOUBLE_EQUALS(get_reference_pitch(), FREQ_OF_A4));
+	assert(REFERENCE_PITCH_SUCCESS_CODE == set_reference_pitch(442.0));
+	assert(DOUBLE_EQUALS(get_reference_pitch(), 442.0));
+	SET_NOTE(test_note, A, 4, 0.0);
+	assert(DOUBLE_EQUALS(get_freq(&test_note), 442.0));
+	SET_NOTE(test_note, A, 5, 0.0);
+	assert(DOUBLE_EQUALS(get_freq(&test_note), 884.0));
+	test_note = get_exact_note(442.0);
+	assert(test_note.semitone == A && test_note.octave == 4 && 0.000001 > fabs(test_note.cents));
+	test_note = get_exact_note(440.0);
+	assert(test_note.semitone == A && test_note.octave == 4 && 0.01 > fabs(test_note.cents + 1200.0 * log2(442.0 / 440.0)));
+	test_note = get_approx_note(442.0 * pow(2.0, 0.49 / 12.0));
+	assert(test_note.semitone == A && test_note.octave == 4 && DOUBLE_EQUALS(test_note.cents, 0.0));
+	test_note = get_approx_note(442.0 * pow(2.0, 0.51 / 12.0));
+	assert(test_note.semitone == Bb && test_note.octave == 4);
+	lowest_freq = 884.0;
+	assert(0 == get_exact_notes(&lowest_freq, 1, &test_note));
+	assert(test_note.semitone == A && test_note.octave == 5 && 0.000001 > fabs(test_note.cents));
+	assert(REFERENCE_PITCH_SUCCESS_CODE == set_reference_pitch(415.0));
+	assert(DOUBLE_EQUALS(get_reference_pitch(), 415.0));
+	assert(REFERENCE_PITCH_SUCCESS_CODE == set_reference_pitch(442.0));
+	SET_NOTE(test_note, A, 5, 0.0);
+	assert(DOUBLE_EQUALS(get_freq(&test_note), 884.0));
+	assert(REFERENCE_PITCH_SUCCESS_CODE == set_reference_pitch(FREQ_OF_A4));
+	test_note = get_exact_note(440.0);
+	assert(test_note.semitone == A && test_note.octave == 4 && 0.000001 > fabs(test_note.cents));
+
 	LOG("get_fifth");
 
 	assert(UNKNOWN_SEMITONE == get_fifth(UNKNOWN_SEMITONE));
@@ -137,6 +284,43 @@ int main(int argc, const char *argv[])
 
 	TEST_SCALE(g_melodic_minor_scale, get_melodic_minor_scale(G), scale);
 
+	LOG("get_scale");
+
+	assert(NULL == get_scale(UNKNOWN_SCALE_TYPE, C));
+	assert(NULL == get_scale(MAJOR_SCALE, UNKNOWN_SEMITONE));
+	assert(NULL != (scale_info = get_scale(DORIAN_SCALE, D)));
+	assert(DORIAN_SCALE == scale_info->scale && D == scale_info->tonic && 7 == scale_info->length);
+	for (i = 0; i < sizeof(d_dorian_scale) / sizeof(enum semitone_t); ++i) {
+		assert(d_dorian_scale[i] == scale_info->steps[i]);
+	}
+	assert(get_scale(MAJOR_SCALE, C)->mask == scale_info->mask);
+	assert(scale_info == get_scale(DORIAN_SCALE, D));
+	scale_info = get_scale(BLUES_SCALE, A);
+	for (i = 0; i < sizeof(a_blues_scale) / sizeof(enum semitone_t); ++i) {
+		assert(a_blues_scale[i] == scale_info->steps[i]);
+	}
+	scale_info = get_scale(OCTATONIC_HALF_WHOLE_SCALE, Db);
+	for (i = 0; i < sizeof(db_octatonic_scale) / sizeof(enum semitone_t); ++i) {
+		assert(db_octatonic_scale[i] == scale_info->steps[i]);
+	}
+	assert(get_scale(OCTATONIC_WHOLE_HALF_SCALE, D)->mask == scale_info->mask);
+	assert(6 == get_scale(WHOLE_TONE_SCALE, Eb)->length && 5 == get_scale(MAJOR_PENTATONIC_SCALE, F)->length);
+	assert(get_scale(MAJOR_PENTATONIC_SCALE, C)->mask == get_scale(MINOR_PENTATONIC_SCALE, A)->mask);
+	assert(get_scale(LYDIAN_SCALE, F)->mask == get_scale(PHRYGIAN_SCALE, E)->mask);
+	assert(get_scale(MIXOLYDIAN_SCALE, G)->mask == get_scale(LOCRIAN_SCALE, B)->mask);
+	assert(get_scale(AEOLIAN_SCALE, A)->mask == get_scale(IONIAN_SCALE, C)->mask);
+
+	LOG("is_semitone_in_scale");
+
+	scale_info = get_scale(HARMONIC_MINOR_SCALE, A);
+	assert(is_semitone_in_scale(scale_info, Ab) && !is_semitone_in_scale(scale_info, G));
+	assert(!is_semitone_in_scale(scale_info, UNKNOWN_SEMITONE) && !is_semitone_in_scale(NULL, A));
+	assert(are_semitones_in_scale(scale_info, SEMITONE_BIT(E) | SEMITONE_BIT(Ab) | SEMITONE_BIT(B)));
+	assert(!are_semitones_in_scale(scale_info, SEMITONE_BIT(E) | SEMITONE_BIT(G) | SEMITONE_BIT(B)));
+	assert(are_semitones_in_scale(scale_info, 0) && !are_semitones_in_scale(NULL, 0));
+	assert(0 == get_scale_degree(scale_info, A) && 6 == get_scale_degree(scale_info, Ab));
+	assert(NOT_IN_SCALE == get_scale_degree(scale_info, Bb) && NOT_IN_SCALE == get_scale_degree(NULL, A));
+
 	LOG("get_samples_from_file");
 
 	wav_samples = get_samples_from_file("a4.wav", 12, &samples_returned);
@@ -153,7 +337,74 @@ int main(int argc, const char *argv[])
 	assert(NULL == get_samples_from_file("a4.wav", -23, &samples_returned) || samples_returned != -1);
 	assert(NULL == get_samples_from_file("does_not_exist.wav", 1024, &samples_returned) || samples_returned != -1);
 	assert(NULL == get_samples_from_file("a4.wav", 24, NULL));
-	assert(NULL != (wav_samples = get_samples_from_file("a4.wav", 24, &samples_returned)) || samples_returned != 24);
+
+	LOG("read_frames_from_source");
+
+	assert(NULL == open_source(NULL));
+	assert(NULL == open_source("does_not_exist.wav"));
+	assert(-1 == get_source_sample_rate(NULL) && -1 == get_source_num_channels(NULL) && -1 == get_source_num_frames(NULL));
+	assert(NULL != (source = open_source("a4.wav")));
+	assert(44100 == get_source_sample_rate(source) && 2 == get_source_num_channels(source) && 176400 == get_source_num_frames(source));
+	assert(-1 == read_frames_from_source(source, NULL, 12));
+	assert(-1 == read_frames_from_source(NULL, bogus_samples, 1));
+	wav_samples = (double *) malloc(24 * sizeof(double));
+	assert(12 == read_frames_from_source(source, wav_samples, 12));
+	assert(DOUBLE_EQUALS(wav_samples[3], 0.0621588230));
+	assert(DOUBLE_EQUALS(wav_samples[11], 0.3059304953));
+	assert(12 == read_frames_from_source(source, wav_samples, 12));
+	assert(DOUBLE_EQUALS(wav_samples[0], 0.6779614687));
+	assert(SOURCE_FAILURE_CODE == reopen_source(NULL, "a4.wav"));
+	assert(SOURCE_FAILURE_CODE == reopen_source(source, "does_not_exist.wav"));
+	assert(-1 == read_frames_from_source(source, wav_samples, 12));
+	assert(SOURCE_SUCCESS_CODE == reopen_source(source, "a4.wav"));
+	assert(12 == read_frames_from_source(source, wav_samples, 12));
+	assert(DOUBLE_EQUALS(wav_samples[3], 0.0621588230));
+	assert(SOURCE_SUCCESS_CODE == reopen_source(source, "f5-a7.wav"));
+	assert(0 < get_source_num_frames(source));
+	FREE_SAFELY(wav_samples);
+	close_source(source);
+	close_source(NULL);
+
+	LOG("map_frames_from_source");
+
+	assert(NULL != (source = open_source("a4.wav")));
+	assert(is_source_mapped(source) && !is_source_mapped(NULL));
+	assert(NULL == map_frames_from_source(source, 12, NULL, NULL));
+	assert(NULL == map_frames_from_source(NULL, 12, &notes_returned, NULL) && 0 == notes_returned);
+	assert(NULL != (mapped_frames = map_frames_from_source(source, 12, &notes_returned, &encoding)));
+	assert(12 == notes_returned && PCM_24_ENCODING == encoding && 3 == get_encoded_sample_size(encoding));
+	mix_down_and_window_encoded(mapped_frames, encoding, 12, 2, NULL, mixed_samples);
+	assert(DOUBLE_EQUALS(mixed_samples[1], 0.0621588230));
+	assert(DOUBLE_EQUALS(mixed_samples[5], 0.3059304953));
+	assert(NULL != map_frames_from_source(source, 176400, &notes_returned, NULL) && 176388 == notes_returned);
+	assert(NULL != map_frames_from_source(source, 12, &notes_returned, NULL) && 0 == notes_returned);
+	assert(0 == read_frames_from_source(source, bogus_samples, 1));
+	assert(SOURCE_SUCCESS_CODE == reopen_source(source, "c4-e4-g4.wav"));
+	assert(NULL != map_frames_from_source(source, 1, &notes_returned, &encoding) && PCM_16_ENCODING == encoding);
+	close_source(source);
+
+	/* 32-bit float is mapped, but 32-bit integer PCM falls back to libsndfile */
+	assert(-1 != (mapped_fd = mkstemp(mapped_filename)));
+	assert(NULL != (wav_file = fdopen(mapped_fd, "wb")));
+	assert(1 == fwrite(float_wav, sizeof(float_wav), 1, wav_file));
+	fclose(wav_file);
+	assert(NULL != (source = open_source(mapped_filename)));
+	assert(is_source_mapped(source) && 8000 == get_source_sample_rate(source) && 2 == get_source_num_frames(source));
+	assert(2 == read_frames_from_source(source, mixed_samples, 4));
+	assert(DOUBLE_EQUALS(mixed_samples[0], 0.5) && DOUBLE_EQUALS(mixed_samples[1], -0.25));
+	float_wav[20] = 1;
+	assert(NULL != (wav_file = fopen(mapped_filename, "wb")));
+	assert(1 == fwrite(float_wav, sizeof(float_wav), 1, wav_file));
+	fclose(wav_file);
+	assert(SOURCE_SUCCESS_CODE == reopen_source(source, mapped_filename));
+	assert(!is_source_mapped(source) && 2 == get_source_num_frames(source));
+	assert(NULL == map_frames_from_source(source, 2, &notes_returned, NULL));
+	close_source(source);
+	remove(mapped_filename);
+
+	assert(NULL != (wav_samples = get_samples_from_file("a4.wav", 200000, &samples_returned)) && 176400 == samples_returned);
+	FREE_SAFELY(wav_samples);
+	assert(NULL != (wav_samples = get_samples_from_file("a4.wav", 24, &samples_returned)) && 24 == samples_returned);
 
 	LOG("split_stereo_channels");
 
@@ -184,6 +435,67 @@ int main(int argc, const char *argv[])
 	FREE_SAFELY(wav_samples_right);
 	FREE_SAFELY(wav_samples);
 
+	LOG("get_hann_window");
+
+	assert(NULL == get_hann_window(0));
+	assert(NULL != (hann_window = get_hann_window(24)));
+	assert(hann_window == get_hann_window(24));
+	assert(DOUBLE_EQUALS(hann_window[0], 0.0) && DOUBLE_EQUALS(hann_window[23], 0.0));
+	assert(DOUBLE_EQUALS(hann_window[6], 0.5 * (1 - cos(2 * M_PI * 6 / 23))));
+
+	LOG("mix_down_and_window");
+
+	assert(NULL != (wav_samples = get_samples_from_file("a4.wav", 12, &samples_returned)));
+	mix_down_and_window(wav_samples, 12, 2, NULL, mixed_samples);
+	assert(DOUBLE_EQUALS(mixed_samples[3], 0.1855007410));
+	mix_down_and_window(wav_samples, 12, 2, get_hann_window(12), mixed_samples);
+	assert(DOUBLE_EQUALS(mixed_samples[0], 0.0));
+	assert(DOUBLE_EQUALS(mixed_samples[3], 0.1855007410 * get_hann_window(12)[3]));
+	mix_down_and_window(wav_samples, 24, 1, get_hann_window(24), mixed_samples);
+	assert(DOUBLE_EQUALS(mixed_samples[3], wav_samples[3] * get_hann_window(24)[3]));
+	FREE_SAFELY(wav_samples);
+
+	LOG("decimate");
+
+	assert(-1 == get_decimation_factor(0, 1000.0) && -1 == get_decimation_factor(44100, 0.0));
+	assert(2 == get_decimation_factor(44100, 8133.7) && 8 == get_decimation_factor(48000, 2000.0));
+	assert(30 == get_decimation_factor(44100, 1.0) && 1 == get_decimation_factor(44100, 30000.0));
+	assert(NULL != (wav_samples = (double *) malloc(8192 * sizeof(double))));
+	assert(NULL != (wav_samples_hannd = (double *) malloc(2048 * sizeof(double))));
+	assert(-1 == decimate(NULL, 8192, 4, wav_samples_hannd) && -1 == decimate(wav_samples, 8192, 0, wav_samples_hannd));
+	for (i = 0; i < 8192; ++i) {
+		wav_samples[i] = 0.5 * sin(2 * M_PI * 440.0 * i / 44100) + 0.5 * sin(2 * M_PI * 10000.0 * i / 44100);
+	}
+	assert(2048 == decimate(wav_samples, 8192, 4, wav_samples_hannd));
+	for (i = 64; i < 1984; ++i) {
+		assert(0.001 > fabs(wav_samples_hannd[i] - 0.5 * sin(2 * M_PI * 440.0 * i * 4 / 44100)));
+	}
+	for (i = 0; i < 8192; ++i) {
+		wav_samples[i] = 0.5 * sin(2 * M_PI * 440.0 * i / 44100) + 0.5 * sin(2 * M_PI * 5000.0 * i / 44100);
+	}
+	assert(1365 == decimate(wav_samples, 8192, 6, wav_samples_hannd));
+	for (i = 64; i < 1301; ++i) {
+		assert(0.001 > fabs(wav_samples_hannd[i] - 0.5 * sin(2 * M_PI * 440.0 * i * 6 / 44100)));
+	}
+	FREE_SAFELY(wav_samples_hannd);
+	assert(NULL != (wav_samples_hannd = (double *) malloc(8192 * sizeof(double))));
+	assert(8192 == decimate(wav_samples, 8192, 1, wav_samples_hannd) && wav_samples_hannd[5] == wav_samples[5]);
+	FREE_SAFELY(wav_samples_hannd);
+	FREE_SAFELY(wav_samples);
+	clear_window_cache();
+
+	LOG("get_peak_of_spectrum");
+
+	assert(-1 == get_peak_of_spectrum(NULL, 12, &peak_power));
+	assert(NULL != (fft_output = (fftw_complex *) calloc(12, sizeof(fftw_complex))));
+	assert(-1 == get_peak_of_spectrum(fft_output, 0, &peak_power));
+	fft_output[4][0] = 3.0;
+	fft_output[4][1] = -4.0;
+	fft_output[7][1] = 4.5;
+	assert(4 == get_peak_of_spectrum(fft_output, 12, &peak_power) && DOUBLE_EQUALS(peak_power, 25.0));
+	assert(0 == get_peak_of_spectrum(fft_output, 4, NULL));
+	FREE_SAFELY(fft_output);
+
 	LOG("get_note_from_file");
 
 	note_from_file = get_note_from_file(NULL, .75);
@@ -207,11 +519,520 @@ int main(int argc, const char *argv[])
 	note_from_file = get_note_from_file("f4-piano.wav", 0.345);
 	assert(F == note_from_file.semitone && 4 == note_from_file.octave && DOUBLE_EQUALS(note_from_file.cents, -6.9648619035));
 
+	LOG("get_note_track_from_file");
+
+	assert(NULL == get_note_track_from_file("a4.wav", 22050, 11025, NULL));
+	assert(NULL == get_note_track_from_file(NULL, 22050, 11025, &notes_returned) && -1 == notes_returned);
+	assert(NULL == get_note_track_from_file("does_not_exist.wav", 22050, 11025, &notes_returned) && -1 == notes_returned);
+	assert(NULL == get_note_track_from_file("a4.wav", 1, 11025, &notes_returned) && -1 == notes_returned);
+	assert(NULL == get_note_track_from_file("a4.wav", 22050, 0, &notes_returned) && -1 == notes_returned);
+
+	assert(NULL != (note_track = get_note_track_from_file("a4.wav", 22050, 11025, &notes_returned)));
+	assert(15 == notes_returned);
+	for (int i = 0; i < notes_returned; ++i) {
+		assert(A == note_track[i].semitone && 4 == note_track[i].octave && DOUBLE_EQUALS(note_track[i].cents, 0.0000000000));
+	}
+	FREE_SAFELY(note_track);
+
+	assert(NULL != (note_track = get_note_track_from_file("a4.wav", 22050, 30000, &notes_returned)));
+	assert(6 == notes_returned);
+	FREE_SAFELY(note_track);
+
+	LOG("push_frames_to_note_detector");
+
+	assert(NULL == create_note_detector(0, 2, 22050, 11025));
+	assert(NULL == create_note_detector(44100, 0, 22050, 11025));
+	assert(NULL == create_note_detector(44100, 2, 1, 11025));
+	assert(NULL == create_note_detector(44100, 2, 22050, -1));
+	assert(NULL != (detector = create_note_detector(44100, 2, 22050, 11025)));
+	assert(NULL != (wav_samples = get_samples_from_file("a4.wav", 55125, &samples_returned)));
+	assert(-1 == push_frames_to_note_detector(detector, NULL, 44100, &test_note, 1, &notes_returned) && 0 == notes_returned);
+	assert(-1 == push_frames_to_note_detector(detector, wav_samples, 44100, &test_note, 1, NULL));
+	assert(22050 == push_frames_to_note_detector(detector, wav_samples, 22050, &test_note, 1, &notes_returned) && 1 == notes_returned);
+	assert(A == test_note.semitone && 4 == test_note.octave && DOUBLE_EQUALS(test_note.cents, 0.0000000000));
+	assert(22050 == push_frames_to_note_detector(detector, wav_samples + 22050 * 2, 22050, &test_note, 1, &notes_returned) && 1 == notes_returned);
+	assert(0 == push_frames_to_note_detector(detector, wav_samples + 44100 * 2, 11025, &test_note, 0, &notes_returned) && 0 == notes_returned);
+	assert(11025 == push_frames_to_note_detector(detector, wav_samples + 44100 * 2, 11025, &test_note, 1, &notes_returned) && 1 == notes_returned);
+	assert(A == test_note.semitone && 4 == test_note.octave);
+	reset_note_detector(detector);
+	assert(11025 == push_frames_to_note_detector(detector, wav_samples, 11025, &test_note, 1, &notes_returned) && 0 == notes_returned);
+	destroy_note_detector(detector);
+	FREE_SAFELY(wav_samples);
+
+	LOG("push_frames_to_onset_detector");
+
+	assert(NULL == create_onset_detector(0, 1024, ONSET_DEFAULT_THRESHOLD_DB));
+	assert(NULL == create_onset_detector(1, 0, ONSET_DEFAULT_THRESHOLD_DB));
+	assert(NULL == create_onset_detector(1, 1024, 0.0));
+	assert(NULL != (onset_detector = create_onset_detector(1, 1024, ONSET_DEFAULT_THRESHOLD_DB)));
+	wav_samples = (double *) calloc(16384, sizeof(double));
+	for (i = 4096; i < 8192; ++i) {
+		wav_samples[i] = 0.5 * sin(2 * M_PI * 440.0 * i / 44100);
+		wav_samples[i + 8192] = 0.5 * sin(2 * M_PI * 440.0 * i / 44100);
+	}
+	assert(-1 == push_frames_to_onset_detector(onset_detector, wav_samples, 16384, onsets, 4, NULL));
+	assert(-1 == push_frames_to_onset_detector(NULL, wav_samples, 16384, onsets, 4, &notes_returned) && 0 == notes_returned);
+	assert(-1 == push_frames_to_onset_detector(onset_detector, wav_samples, 16384, NULL, 4, &notes_returned));
+	assert(16384 == push_frames_to_onset_detector(onset_detector, wav_samples, 16384, onsets, 4, &notes_returned));
+	assert(2 == notes_returned && 4096 == onsets[0] && 12288 == onsets[1]);
+	reset_onset_detector(onset_detector);
+	assert(0 == push_frames_to_onset_detector(onset_detector, wav_samples, 8192, onsets, 0, &notes_returned) && 0 == notes_returned);
+	assert(5120 == push_frames_to_onset_detector(onset_detector, wav_samples, 16384, onsets, 1, &notes_returned));
+	assert(1 == notes_returned && 4096 == onsets[0]);
+	assert(11264 == push_frames_to_onset_detector(onset_detector, wav_samples + 5120, 11264, onsets, 4, &notes_returned));
+	assert(1 == notes_returned && 12288 == onsets[0]);
+	destroy_onset_detector(onset_detector);
+	destroy_onset_detector(NULL);
+	assert(ONSET_FLOOR_DB == get_energy_db(wav_samples, 4096) && ONSET_FLOOR_DB == get_energy_db(NULL, 4096));
+	assert(0.05 > fabs(get_energy_db(wav_samples + 4096, 4096) - 10.0 * log10(0.125)));
+	assert(0.0 == get_zero_crossing_rate(wav_samples, 1) && 0.0 == get_zero_crossing_rate(NULL, 4096));
+	assert(0.019 < get_zero_crossing_rate(wav_samples + 4096, 4096) && 0.021 > get_zero_crossing_rate(wav_samples + 4096, 4096));
+	FREE_SAFELY(wav_samples);
+
+	/* with onset gating, a steady note is only analyzed once */
+	assert(NULL != (detector = create_note_detector(44100, 2, 4096, 1024)));
+	assert(NULL != (wav_samples = get_samples_from_file("a4.wav", 44100, &samples_returned)));
+	init_detection_options(&options);
+	reset_detection_stats(&stats);
+	options.stats = &stats;
+	options.onset_gating = true;
+	set_note_detector_options(detector, &options);
+	assert(11264 == push_frames_to_note_detector(detector, wav_samples, 11264, notes_from_file, 8, &notes_returned));
+	assert(8 == notes_returned && 1 == stats.calls && 7 == stats.gated);
+	assert(A == notes_from_file[7].semitone && 4 == notes_from_file[7].octave);
+	reset_note_detector(detector);
+	assert(4096 == push_frames_to_note_detector(detector, wav_samples, 4096, notes_from_file, 8, &notes_returned));
+	assert(1 == notes_returned && 2 == stats.calls && 7 == stats.gated);
+	destroy_note_detector(detector);
+	FREE_SAFELY(wav_samples);
+
+	/* a new pitch at the same level is followed instead of gated out */
+	assert(NULL != (detector = create_note_detector(44100, 1, 4096, 1024)));
+	assert(NULL != (wav_samples = (double *) malloc(44032 * sizeof(double))));
+	for (i = 0; i < 44032; ++i) {
+		wav_samples[i] = 0.5 * sin(2 * M_PI * ((22016 > i) ? 523.2511 : 554.3653) * i / 44100);
+	}
+	reset_detection_stats(&stats);
+	set_note_detector_options(detector, &options);
+	for (i = 0; i < 44032; i += 1024) {
+		assert(1024 == push_frames_to_note_detector(detector, wav_samples + i, 1024, notes_from_file, 8, &notes_returned));
+		if (0 < notes_returned) {
+			test_note_2 = notes_from_file[notes_returned - 1];
+		}
+	}
+	assert(Db == test_note_2.semitone && 5 == test_note_2.octave);
+	assert(0 < stats.gated && 40 == stats.calls + stats.gated);
+
+	/* so is a pitch that drifts by less than a semitone */
+	for (i = 0; i < 44032; ++i) {
+		wav_samples[i] = 0.5 * sin(2 * M_PI * ((22016 > i) ? 440.0 : 452.8929) * i / 44100);
+	}
+	options.onset_gating = false;
+	set_note_detector_options(detector, &options);
+	reset_note_detector(detector);
+	for (i = 0; i < 44032; i += 1024) {
+		assert(1024 == push_frames_to_note_detector(detector, wav_samples + i, 1024, notes_from_file, 8, &notes_returned));
+		if (0 < notes_returned) {
+			test_note_3 = notes_from_file[notes_returned - 1];
+		}
+	}
+	options.onset_gating = true;
+	set_note_detector_options(detector, &options);
+	reset_note_detector(detector);
+	reset_detection_stats(&stats);
+	for (i = 0; i < 44032; i += 1024) {
+		assert(1024 == push_frames_to_note_detector(detector, wav_samples + i, 1024, notes_from_file, 8, &notes_returned));
+		if (0 < notes_returned) {
+			test_note_2 = notes_from_file[notes_returned - 1];
+		}
+	}
+	assert(test_note_3.semitone == test_note_2.semitone && test_note_3.octave == test_note_2.octave);
+	assert(1.0 > fabs(test_note_3.cents - test_note_2.cents) && 0 < stats.gated);
+	destroy_note_detector(detector);
+	FREE_SAFELY(wav_samples);
+
+	LOG("push_frames_to_live_detector");
+
+	assert(NULL == create_live_detector(44100, 2, 22050, 11025, 0, NULL, NULL, NULL));
+	assert(NULL == create_live_detector(0, 2, 22050, 11025, 65536, NULL, NULL, NULL));
+	assert(-1 == push_frames_to_live_detector(NULL, bogus_samples, 1));
+	assert(-1 == get_latest_live_note(NULL, &test_note) && -1 == get_live_detector_dropped_frames(NULL));
+	destroy_live_detector(NULL);
+	live_sequence = 0;
+	assert(NULL != (live = create_live_detector(44100, 2, 22050, 11025, 65536, NULL, record_live_note, &live_sequence)));
+	assert(0 == get_latest_live_note(live, &test_note));
+	assert(NULL != (wav_samples = get_samples_from_file("a4.wav", 55125, &samples_returned)));
+	for (i = 0; i < 55125; i += 441) {
+		assert(441 == push_frames_to_live_detector(live, wav_samples + i * 2, 441));
+	}
+	live_start = clock();
+	while (4 != get_latest_live_note(live, &test_note) && 10 * CLOCKS_PER_SEC > clock() - live_start);
+	assert(4 == get_latest_live_note(live, &test_note) && 0 == get_live_detector_dropped_frames(live));
+	assert(A == test_note.semitone && 4 == test_note.octave && DOUBLE_EQUALS(test_note.cents, 0.0000000000));
+	destroy_live_detector(live);
+	assert(4 == live_sequence);
+	assert(NULL != (live = create_live_detector(44100, 2, 22050, 11025, 1000, NULL, NULL, NULL)));
+	assert(1024 == push_frames_to_live_detector(live, wav_samples, 4096));
+	assert(3072 == get_live_detector_dropped_frames(live));
+	destroy_live_detector(live);
+	FREE_SAFELY(wav_samples);
+
+	LOG("get_note_from_file_with_options");
+
+	init_detection_options(&options);
+	note_from_file = get_note_from_file_with_options("a4.wav", 0.5, &options);
+	assert(A == note_from_file.semitone && 4 == note_from_file.octave && DOUBLE_EQUALS(note_from_file.cents, 0.0000000000));
+	note_from_file = get_note_from_file_with_options("a4.wav", 0.0503, NULL);
+	assert(A == note_from_file.semitone && 4 == note_from_file.octave && -10.0 > note_from_file.cents);
+	options.interpolation = QUADRATIC_INTERPOLATION;
+	note_from_file = get_note_from_file_with_options("a4.wav", 0.0503, &options);
+	assert(A == note_from_file.semitone && 4 == note_from_file.octave && 3.0 > fabs(note_from_file.cents));
+	options.interpolation = GAUSSIAN_INTERPOLATION;
+	note_from_file = get_note_from_file_with_options("a4.wav", 0.0503, &options);
+	assert(A == note_from_file.semitone && 4 == note_from_file.octave && 1.0 > fabs(note_from_file.cents));
+	note_from_file = get_note_from_file_with_options(NULL, 0.0503, &options);
+	assert(UNKNOWN_SEMITONE == note_from_file.semitone);
+
+	options.method = YIN_METHOD;
+	note_from_file = get_note_from_file_with_options("a4.wav", 0.01, &options);
+	assert(A == note_from_file.semitone && 4 == note_from_file.octave && 0.5 > fabs(note_from_file.cents));
+	note_from_file = get_note_from_file_with_options("g#5-piano.wav", 0.05, &options);
+	assert(Ab == note_from_file.semitone && 5 == note_from_file.octave);
+	note_from_file = get_note_from_file_with_options("a4.wav", 0.0001, &options);
+	assert(UNKNOWN_SEMITONE == note_from_file.semitone);
+	options.max_freq = 1000.0;
+	note_from_file = get_note_from_file_with_options("a4.wav", 0.01, &options);
+	assert(A == note_from_file.semitone && 4 == note_from_file.octave && 0.5 > fabs(note_from_file.cents));
+	options.method = SPECTRAL_PEAK_METHOD;
+	note_from_file = get_note_from_file_with_options("a4.wav", 0.05, &options);
+	assert(A == note_from_file.semitone && 4 == note_from_file.octave && 0.01 > fabs(note_from_file.cents));
+	options.interpolation = NO_INTERPOLATION;
+	note_from_file = get_note_from_file_with_options("a4.wav", 0.5, &options);
+	assert(A == note_from_file.semitone && 4 == note_from_file.octave && DOUBLE_EQUALS(note_from_file.cents, 0.0000000000));
+	note_from_file = get_note_from_file_with_options("g#5-piano.wav", 0.234, &options);
+	assert(Ab == note_from_file.semitone && 5 == note_from_file.octave);
+	options.max_freq = 0.0;
+
+	LOG("reset_detection_stats");
+
+	reset_detection_stats(NULL);
+	reset_detection_stats(&stats);
+	assert(0 == stats.calls && 0 == stats.decode_ns && 0 == stats.allocations && 0 == stats.fft_size);
+	init_detection_options(&options);
+	assert(NULL == options.stats);
+	options.stats = &stats;
+	note_from_file = get_note_from_file_with_options("a4.wav", 0.5, &options);
+	assert(A == note_from_file.semitone && 4 == note_from_file.octave && DOUBLE_EQUALS(note_from_file.cents, 0.0000000000));
+	assert(1 == stats.calls && 22050 == stats.fft_size && 22050 * 2 * 3 == stats.bytes_read);
+	assert(0 < stats.decode_ns && 0 < stats.mixdown_ns && 0 == stats.window_ns && 0 < stats.fft_ns && 0 < stats.peak_ns);
+	assert(0 < stats.allocations);
+	options.method = YIN_METHOD;
+	note_from_file = get_note_from_file_with_options("a4.wav", 0.01, &options);
+	assert(2 == stats.calls && 441 == stats.fft_size && (22050 + 441) * 2 * 3 == stats.bytes_read);
+	note_from_file = get_note_from_file_with_options("does_not_exist.wav", 0.01, &options);
+	assert(3 == stats.calls && 441 == stats.fft_size);
+	options.method = SPECTRAL_PEAK_METHOD;
+	options.max_freq = 1000.0;
+	note_from_file = get_note_from_file_with_options("a4.wav", 0.5, &options);
+	assert(A == note_from_file.semitone && 4 == note_from_file.octave && 1470 == stats.fft_size);
+	options.max_freq = 0.0;
+	reset_detection_stats(&stats);
+	assert(NULL != (detector = create_note_detector(44100, 2, 2048, 512)));
+	set_note_detector_options(detector, &options);
+	assert(NULL != (wav_samples = get_samples_from_file("a4.wav", 4096, &samples_returned)));
+	assert(4096 == push_frames_to_note_detector(detector, wav_samples, 4096, notes_from_file, 8, &notes_returned) && 5 == notes_returned);
+	assert(5 == stats.calls && 2048 == stats.fft_size && 4096 * 2 * sizeof(double) == stats.bytes_read);
+	assert(0 == stats.decode_ns && 0 < stats.mixdown_ns && 0 < stats.window_ns && 0 < stats.fft_ns && 0 == stats.allocations);
+	destroy_note_detector(detector);
+	FREE_SAFELY(wav_samples);
+	options.stats = NULL;
+
+	LOG("create_workspace");
+
+	assert(NULL == create_workspace(-1, 2));
+	assert(NULL == create_workspace(22050, -1));
+	assert(WORKSPACE_FAILURE_CODE == reserve_workspace(NULL, 22050, 2));
+	assert(NULL != (workspace = create_workspace(22050, 2)));
+	assert(WORKSPACE_FAILURE_CODE == reserve_workspace(workspace, 0, 2));
+	assert(WORKSPACE_SUCCESS_CODE == reserve_workspace(workspace, 22050, 2) && 22050 == workspace->max_samples);
+	init_detection_options(&options);
+	assert(NULL == options.workspace);
+	options.workspace = workspace;
+	options.stats = &stats;
+	reset_detection_stats(&stats);
+	note_from_file = get_note_from_file_with_options("a4.wav", 0.5, &options);
+	assert(A == note_from_file.semitone && 4 == note_from_file.octave && DOUBLE_EQUALS(note_from_file.cents, 0.0000000000));
+	reset_detection_stats(&stats);
+	for (int i = 0; i < 4; ++i) {
+		note_from_file = get_note_from_file_with_options(0 == i % 2 ? "a4.wav" : "g#5-piano.wav", 0.234, &options);
+		assert(UNKNOWN_SEMITONE != note_from_file.semitone);
+	}
+	assert(Ab == note_from_file.semitone && 5 == note_from_file.octave && DOUBLE_EQUALS(note_from_file.cents, 5.6681983644));
+	assert(4 == stats.calls && 0 == stats.allocations);
+	options.method = YIN_METHOD;
+	note_from_file = get_note_from_file_with_options("a4.wav", 0.01, &options);
+	note_from_file = get_note_from_file_with_options("a4.wav", 0.01, &options);
+	assert(A == note_from_file.semitone && 4 == note_from_file.octave && 0 == stats.allocations);
+	options.method = SPECTRAL_PEAK_METHOD;
+	note_from_file = get_note_from_file_with_options("a4.wav", 1.0, &options);
+	assert(A == note_from_file.semitone && 44100 == workspace->max_samples && 0 < stats.allocations);
+	note_from_file = get_note_from_file_with_options("does_not_exist.wav", 1.0, &options);
+	assert(UNKNOWN_SEMITONE == note_from_file.semitone);
+	note_from_file = get_note_from_file_with_options("a4.wav", 0.5, &options);
+	assert(A == note_from_file.semitone && 4 == note_from_file.octave && DOUBLE_EQUALS(note_from_file.cents, 0.0000000000));
+	destroy_workspace(workspace);
+	destroy_workspace(NULL);
+	options.workspace = NULL;
+	options.stats = NULL;
+
+	LOG("get_yin_frequency");
+
+	assert(NULL != (wav_samples = get_samples_from_file("a4.wav", 2048, &samples_returned)));
+	mix_down_and_window(wav_samples, 2048, 2, NULL, wav_samples);
+	assert(INVALID_FREQUENCY == get_yin_frequency(NULL, 2048, 44100, YIN_DEFAULT_THRESHOLD));
+	assert(INVALID_FREQUENCY == get_yin_frequency(wav_samples, 2048, 0, YIN_DEFAULT_THRESHOLD));
+	assert(INVALID_FREQUENCY == get_yin_frequency(wav_samples, 2048, 44100, 0.0));
+	assert(INVALID_FREQUENCY == get_yin_frequency(wav_samples, 8, 44100, YIN_DEFAULT_THRESHOLD));
+	assert(0.1 > fabs(get_yin_frequency(wav_samples, 2048, 44100, YIN_DEFAULT_THRESHOLD) - 440.0));
+	memset(wav_samples, 0, 2048 * sizeof(double));
+	assert(INVALID_FREQUENCY == get_yin_frequency(wav_samples, 2048, 44100, YIN_DEFAULT_THRESHOLD));
+	FREE_SAFELY(wav_samples);
+
+	LOG("set_note_detector_options");
+
+	options.interpolation = PHASE_VOCODER_INTERPOLATION;
+	assert(NULL != (detector = create_note_detector(44100, 2, 2048, 512)));
+	set_note_detector_options(detector, &options);
+	assert(NULL != (wav_samples = get_samples_from_file("a4.wav", 8192, &samples_returned)));
+	assert(5632 == push_frames_to_note_detector(detector, wav_samples, 5632, notes_from_file, 8, &notes_returned) && 8 == notes_returned);
+	for (int i = 0; i < 8; ++i) {
+		assert(A == notes_from_file[i].semitone && 4 == notes_from_file[i].octave && 1.0 > fabs(notes_from_file[i].cents));
+	}
+	assert(0.01 > fabs(notes_from_file[7].cents));
+	set_note_detector_options(detector, NULL);
+	reset_note_detector(detector);
+	assert(2048 == push_frames_to_note_detector(detector, wav_samples, 2048, notes_from_file, 8, &notes_returned) && 1 == notes_returned);
+	assert(A == notes_from_file[0].semitone && 4 == notes_from_file[0].octave && -20.0 > notes_from_file[0].cents);
+	options.method = YIN_METHOD;
+	set_note_detector_options(detector, &options);
+	assert(1024 == push_frames_to_note_detector(detector, wav_samples + 2048 * 2, 1024, notes_from_file, 8, &notes_returned) && 2 == notes_returned);
+	assert(A == notes_from_file[1].semitone && 4 == notes_from_file[1].octave && 0.5 > fabs(notes_from_file[1].cents));
+	reset_note_detector(detector);
+	memset(wav_samples, 0, 2048 * 2 * sizeof(double));
+	assert(2048 == push_frames_to_note_detector(detector, wav_samples, 2048, notes_from_file, 8, &notes_returned) && 1 == notes_returned);
+	assert(UNKNOWN_SEMITONE == notes_from_file[0].semitone && INVALID_OCTAVE == notes_from_file[0].octave);
+	destroy_note_detector(detector);
+	FREE_SAFELY(wav_samples);
+
+	LOG("get_notes_from_file");
+
+	assert(-1 == get_notes_from_file("f5-a7.wav", 0.5, NULL, 8));
+	assert(-1 == get_notes_from_file("f5-a7.wav", 0.5, notes_from_file, 0));
+	assert(-1 == get_notes_from_file(NULL, 0.5, notes_from_file, 8));
+	assert(-1 == get_notes_from_file("does_not_exist.wav", 0.5, notes_from_file, 8));
+	assert(-1 == get_notes_from_file("f5-a7.wav", -0.5, notes_from_file, 8));
+	assert(2 == get_notes_from_file("f5-a7.wav", 0.5, notes_from_file, 8));
+	assert(A == notes_from_file[0].semitone && 7 == notes_from_file[0].octave);
+	assert(F == notes_from_file[1].semitone && 5 == notes_from_file[1].octave);
+	assert(1 == get_notes_from_file("f5-a7.wav", 0.5, notes_from_file, 1));
+	assert(A == notes_from_file[0].semitone && 7 == notes_from_file[0].octave);
+	assert(1 == get_notes_from_file("a4.wav", 0.5, notes_from_file, 8));
+	assert(A == notes_from_file[0].semitone && 4 == notes_from_file[0].octave && DOUBLE_EQUALS(notes_from_file[0].cents, 0.0));
+	assert(3 == get_notes_from_file("c4-e4-g4.wav", 0.4, notes_from_file, 8));
+
+	LOG("remove_harmonic_peaks");
+
+	assert(0 == remove_harmonic_peaks(NULL, NULL, 3, NOTE_HARMONIC_TOLERANCE_CENTS, NOTE_HARMONIC_TOLERANCE_BINS, NOTE_HARMONIC_MIN_RELATIVE_POWER));
+	peaks[0] = 400;
+	peaks[1] = 200;
+	peaks[2] = 301;
+	peaks[3] = 601;
+	assert(2 == remove_harmonic_peaks(peaks, NULL, 4, NOTE_HARMONIC_TOLERANCE_CENTS, 0.0, NOTE_HARMONIC_MIN_RELATIVE_POWER));
+	assert(200 == peaks[0] && 301 == peaks[1]);
+
+	/* G1 (49.0 Hz) and its second harmonic 0.4 seconds in land on bins 20 and 39 (44 cents flat) */
+	peaks[0] = 39;
+	peaks[1] = 20;
+	peaks[2] = 59;
+	assert(3 == remove_harmonic_peaks(peaks, NULL, 3, NOTE_HARMONIC_TOLERANCE_CENTS, 0.0, NOTE_HARMONIC_MIN_RELATIVE_POWER));
+	assert(1 == remove_harmonic_peaks(peaks, NULL, 3, NOTE_HARMONIC_TOLERANCE_CENTS, NOTE_HARMONIC_TOLERANCE_BINS, NOTE_HARMONIC_MIN_RELATIVE_POWER));
+	assert(20 == peaks[0]);
+	peaks[0] = 131;
+	peaks[1] = 65;
+	peaks[2] = 98;
+	assert(2 == remove_harmonic_peaks(peaks, NULL, 3, NOTE_HARMONIC_TOLERANCE_CENTS, NOTE_HARMONIC_TOLERANCE_BINS, NOTE_HARMONIC_MIN_RELATIVE_POWER));
+	assert(65 == peaks[0] && 98 == peaks[1]);
+
+	/* the result doesn't depend on the order of the peaks */
+	peaks[0] = 100;
+	peaks[1] = 201;
+	peaks[2] = 403;
+	assert(1 == remove_harmonic_peaks(peaks, NULL, 3, NOTE_HARMONIC_TOLERANCE_CENTS, NOTE_HARMONIC_TOLERANCE_BINS, NOTE_HARMONIC_MIN_RELATIVE_POWER));
+	assert(100 == peaks[0]);
+	peaks[0] = 201;
+	peaks[1] = 100;
+	peaks[2] = 403;
+	assert(1 == remove_harmonic_peaks(peaks, NULL, 3, NOTE_HARMONIC_TOLERANCE_CENTS, NOTE_HARMONIC_TOLERANCE_BINS, NOTE_HARMONIC_MIN_RELATIVE_POWER));
+	assert(100 == peaks[0]);
+
+	/* a weak low peak (e.g. hum) doesn't take out the notes near its multiples */
+	peaks[0] = 301;
+	peaks[1] = 200;
+	peaks[2] = 3;
+	peak_powers[0] = 1.0;
+	peak_powers[1] = 0.5;
+	peak_powers[2] = 0.02;
+	assert(1 == remove_harmonic_peaks(peaks, NULL, 3, NOTE_HARMONIC_TOLERANCE_CENTS, NOTE_HARMONIC_TOLERANCE_BINS, NOTE_HARMONIC_MIN_RELATIVE_POWER));
+	assert(3 == peaks[0]);
+	peaks[0] = 301;
+	peaks[1] = 200;
+	peaks[2] = 3;
+	assert(3 == remove_harmonic_peaks(peaks, peak_powers, 3, NOTE_HARMONIC_TOLERANCE_CENTS, NOTE_HARMONIC_TOLERANCE_BINS, NOTE_HARMONIC_MIN_RELATIVE_POWER));
+	assert(301 == peaks[0] && 200 == peaks[1] && 3 == peaks[2] && DOUBLE_EQUALS(peak_powers[2], 0.02));
+	peak_powers[0] = 0.02;
+	peak_powers[1] = 20.0;
+	peak_powers[2] = 1.0;
+	assert(2 == remove_harmonic_peaks(peaks, peak_powers, 3, NOTE_HARMONIC_TOLERANCE_CENTS, NOTE_HARMONIC_TOLERANCE_BINS, NOTE_HARMONIC_MIN_RELATIVE_POWER));
+	assert(200 == peaks[0] && 3 == peaks[1] && DOUBLE_EQUALS(peak_powers[0], 20.0) && DOUBLE_EQUALS(peak_powers[1], 1.0));
+
+	/* the same G1 in a file is one note, not G1 and G2 */
+	assert(-1 != (mapped_fd = mkstemp(low_filename)));
+	assert(NULL != (wav_file = fdopen(mapped_fd, "wb")));
+	memcpy(low_wav_header, float_wav, sizeof(low_wav_header));
+	low_wav_header[20] = 3;  /* IEEE float (the test above changed it) */
+	low_wav_header[4] = (36 + 4 * 4000) & 0xff;
+	low_wav_header[5] = (36 + 4 * 4000) >> 8;
+	low_wav_header[40] = (4 * 4000) & 0xff;
+	low_wav_header[41] = (4 * 4000) >> 8;
+	assert(1 == fwrite(low_wav_header, sizeof(low_wav_header), 1, wav_file));
+	for (i = 0; i < 4000; ++i) {
+		low_wav_sample = 0.5f * sin(2 * M_PI * 49.0 * i / 8000) + 0.25f * sin(2 * M_PI * 98.0 * i / 8000);
+		assert(1 == fwrite(&low_wav_sample, sizeof(low_wav_sample), 1, wav_file));
+	}
+	fclose(wav_file);
+	assert(1 == get_notes_from_file(low_filename, 0.4, notes_from_file, 8));
+	assert(G == notes_from_file[0].semitone && 1 == notes_from_file[0].octave);
+
+	/* a louder tone just above max_freq, where decimating only partly filters it */
+	assert(NULL != (wav_file = fopen(low_filename, "wb")));
+	assert(1 == fwrite(low_wav_header, sizeof(low_wav_header), 1, wav_file));
+	for (i = 0; i < 4000; ++i) {
+		low_wav_sample = 0.25f * sin(2 * M_PI * 440.0 * i / 8000) + 0.5f * sin(2 * M_PI * 1800.0 * i / 8000);
+		assert(1 == fwrite(&low_wav_sample, sizeof(low_wav_sample), 1, wav_file));
+	}
+	fclose(wav_file);
+	init_detection_options(&options);
+	options.max_freq = 1000.0;
+	note_from_file = get_note_from_file_with_options(low_filename, 0.4, &options);
+	assert(A == note_from_file.semitone && 4 == note_from_file.octave);
+	options.max_freq = 0.0;
+	remove(low_filename);
+
+	LOG("get_notes_from_files");
+
+	assert(BATCH_FAILURE_CODE == get_notes_from_files(NULL, 7, 0.234, 2, batch_results));
+	assert(BATCH_FAILURE_CODE == get_notes_from_files(batch_filenames, 7, 0.234, 2, NULL));
+	assert(BATCH_FAILURE_CODE == get_notes_from_files(batch_filenames, 7, -0.234, 2, batch_results));
+	assert(BATCH_SUCCESS_CODE == get_notes_from_files(batch_filenames, 0, 0.234, 2, batch_results));
+	for (int threads = 0; threads <= 8; threads += 3) {
+		assert(BATCH_SUCCESS_CODE == get_notes_from_files(batch_filenames, 7, 0.234, threads, batch_results));
+		for (int i = 0; i < 7; ++i) {
+			note_from_file = get_note_from_file(batch_filenames[i], 0.234);
+			assert(note_from_file.semitone == batch_results[i].semitone && note_from_file.octave == batch_results[i].octave);
+			assert(DOUBLE_EQUALS(note_from_file.cents, batch_results[i].cents));
+		}
+	}
+	assert(Ab == batch_results[1].semitone && 5 == batch_results[1].octave && DOUBLE_EQUALS(batch_results[1].cents, 5.6681983644));
+	assert(UNKNOWN_SEMITONE == batch_results[2].semitone && UNKNOWN_SEMITONE == batch_results[5].semitone);
+
+	LOG("get_note_from_file_float");
+
+	note_from_file = get_note_from_file_float(NULL, .75);
+	assert(UNKNOWN_SEMITONE == note_from_file.semitone);
+
+	note_from_file = get_note_from_file_float("a4.wav", -1.69);
+	assert(UNKNOWN_SEMITONE == note_from_file.semitone);
+
+	note_from_file = get_note_from_file_float("a4.wav", 100);
+	assert(UNKNOWN_SEMITONE == note_from_file.semitone);
+
+	note_from_file = get_note_from_file_float("does_not_exist.wav", 1.0);
+	assert(UNKNOWN_SEMITONE == note_from_file.semitone);
+
+	note_from_file = get_note_from_file_float("a4.wav", 0.5);
+	assert(A == note_from_file.semitone && 4 == note_from_file.octave && DOUBLE_EQUALS(note_from_file.cents, 0.0000000000));
+
+	note_from_file = get_note_from_file_float("g#5-piano.wav", 0.234);
+	assert(Ab == note_from_file.semitone && 5 == note_from_file.octave && DOUBLE_EQUALS(note_from_file.cents, 5.6681983644));
+
+	note_from_file = get_note_from_file_float("f4-piano.wav", 0.345);
+	assert(F == note_from_file.semitone && 4 == note_from_file.octave && DOUBLE_EQUALS(note_from_file.cents, -6.9648619035));
+
+	LOG("get_samples_from_file_float");
+
+	assert(NULL == get_samples_from_file_float("a4.wav", 12, NULL));
+	assert(NULL == get_samples_from_file_float(NULL, 12, &samples_returned) && -1 == samples_returned);
+	assert(NULL == get_samples_from_file_float("a4.wav", 0, &samples_returned) && -1 == samples_returned);
+	assert(NULL == get_samples_from_file_float("does_not_exist.wav", 12, &samples_returned) && -1 == samples_returned);
+	assert(NULL != (wav_samples_float = get_samples_from_file_float("a4.wav", 12, &samples_returned)) && 12 == samples_returned);
+	assert(DOUBLE_EQUALS(wav_samples_float[3], 0.0621588230));
+	assert(DOUBLE_EQUALS(wav_samples_float[11], 0.3059304953));
+
+	LOG("apply_hann_function_float");
+
+	assert(NULL == apply_hann_function_float(NULL, 12));
+	assert(NULL == apply_hann_function_float(wav_samples_float, -12));
+	assert(NULL != (wav_samples_float_hannd = apply_hann_function_float(wav_samples_float, 24)));
+	assert(DOUBLE_EQUALS(wav_samples_float_hannd[3], 0.0621588230 * get_hann_window(24)[3]));
+
+	LOG("get_fft_float");
+
+	assert(NULL == get_fft_float(NULL, 24));
+	assert(NULL == get_fft_float(wav_samples_float_hannd, -24));
+	assert(NULL != (fft_output_float = get_fft_float(wav_samples_float_hannd, 24)));
+	FREE_SAFELY(fft_output_float);
+	FREE_SAFELY(wav_samples_float_hannd);
+	FREE_SAFELY(wav_samples_float);
+
 	LOG("get_fft");
 
 	assert(NULL == get_fft(NULL, 12345));
 	assert(NULL == get_fft(bogus_samples, -123));
 
+	LOG("get_r2c_plan");
+
+	assert(NULL == get_r2c_plan(1024, NULL, (fftw_complex *) bogus_samples));
+	assert(NULL == get_r2c_plan(0, bogus_samples, (fftw_complex *) bogus_samples));
+	assert(FFT_WISDOM_SUCCESS_CODE == tonedef_init(NULL));
+	assert(FFT_WISDOM_FAILURE_CODE == load_fft_wisdom(NULL));
+	assert(FFT_WISDOM_FAILURE_CODE == load_fft_wisdom("does_not_exist.wisdom"));
+	assert(FFT_WISDOM_FAILURE_CODE == save_fft_wisdom(NULL));
+
+	set_fft_planning_rigor(FFT_RIGOR_MEASURE);
+	assert(FFT_RIGOR_MEASURE == get_fft_planning_rigor());
+	set_fft_planning_rigor((enum fft_rigor_t) 42);
+	assert(FFT_RIGOR_MEASURE == get_fft_planning_rigor());
+
+	fft_input = (double *) fftw_malloc(1024 * sizeof(double));
+	for (int i = 0; i < 1024; ++i) {
+		fft_input[i] = sin(2 * M_PI * 32 * i / 1024.0);
+	}
+	assert(NULL != (fft_output = get_fft(fft_input, 1024)));
+	assert(NULL != (fft_output_2 = get_fft(fft_input, 1024)));
+	assert(get_r2c_plan(1024, fft_input, fft_output) == get_r2c_plan(1024, fft_input, fft_output_2));
+	assert(DOUBLE_EQUALS(fft_input[1], sin(2 * M_PI * 32 / 1024.0)));
+	assert(DOUBLE_EQUALS(fft_output[32][1], -512.0) && DOUBLE_EQUALS(fft_output_2[32][1], -512.0));
+	FREE_SAFELY(fft_output);
+	FREE_SAFELY(fft_output_2);
+	fftw_free(fft_input);
+
+	assert(FFT_WISDOM_SUCCESS_CODE == save_fft_wisdom("test.wisdom"));
+	tonedef_cleanup();
+	assert(FFT_WISDOM_SUCCESS_CODE == tonedef_init("test.wisdom"));
+	remove("test.wisdom");
+	remove("test.wisdom" FFT_FLOAT_WISDOM_SUFFIX);
+	set_fft_planning_rigor(FFT_RIGOR_ESTIMATE);
+
 	LOG("get_chord");
 
 	chord = get_chord(NULL);
@@ -271,6 +1092,310 @@ int main(int argc, const char *argv[])
 	chord = get_chord(&node);
 	assert(MAJOR_TRIAD == chord.chord && Bb == chord.tonic && Bb == chord.bass);
 
+	SET_NOTE(test_note_2, E, 4, 1.5);
+	SET_NOTE(test_note_3, Ab, 4, 2.235);
+	SET_NOTE(test_note_4, C, 3, 0.00);
+	node.note = test_note_4;
+	node.next = &node2;
+	node2.note = test_note_2;
+	node2.next = &node3;
+	node3.note = test_note_3;
+	node3.next = NULL;
+	chord = get_chord(&node);
+	assert(AUGMENTED_TRIAD == chord.chord && C == chord.tonic && C == chord.bass);
+	node.note.octave = 5;
+	chord = get_chord(&node);
+	assert(AUGMENTED_TRIAD == chord.chord && C == chord.tonic && E == chord.bass);
+	node3.note.semitone = UNKNOWN_SEMITONE;
+	chord = get_chord(&node);
+	assert(UNKNOWN_CHORD_TYPE == chord.chord && UNKNOWN_SEMITONE == chord.tonic && UNKNOWN_SEMITONE == chord.bass);
+	node.next = NULL;
+	chord = get_chord(&node);
+	assert(UNKNOWN_CHORD_TYPE == chord.chord && UNKNOWN_SEMITONE == chord.tonic && UNKNOWN_SEMITONE == chord.bass);
+
+	LOG("get_chord_from_file");
+
+	chord = get_chord_from_file("c4-e4-g4.wav", 0.4, 6);
+	assert(MAJOR_TRIAD == chord.chord && C == chord.tonic && C == chord.bass);
+
+	chord = get_chord_from_file("c4-e4-g4.wav", 0.4, 2);
+	assert(UNKNOWN_CHORD_TYPE == chord.chord && UNKNOWN_SEMITONE == chord.tonic && UNKNOWN_SEMITONE == chord.bass);
+
+	chord = get_chord_from_file("c4-e4-g4.wav", 0.4, 0);
+	assert(UNKNOWN_CHORD_TYPE == chord.chord);
+
+	chord = get_chord_from_file("does_not_exist.wav", 0.4, 6);
+	assert(UNKNOWN_CHORD_TYPE == chord.chord);
+
+	LOG("get_chromagram_from_file");
+
+	assert(NULL == get_chromagram_from_file("c4-e4-g4.wav", 4096, 2048, 0, NULL));
+	assert(NULL == get_chromagram_from_file("c4-e4-g4.wav", 1, 2048, 0, &notes_returned) && 0 == notes_returned);
+	assert(NULL == get_chromagram_from_file("c4-e4-g4.wav", 4096, 0, 0, &notes_returned));
+	assert(NULL == get_chromagram_from_file("does_not_exist.wav", 4096, 2048, 0, &notes_returned));
+	assert(NULL == get_chromagram_from_file("c4-e4-g4.wav", 1 << 20, 2048, 0, &notes_returned));
+	assert(NULL != (chroma = get_chromagram_from_file("c4-e4-g4.wav", 4096, 2048, 0, &notes_returned)));
+	assert(9 == notes_returned);
+	for (i = 0; i < notes_returned; ++i) {
+		assert(0.9f < chroma[i * CHROMA_NUM_BINS + C] && 0.9f < chroma[i * CHROMA_NUM_BINS + E] && 0.9f < chroma[i * CHROMA_NUM_BINS + G]);
+		assert(0.1f > chroma[i * CHROMA_NUM_BINS + A] && 0.1f > chroma[i * CHROMA_NUM_BINS + Db]);
+	}
+	FREE_SAFELY(chroma);
+	assert(NULL != (chroma = get_chromagram_from_file("a4.wav", 4096, 4096, 3, &notes_returned)));
+	assert(43 == notes_returned && 1.0f == chroma[42 * CHROMA_NUM_BINS + A] && 0.01f > chroma[42 * CHROMA_NUM_BINS + G]);
+	FREE_SAFELY(chroma);
+	assert(NULL != (wav_file = fopen("test-chroma.wav", "wb")));
+	assert(1 == fwrite(float_wav, sizeof(float_wav), 1, wav_file));
+	fclose(wav_file);
+	assert(NULL != (chroma = get_chromagram_from_file("test-chroma.wav", 2, 1, 1, &notes_returned)));
+	assert(1 == notes_returned);
+	FREE_SAFELY(chroma);
+	remove("test-chroma.wav");
+
+	LOG("get_chord_from_chroma");
+
+	assert(NULL != (chroma = get_chromagram_from_file("c4-e4-g4.wav", 4096, 2048, 2, &notes_returned)));
+	chord = get_chord_from_chroma(chroma + 4 * CHROMA_NUM_BINS, 0.5);
+	assert(MAJOR_TRIAD == chord.chord && C == chord.tonic && C == chord.bass);
+	chord = get_chord_from_chroma(chroma, 0.0);
+	assert(UNKNOWN_CHORD_TYPE == chord.chord && UNKNOWN_SEMITONE == chord.tonic && UNKNOWN_SEMITONE == chord.bass);
+	chord = get_chord_from_chroma(NULL, 0.5);
+	assert(UNKNOWN_CHORD_TYPE == chord.chord);
+	chroma[E] = 0.0f;
+	chord = get_chord_from_chroma(chroma, 0.5);
+	assert(UNKNOWN_CHORD_TYPE == chord.chord && UNKNOWN_SEMITONE == chord.bass);
+	FREE_SAFELY(chroma);
+
+	LOG("get_chord_candidates");
+
+	/* an augmented triad is the same set on three tonics, so the bass decides */
+	SET_NOTE(node.note, E, 3, 0.0);
+	SET_NOTE(node2.note, Ab, 4, 0.0);
+	SET_NOTE(node3.note, C, 5, 0.0);
+	node.next = &node2;
+	node2.next = &node3;
+	node3.next = NULL;
+	assert(3 <= get_chord_candidates(&node, chord_candidates, 4));
+	assert(AUGMENTED_TRIAD == chord_candidates[0].chord && E == chord_candidates[0].tonic && E == chord_candidates[0].bass);
+	assert(0 == chord_candidates[0].inversion && DOUBLE_EQUALS(chord_candidates[0].score, 1.0));
+	assert(AUGMENTED_TRIAD == chord_candidates[1].chord && C == chord_candidates[1].tonic && 1 == chord_candidates[1].inversion);
+	assert(AUGMENTED_TRIAD == chord_candidates[2].chord && Ab == chord_candidates[2].tonic && 2 == chord_candidates[2].inversion);
+	assert(DOUBLE_EQUALS(chord_candidates[2].score, 1.0));
+
+	/* a dominant seventh without its fifth, with the seventh in the bass */
+	SET_NOTE(node.note, Bb, 2, 0.0);
+	SET_NOTE(node2.note, C, 4, 0.0);
+	SET_NOTE(node3.note, E, 4, 0.0);
+	assert(1 == get_chord_candidates(&node, chord_candidates, 1));
+	assert(DOMINANT_SEVENTH == chord_candidates[0].chord && C == chord_candidates[0].tonic && Bb == chord_candidates[0].bass);
+	assert(3 == chord_candidates[0].inversion && DOUBLE_EQUALS(chord_candidates[0].score, 0.75));
+	for (i = get_chord_candidates(&node, chord_candidates, 4) - 1; 0 < i; --i) {
+		assert(chord_candidates[i].score <= chord_candidates[i - 1].score);
+		assert(CHORD_MIN_CANDIDATE_SCORE <= chord_candidates[i].score);
+	}
+
+	assert(CHORD_CANDIDATES_FAILURE_CODE == get_chord_candidates(NULL, chord_candidates, 4));
+	assert(CHORD_CANDIDATES_FAILURE_CODE == get_chord_candidates(&node, NULL, 4));
+	assert(CHORD_CANDIDATES_FAILURE_CODE == get_chord_candidates(&node, chord_candidates, 0));
+	node3.note.semitone = UNKNOWN_SEMITONE;
+	assert(CHORD_CANDIDATES_FAILURE_CODE == get_chord_candidates(&node, chord_candidates, 4));
+
+	LOG("get_chord_candidates_from_masks");
+
+	/* a diminished seventh in first inversion, a C9, and silence */
+	chord_masks[0] = SEMITONE_BIT(C) | SEMITONE_BIT(Eb) | SEMITONE_BIT(Gb) | SEMITONE_BIT(A);
+	chord_basses[0] = Eb;
+	chord_masks[1] = SEMITONE_BIT(C) | SEMITONE_BIT(D) | SEMITONE_BIT(E) | SEMITONE_BIT(G) | SEMITONE_BIT(Bb);
+	chord_basses[1] = D;
+	chord_masks[2] = 0;
+	chord_basses[2] = UNKNOWN_SEMITONE;
+	assert(8 == get_chord_candidates_from_masks(chord_masks, chord_basses, 3, chord_candidates, 4, num_chord_candidates));
+	assert(4 == num_chord_candidates[0] && 4 == num_chord_candidates[1] && 0 == num_chord_candidates[2]);
+	assert(DIMINISHED_SEVENTH == chord_candidates[0].chord && Eb == chord_candidates[0].tonic && 0 == chord_candidates[0].inversion);
+	assert(DIMINISHED_SEVENTH == chord_candidates[1].chord && C == chord_candidates[1].tonic && 1 == chord_candidates[1].inversion);
+	assert(DOMINANT_NINTH == chord_candidates[4].chord && C == chord_candidates[4].tonic && 4 == chord_candidates[4].inversion);
+	assert(DOUBLE_EQUALS(chord_candidates[4].score, 1.0) && DOMINANT_ELEVENTH == chord_candidates[5].chord && DOUBLE_EQUALS(chord_candidates[5].score, 5.0 / 6.0));
+
+	/* without the basses, nothing has an inversion */
+	assert(8 == get_chord_candidates_from_masks(chord_masks, NULL, 3, chord_candidates, 4, num_chord_candidates));
+	assert(DIMINISHED_SEVENTH == chord_candidates[0].chord && C == chord_candidates[0].tonic);
+	assert(CHORD_NO_INVERSION == chord_candidates[0].inversion && UNKNOWN_SEMITONE == chord_candidates[0].bass);
+
+	/* the bass counts as one of the semitones */
+	chord_masks[0] = SEMITONE_BIT(E) | SEMITONE_BIT(G);
+	chord_basses[0] = C;
+	assert(0 < get_chord_candidates_from_masks(chord_masks, chord_basses, 1, chord_candidates, 4, num_chord_candidates));
+	assert(MAJOR_TRIAD == chord_candidates[0].chord && C == chord_candidates[0].tonic && 0 == chord_candidates[0].inversion);
+
+	assert(CHORD_CANDIDATES_FAILURE_CODE == get_chord_candidates_from_masks(NULL, NULL, 3, chord_candidates, 4, num_chord_candidates));
+	assert(CHORD_CANDIDATES_FAILURE_CODE == get_chord_candidates_from_masks(chord_masks, NULL, 3, chord_candidates, 0, num_chord_candidates));
+	assert(CHORD_CANDIDATES_FAILURE_CODE == get_chord_candidates_from_masks(chord_masks, NULL, 3, chord_candidates, 4, NULL));
+	assert(0 == get_chord_candidates_from_masks(chord_masks, NULL, 0, chord_candidates, 4, num_chord_candidates));
+	chord_masks[2] = SEMITONE_BIT(SEMITONES_PER_OCTAVE);
+	assert(CHORD_CANDIDATES_FAILURE_CODE == get_chord_candidates_from_masks(chord_masks, NULL, 3, chord_candidates, 4, num_chord_candidates));
+
+	LOG("get_cqt_kernel");
+
+	assert(NULL == get_cqt_kernel(0, 1));
+	assert(NULL == get_cqt_kernel(44100, 0));
+	assert(NULL == get_cqt_kernel(44100, CQT_MAX_BINS_PER_SEMITONE + 1));
+	assert(NULL != (cqt_kernel = get_cqt_kernel(44100, 1)));
+	assert(cqt_kernel == get_cqt_kernel(44100, 1));
+	assert(108 == get_cqt_num_bins(cqt_kernel) && 65536 == get_cqt_fft_size(cqt_kernel) && 1 == get_cqt_bins_per_semitone(cqt_kernel));
+	assert(DOUBLE_EQUALS(get_cqt_bin_freq(cqt_kernel, 57), 440.0));
+	assert(DOUBLE_EQUALS(get_cqt_bin_freq(cqt_kernel, 108), INVALID_FREQUENCY));
+	assert(-1 == get_cqt_num_bins(NULL) && -1 == get_cqt_fft_size(NULL) && -1 == get_cqt_bins_per_semitone(NULL));
+	fft_input = (double *) fftw_malloc(65536 * sizeof(double));
+	cqt = (double *) MALLOC_SAFELY(108 * sizeof(double));
+	for (i = 0; i < 65536; ++i) {
+		fft_input[i] = 0.5 * sin(2 * M_PI * 440.0 * i / 44100);
+	}
+	assert(NULL != (fft_output = get_fft(fft_input, 65536)));
+	apply_cqt_kernel(cqt_kernel, fft_output, cqt);
+	FREE_SAFELY(fft_output);
+	assert(0.49 < cqt[57] && 0.51 > cqt[57] && 0.3 > cqt[56] && 0.3 > cqt[58] && 0.01 > cqt[45]);
+
+	/* C1 and Db1 are only 1.9 Hz apart */
+	for (i = 0; i < 65536; ++i) {
+		fft_input[i] = 0.5 * sin(2 * M_PI * 32.7032 * i / 44100);
+	}
+	assert(NULL != (fft_output = get_fft(fft_input, 65536)));
+	apply_cqt_kernel(cqt_kernel, fft_output, cqt);
+	assert(0.49 < cqt[12] && 0.3 > cqt[13]);
+	FREE_SAFELY(fft_output);
+	FREE_SAFELY(cqt);
+	fftw_free(fft_input);
+	assert(NULL != (cqt_kernel = get_cqt_kernel(8000, 3)));
+	assert(324 == get_cqt_num_bins(cqt_kernel) && DOUBLE_EQUALS(get_cqt_bin_freq(cqt_kernel, 172), 440.0));
+
+	LOG("get_cqt_from_file");
+
+	assert(NULL == get_cqt_from_file("a4.wav", 1, NULL));
+	assert(NULL == get_cqt_from_file(NULL, 1, &cqt_bins) && -1 == cqt_bins);
+	assert(NULL == get_cqt_from_file("does_not_exist.wav", 1, &cqt_bins));
+	assert(NULL == get_cqt_from_file("a4.wav", 0, &cqt_bins));
+	assert(NULL != (cqt = get_cqt_from_file("a4.wav", 1, &cqt_bins)) && 108 == cqt_bins);
+	for (i = 0; i < cqt_bins; ++i) {
+		assert(57 == i || cqt[i] < cqt[57]);
+	}
+	FREE_SAFELY(cqt);
+
+	/* a short file is centered on the kernels */
+	assert(NULL != (cqt = get_cqt_from_file("c4-e4-g4.wav", 1, &cqt_bins)));
+	assert(0.2 < cqt[48] && 0.2 < cqt[52] && 0.2 < cqt[55]);
+	assert(0.05 > cqt[50] && 0.05 > cqt[57] && 0.05 > cqt[36]);
+	FREE_SAFELY(cqt);
+	clear_cqt_kernel_cache();
+
+	LOG("verify_notes");
+
+	expected_notes[0].semitone = A;
+	expected_notes[0].octave = 4;
+	expected_notes[0].cents = 0.0;
+	expected_notes[1].semitone = Db;
+	expected_notes[1].octave = 5;
+	expected_notes[1].cents = 0.0;
+	expected_notes[2].semitone = G;
+	expected_notes[2].octave = 4;
+	expected_notes[2].cents = 0.0;
+	assert(NULL != (wav_samples = (double *) malloc(11025 * sizeof(double))));
+	for (i = 0; i < 11025; ++i) {
+		wav_samples[i] = 0.5 * sin(2 * M_PI * 440.0 * i / 44100) + 0.25 * sin(2 * M_PI * get_freq(&expected_notes[1]) * i / 44100);
+	}
+	assert(VERIFY_NOTES_SUCCESS_CODE == verify_notes(wav_samples, 11025, 44100, expected_notes, 3, 0, VERIFY_DEFAULT_THRESHOLD, verdicts));
+	assert(verdicts[0].passed && 0.01 > fabs(verdicts[0].power - 0.125) && 0.01 > fabs(verdicts[0].relative_power - 0.8));
+	assert(verdicts[1].passed && 0.01 > fabs(verdicts[1].relative_power - 0.2));
+	assert(!verdicts[2].passed && 0.001 > verdicts[2].relative_power && G == verdicts[2].note.semitone);
+	assert(VERIFY_NOTES_SUCCESS_CODE == verify_notes(wav_samples, 11025, 44100, expected_notes, 3, VERIFY_MAX_HARMONICS, 0.5, verdicts));
+	assert(verdicts[0].passed && !verdicts[1].passed && !verdicts[2].passed);
+	assert(VERIFY_NOTES_FAILURE_CODE == verify_notes(NULL, 11025, 44100, expected_notes, 3, 0, 0.1, verdicts));
+	assert(VERIFY_NOTES_FAILURE_CODE == verify_notes(wav_samples, 1, 44100, expected_notes, 3, 0, 0.1, verdicts));
+	assert(VERIFY_NOTES_FAILURE_CODE == verify_notes(wav_samples, 11025, 44100, expected_notes, 0, 0, 0.1, verdicts));
+	assert(VERIFY_NOTES_FAILURE_CODE == verify_notes(wav_samples, 11025, 44100, expected_notes, VERIFY_MAX_NOTES + 1, 0, 0.1, verdicts));
+	assert(VERIFY_NOTES_FAILURE_CODE == verify_notes(wav_samples, 11025, 44100, expected_notes, 3, -1, 0.1, verdicts));
+	assert(VERIFY_NOTES_FAILURE_CODE == verify_notes(wav_samples, 11025, 44100, expected_notes, 3, 0, 0.0, verdicts));
+	expected_notes[2].octave = OCTAVE_MAX + 1;
+	assert(VERIFY_NOTES_FAILURE_CODE == verify_notes(wav_samples, 11025, 44100, expected_notes, 3, 0, 0.1, verdicts));
+	FREE_SAFELY(wav_samples);
+
+	LOG("verify_notes_from_file");
+
+	expected_notes[0].semitone = C;
+	expected_notes[1].semitone = E;
+	expected_notes[2].semitone = G;
+	expected_notes[3].semitone = A;
+	expected_notes[0].octave = expected_notes[1].octave = expected_notes[2].octave = expected_notes[3].octave = 4;
+	expected_notes[3].cents = 0.0;
+	assert(VERIFY_NOTES_SUCCESS_CODE == verify_notes_from_file("c4-e4-g4.wav", 0.25, expected_notes, 4, 2, VERIFY_DEFAULT_THRESHOLD, verdicts));
+	assert(verdicts[0].passed && verdicts[1].passed && verdicts[2].passed && !verdicts[3].passed);
+	assert(VERIFY_NOTES_FAILURE_CODE == verify_notes_from_file(NULL, 0.25, expected_notes, 4, 2, 0.1, verdicts));
+	assert(VERIFY_NOTES_FAILURE_CODE == verify_notes_from_file("c4-e4-g4.wav", 0.0, expected_notes, 4, 2, 0.1, verdicts));
+	assert(VERIFY_NOTES_FAILURE_CODE == verify_notes_from_file("c4-e4-g4.wav", 10.0, expected_notes, 4, 2, 0.1, verdicts));
+	assert(VERIFY_NOTES_FAILURE_CODE == verify_notes_from_file("does_not_exist.wav", 0.25, expected_notes, 4, 2, 0.1, verdicts));
+
+	LOG("get_key_estimate");
+
+	assert(NULL == create_key_estimator(0.0) && NULL == create_key_estimator(1.5));
+	assert(NULL != (key_estimator = create_key_estimator(KEY_DEFAULT_DECAY)));
+	key = get_key_estimate(key_estimator);
+	assert(UNKNOWN_SEMITONE == key.tonic && UNKNOWN_SCALE_TYPE == key.scale && 0.0 == key.correlation);
+	key = get_key_estimate(NULL);
+	assert(UNKNOWN_SEMITONE == key.tonic && UNKNOWN_SCALE_TYPE == key.scale);
+
+	/* a C major scale, then its tonic triad */
+	for (i = 0; i < 8; ++i) {
+		SET_NOTE(test_note, c_major_scale[i], 4, 0.0);
+		assert(KEY_ESTIMATOR_SUCCESS_CODE == push_notes_to_key_estimator(key_estimator, &test_note, 1));
+	}
+	SET_NOTE(expected_notes[0], C, 4, 0.0);
+	SET_NOTE(expected_notes[1], E, 4, 0.0);
+	SET_NOTE(expected_notes[2], G, 4, 0.0);
+	assert(KEY_ESTIMATOR_SUCCESS_CODE == push_notes_to_key_estimator(key_estimator, expected_notes, 3));
+	key = get_key_estimate(key_estimator);
+	assert(C == key.tonic && MAJOR_SCALE == key.scale && 0.7 < key.correlation && 1.0 >= key.correlation);
+	assert(is_semitone_in_scale(get_scale(key.scale, key.tonic), B));
+	assert(KEY_ESTIMATOR_SUCCESS_CODE == get_key_correlations(key_estimator, key_correlations));
+	assert(DOUBLE_EQUALS(key_correlations[C], key.correlation));
+	for (i = 0, key_correlation_sum = 0.0; i < SEMITONES_PER_OCTAVE; ++i) {
+		key_correlation_sum += key_correlations[i];
+	}
+	assert(DOUBLE_EQUALS(key_correlation_sum, 0.0));
+	assert(KEY_ESTIMATOR_FAILURE_CODE == get_key_correlations(key_estimator, NULL));
+	assert(KEY_ESTIMATOR_FAILURE_CODE == push_notes_to_key_estimator(key_estimator, NULL, 1));
+	assert(KEY_ESTIMATOR_FAILURE_CODE == push_notes_to_key_estimator(NULL, expected_notes, 1));
+	assert(KEY_ESTIMATOR_SUCCESS_CODE == push_notes_to_key_estimator(key_estimator, NULL, 0));
+
+	/* an A harmonic minor scale with its tonic triad replaces it over time */
+	for (i = 0; i < 200; ++i) {
+		SET_NOTE(expected_notes[0], a_harmonic_minor_scale[i % 7], 4, 0.0);
+		SET_NOTE(expected_notes[1], (i % 2) ? A : E, 3, 0.0);
+		SET_NOTE(expected_notes[2], UNKNOWN_SEMITONE, INVALID_OCTAVE, INVALID_CENTS);
+		assert(KEY_ESTIMATOR_SUCCESS_CODE == push_notes_to_key_estimator(key_estimator, expected_notes, 3));
+	}
+	key = get_key_estimate(key_estimator);
+	assert(A == key.tonic && NATURAL_MINOR_SCALE == key.scale);
+
+	reset_key_estimator(key_estimator);
+	assert(UNKNOWN_SEMITONE == get_key_estimate(key_estimator).tonic);
+
+	LOG("push_chroma_to_key_estimator");
+
+	/* D minor: D, F, and A, then the same again with a passing E */
+	for (i = 0; i < 2 * CHROMA_NUM_BINS; ++i) {
+		key_chroma[i] = 0.05f;
+	}
+	key_chroma[D] = key_chroma[F] = key_chroma[A] = 1.0f;
+	key_chroma[CHROMA_NUM_BINS + D] = key_chroma[CHROMA_NUM_BINS + F] = key_chroma[CHROMA_NUM_BINS + A] = 1.0f;
+	key_chroma[CHROMA_NUM_BINS + E] = 0.5f;
+	key_chroma[CHROMA_NUM_BINS + Gb] = -1.0f;
+	assert(KEY_ESTIMATOR_SUCCESS_CODE == push_chroma_to_key_estimator(key_estimator, key_chroma, 2));
+	key = get_key_estimate(key_estimator);
+	assert(D == key.tonic && NATURAL_MINOR_SCALE == key.scale);
+	assert(KEY_ESTIMATOR_FAILURE_CODE == push_chroma_to_key_estimator(key_estimator, NULL, 2));
+	assert(KEY_ESTIMATOR_FAILURE_CODE == push_chroma_to_key_estimator(key_estimator, key_chroma, -1));
+	destroy_key_estimator(key_estimator);
+	destroy_key_estimator(NULL);
+
 	/* we use the TESTING macro to avoid the call to exit(...) during testing */
 	assert(NULL == detect_oom(NULL));
 
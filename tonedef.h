@@ -7,8 +7,23 @@
 #ifndef TONEDEF_H
 #define TONEDEF_H
 
+#include "batch.h"
 #include "chord.h"
+#include "chroma.h"
 #include "common.h"
+#include "cqt.h"
+#include "dsp.h"
+#include "fft.h"
+#include "goertzel.h"
+#include "key.h"
+#include "live.h"
+#include "onset.h"
+#include "scale.h"
+#include "singleprec.h"
+#include "source.h"
+#include "stats.h"
+#include "stream.h"
 #include "utils.h"
+#include "workspace.h"
 
 #endif
@@ -8,6 +8,12 @@
 #include <stdlib.h>
 #include "utils.h"
 
+/*
+ * Every allocation in the library goes through detect_oom(), so counting them
+ * there (per thread, so that threads don't contend) tells us how many we make.
+ */
+static __thread long	allocation_count = 0;
+
 /*
  * Static wrapper function for memory allocation functions.
  *
@@ -23,7 +29,18 @@ void *detect_oom(void *ptr)
 #ifndef TESTING
 		exit(EXIT_FAILURE_CODE);
 #endif
+	} else {
+		++allocation_count;
 	}
 
 	return ptr;
 }
+
+/*
+ * This function returns the number of allocations made by the library on the
+ * calling thread so far.
+ */
+long get_allocation_count(void)
+{
+	return allocation_count;
+}
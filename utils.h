@@ -11,11 +11,13 @@
 #define EXIT_FAILURE_CODE	1
 
 #define MIN(a, b)		((a < b) ? (a) : (b))
-#define AUDIO_SAMPLE_BUFSIZE	512
+#define MAX(a, b)		((a > b) ? (a) : (b))
 #define MALLOC_SAFELY(a)	detect_oom(malloc(a))
 #define CALLOC_SAFELY(a, b)	detect_oom(calloc(a, b))
+#define REALLOC_SAFELY(a, b)	detect_oom(realloc(a, b))
 #define FREE_SAFELY(a)		free(a); a = NULL
 
-void *detect_oom(void *ptr);
+void	*detect_oom(void *ptr);
+long	get_allocation_count(void);
 
 #endif
@@ -0,0 +1,117 @@
+/*
+ *  workspace.c
+ *
+ *  Copyright (C) 2016  Nathan Bossart
+ */
+
+#include <assert.h>
+#include <fftw3.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "source.h"
+#include "utils.h"
+#include "workspace.h"
+
+/*
+ * This function creates a workspace big enough to analyze max_samples frames
+ * of max_channels channels each without allocating.  If either is 0, nothing
+ * is allocated up front, and the workspace grows on first use.
+ *
+ * Returns NULL for illegal arguments.  The workspace must be freed with
+ * destroy_workspace().
+ */
+struct tonedef_workspace *create_workspace(long max_samples, int max_channels)
+{
+	struct tonedef_workspace	*workspace;
+
+	if (0 > max_samples || 0 > max_channels) {
+		fprintf(stderr, "max_samples and max_channels cannot be negative\n");
+		return NULL;
+	}
+
+	workspace = (struct tonedef_workspace *) CALLOC_SAFELY(1, sizeof(struct tonedef_workspace));
+	if (0 < max_samples) {
+		reserve_workspace(workspace, max_samples, max_channels);
+	}
+
+	return workspace;
+}
+
+/*
+ * This function frees the workspace and all of its buffers (and closes the
+ * sound file it last read, if any).  It is safe to call with NULL.
+ */
+void destroy_workspace(struct tonedef_workspace *workspace)
+{
+	if (NULL == workspace) {
+		return;
+	}
+
+	close_source(workspace->source);
+	FREE_SAFELY(workspace->frames);
+	fftw_free(workspace->samples);
+	fftw_free(workspace->scratch);
+	fftw_free(workspace->spectrum);
+	fftw_free(workspace->scratch_spectrum);
+	FREE_SAFELY(workspace);
+}
+
+/*
+ * This function makes sure the workspace can hold num_samples frames of
+ * num_channels channels each, growing (but never shrinking) its buffers if it
+ * can't yet.  Growing is the only time a workspace allocates, so a workspace
+ * created big enough never does.  Passing zero for num_channels reserves no
+ * room for frames, which memory-mapped sources don't need.
+ *
+ * Returns WORKSPACE_FAILURE_CODE for illegal arguments.
+ */
+int reserve_workspace(struct tonedef_workspace *workspace, long num_samples, int num_channels)
+{
+	if (NULL == workspace || 0 >= num_samples || 0 > num_channels) {
+		return WORKSPACE_FAILURE_CODE;
+	}
+
+	if (workspace->frames_size < num_samples * num_channels) {
+		FREE_SAFELY(workspace->frames);
+		workspace->frames_size = num_samples * num_channels;
+		workspace->frames = (double *) MALLOC_SAFELY(workspace->frames_size * sizeof(double));
+	}
+
+	if (workspace->max_samples < num_samples) {
+		fftw_free(workspace->samples);
+		fftw_free(workspace->scratch);
+		fftw_free(workspace->spectrum);
+		fftw_free(workspace->scratch_spectrum);
+		workspace->max_samples = num_samples;
+		workspace->samples = (double *) detect_oom(fftw_malloc(num_samples * sizeof(double)));
+		workspace->scratch = (double *) detect_oom(fftw_malloc(num_samples * sizeof(double)));
+		workspace->spectrum = (fftw_complex *) detect_oom(fftw_malloc((num_samples / 2 + 1) * sizeof(fftw_complex)));
+		workspace->scratch_spectrum = (fftw_complex *) detect_oom(fftw_malloc((num_samples / 2 + 1) * sizeof(fftw_complex)));
+	}
+
+	return WORKSPACE_SUCCESS_CODE;
+}
+
+/*
+ * This function opens the sound file with the workspace's source, which is
+ * only allocated the first time.  The source belongs to the workspace and must
+ * not be closed by the caller; the file stays open until the next call or until
+ * the workspace is destroyed.
+ *
+ * Returns NULL if the file could not be opened.
+ */
+struct tonedef_source *open_workspace_source(struct tonedef_workspace *workspace, const char * const filename)
+{
+	assert(NULL != workspace);
+
+	if (NULL == workspace->source) {
+		workspace->source = open_source(filename);
+		return workspace->source;
+	}
+
+	if (SOURCE_SUCCESS_CODE != reopen_source(workspace->source, filename)) {
+		return NULL;
+	}
+
+	return workspace->source;
+}
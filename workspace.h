@@ -0,0 +1,53 @@
+/*
+ *  workspace.h
+ *
+ *  Copyright (C) 2016  Nathan Bossart
+ */
+
+#ifndef WORKSPACE_H
+#define WORKSPACE_H
+
+#include <fftw3.h>
+#include "source.h"
+
+/* return codes for reserve_workspace() */
+#define WORKSPACE_SUCCESS_CODE	0
+#define WORKSPACE_FAILURE_CODE	-1
+
+/*
+ * Buffers for analyzing a sound file, allocated once and reused by every
+ * analysis that is handed the workspace (see the workspace member of struct
+ * detection_options).  Once the workspace is big enough for the longest
+ * window, analysis makes no heap allocations of its own.  A workspace may only
+ * be used by one thread at a time; give each thread its own.
+ *
+ * The members are managed by the functions below and shouldn't be changed by
+ * the caller.
+ *
+ * max_samples      : number of (mono) samples the buffers can hold
+ * frames_size      : number of doubles frames can hold
+ * frames           : interleaved frames read from the sound file
+ * samples          : the mixed down (and maybe windowed) samples
+ * scratch          : another buffer of max_samples samples
+ * spectrum         : max_samples / 2 + 1 bins
+ * scratch_spectrum : another max_samples / 2 + 1 bins
+ * source           : a source that is reopened for every sound file
+ */
+struct tonedef_workspace
+{
+	long			max_samples;
+	long			frames_size;
+	double *		frames;
+	double *		samples;
+	double *		scratch;
+	fftw_complex *		spectrum;
+	fftw_complex *		scratch_spectrum;
+	struct tonedef_source *	source;
+};
+
+struct tonedef_workspace	*create_workspace(long max_samples, int max_channels);
+void				destroy_workspace(struct tonedef_workspace *workspace);
+int				reserve_workspace(struct tonedef_workspace *workspace, long num_samples, int num_channels);
+struct tonedef_source		*open_workspace_source(struct tonedef_workspace *workspace, const char * const filename);
+
+#endif